@@ -1,12 +1,146 @@
 #include "assembler.h"
 #include "instruction_set.h"
 #include "opcodes.h"
+#include "executable_file_format.h"
+#include "vector_unit.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <strings.h>
 
 #define MAX_LINE_LENGTH 256
 
+// Operand layouts of the SDSCKS instruction words (see instruction_decoder.c)
+typedef enum {
+    FORMAT_NONE,   // HALT, FENCE, ECALL, ERET, WFI, EBREAK, RET
+    FORMAT_RRR,    // Rd, Rs1, Rs2
+    FORMAT_CMP,    // Rs1, Rs2
+    FORMAT_RRI,    // Rd, Rs1, Imm16
+    FORMAT_LI,     // Rd, Imm21
+    FORMAT_MEM,    // Rd, Address21
+    FORMAT_JUMP,   // Address26
+    FORMAT_JR,     // Rs
+    FORMAT_BRANCH, // Rs1, Rs2, Label (16-bit offset from the next instruction)
+    FORMAT_ATOMIC, // Rd, (Rs1)[, Rs2]
+    FORMAT_OFFSET, // Rd, Offset16(Rs1)
+    FORMAT_VRRR,   // Vd, Vs1, Vs2 (.W suffix for 32-bit lanes)
+    FORMAT_VMEM,   // Vd, Offset16(Rs1)
+    FORMAT_VREDUCE, // Rd, Vs1 (.W suffix for 32-bit lanes)
+    FORMAT_VSPLAT, // Vd, Rs1 (.W suffix for 32-bit lanes)
+    FORMAT_FRRR,   // Fd, Fs1, Fs2
+    FORMAT_FRR,    // Fd, Fs1
+    FORMAT_FRRRR,  // Fd, Fs1, Fs2, Fs3
+    FORMAT_FCMP,   // Rd, Fs1, Fs2
+    FORMAT_ITOF,   // Fd, Rs1
+    FORMAT_FTOI,   // Rd, Fs1
+    FORMAT_FMEM,   // Fd, Offset16(Rs1)
+    FORMAT_CSRR,   // Rd, Csr
+    FORMAT_CSRW    // Csr, Rs1
+} operand_format_t;
+
+// Structure describing how one mnemonic is encoded
+typedef struct {
+    const char *mnemonic;
+    uint32_t opcode;
+    operand_format_t format;
+} instruction_encoding_t;
+
+static const instruction_encoding_t instruction_table[] = {
+    { "ADD", OP_ADD, FORMAT_RRR },
+    { "SUB", OP_SUB, FORMAT_RRR },
+    { "MUL", OP_MUL, FORMAT_RRR },
+    { "DIV", OP_DIV, FORMAT_RRR },
+    { "AND", OP_AND, FORMAT_RRR },
+    { "OR", OP_OR, FORMAT_RRR },
+    { "XOR", OP_XOR, FORMAT_RRR },
+    { "SLL", OP_SLL, FORMAT_RRR },
+    { "SRL", OP_SRL, FORMAT_RRR },
+    { "SRA", OP_SRA, FORMAT_RRR },
+    { "CMP", OP_CMP, FORMAT_CMP },
+    { "ADDI", OP_ADDI, FORMAT_RRI },
+    { "SUBI", OP_SUBI, FORMAT_RRI },
+    { "ANDI", OP_ANDI, FORMAT_RRI },
+    { "ORI", OP_ORI, FORMAT_RRI },
+    { "XORI", OP_XORI, FORMAT_RRI },
+    { "LI", OP_LI, FORMAT_LI },
+    { "LOAD", OP_LOAD, FORMAT_MEM },
+    { "STORE", OP_STORE, FORMAT_MEM },
+    { "LB", OP_LB, FORMAT_OFFSET },
+    { "LH", OP_LH, FORMAT_OFFSET },
+    { "LW", OP_LW, FORMAT_OFFSET },
+    { "LD", OP_LD, FORMAT_OFFSET },
+    { "SB", OP_SB, FORMAT_OFFSET },
+    { "SH", OP_SH, FORMAT_OFFSET },
+    { "SW", OP_SW, FORMAT_OFFSET },
+    { "SD", OP_SD, FORMAT_OFFSET },
+    { "MEMCPY", OP_MEMCPY, FORMAT_RRR },
+    { "MEMSET", OP_MEMSET, FORMAT_RRR },
+    { "JMP", OP_JMP, FORMAT_JUMP },
+    { "JR", OP_JR, FORMAT_JR },
+    { "JAL", OP_JAL, FORMAT_JUMP },
+    { "JALR", OP_JALR, FORMAT_JR },
+    { "RET", OP_RET, FORMAT_NONE },
+    { "BEQ", OP_BEQ, FORMAT_BRANCH },
+    { "BNE", OP_BNE, FORMAT_BRANCH },
+    { "LR", OP_LR, FORMAT_ATOMIC },
+    { "SC", OP_SC, FORMAT_ATOMIC },
+    { "CAS", OP_CAS, FORMAT_ATOMIC },
+    { "VADD", OP_VADD, FORMAT_VRRR },
+    { "VSUB", OP_VSUB, FORMAT_VRRR },
+    { "VMUL", OP_VMUL, FORMAT_VRRR },
+    { "VAND", OP_VAND, FORMAT_VRRR },
+    { "VOR", OP_VOR, FORMAT_VRRR },
+    { "VXOR", OP_VXOR, FORMAT_VRRR },
+    { "VSLL", OP_VSLL, FORMAT_VRRR },
+    { "VSRL", OP_VSRL, FORMAT_VRRR },
+    { "VSRA", OP_VSRA, FORMAT_VRRR },
+    { "VCMPEQ", OP_VCMPEQ, FORMAT_VRRR },
+    { "VCMPLT", OP_VCMPLT, FORMAT_VRRR },
+    { "VLOAD", OP_VLOAD, FORMAT_VMEM },
+    { "VSTORE", OP_VSTORE, FORMAT_VMEM },
+    { "VREDSUM", OP_VREDSUM, FORMAT_VREDUCE },
+    { "VSPLAT", OP_VSPLAT, FORMAT_VSPLAT },
+    { "FADD", OP_FADD, FORMAT_FRRR },
+    { "FSUB", OP_FSUB, FORMAT_FRRR },
+    { "FMUL", OP_FMUL, FORMAT_FRRR },
+    { "FDIV", OP_FDIV, FORMAT_FRRR },
+    { "FSQRT", OP_FSQRT, FORMAT_FRR },
+    { "FMADD", OP_FMADD, FORMAT_FRRRR },
+    { "FEQ", OP_FEQ, FORMAT_FCMP },
+    { "FLT", OP_FLT, FORMAT_FCMP },
+    { "FLE", OP_FLE, FORMAT_FCMP },
+    { "FCVTDL", OP_FCVTDL, FORMAT_ITOF },
+    { "FCVTLD", OP_FCVTLD, FORMAT_FTOI },
+    { "FMVDX", OP_FMVDX, FORMAT_ITOF },
+    { "FMVXD", OP_FMVXD, FORMAT_FTOI },
+    { "FLD", OP_FLD, FORMAT_FMEM },
+    { "FSD", OP_FSD, FORMAT_FMEM },
+    { "FENCE", OP_FENCE, FORMAT_NONE },
+    { "ECALL", OP_ECALL, FORMAT_NONE },
+    { "ERET", OP_ERET, FORMAT_NONE },
+    { "CSRR", OP_CSRR, FORMAT_CSRR },
+    { "CSRW", OP_CSRW, FORMAT_CSRW },
+    { "WFI", OP_WFI, FORMAT_NONE },
+    { "EBREAK", OP_EBREAK, FORMAT_NONE },
+    { "HALT", OP_HALT, FORMAT_NONE },
+};
+
+// Names of the control and status registers accepted by CSRR and CSRW
+static const struct {
+    const char *name;
+    uint32_t number;
+} csr_names[] = {
+    { "STATUS", CSR_STATUS },
+    { "VECTOR", CSR_VECTOR },
+    { "EPC", CSR_EPC },
+    { "CAUSE", CSR_CAUSE },
+    { "TVAL", CSR_TVAL },
+    { "IE", CSR_IE },
+    { "IP", CSR_IP },
+    { "SCRATCH", CSR_SCRATCH },
+    { "HARTID", CSR_HARTID },
+};
+
 // Helper function to trim leading and trailing whitespace from a string
 char *trim(char *str) {
     char *start = str;
@@ -32,10 +166,15 @@ assembly_line_t *tokenize_line(char *line, int line_number) {
     tokens->operand1 = NULL;
     tokens->operand2 = NULL;
     tokens->operand3 = NULL;
+    tokens->operand4 = NULL;
     tokens->line_number = line_number;
 
+    char *comment = strchr(line, ';');
+    if (comment) {
+        *comment = '\0'; // Comments run to the end of the line
+    }
     line = trim(line);
-    if (*line == '\0' || *line == ';') { // Empty line or comment
+    if (*line == '\0') { // Empty line or comment
         return tokens;
     }
 
@@ -60,6 +199,10 @@ assembly_line_t *tokenize_line(char *line, int line_number) {
                 token = strtok_r(NULL, " \t,", &saveptr);
                 if (token) {
                     tokens->operand3 = strdup(token);
+                    token = strtok_r(NULL, " \t,", &saveptr);
+                    if (token) {
+                        tokens->operand4 = strdup(token);
+                    }
                 }
             }
         }
@@ -75,6 +218,7 @@ void free_assembly_line(assembly_line_t *line) {
         free(line->operand1);
         free(line->operand2);
         free(line->operand3);
+        free(line->operand4);
         free(line);
     }
 }
@@ -130,48 +274,382 @@ symbol_t *assemble_pass1(FILE *inputFile, long *program_size) {
     return symbolTable;
 }
 
+// Helper function to parse a register operand ("R5", or "(R5)" for the address of an atomic)
+static bool parse_register(const char *operand, bool parenthesized, uint32_t *reg) {
+    if (!operand) {
+        return false;
+    }
+    if (parenthesized) {
+        size_t length = strlen(operand);
+        if (length < 2 || operand[0] != '(' || operand[length - 1] != ')') {
+            return false;
+        }
+        char inner[16];
+        if (length - 2 >= sizeof(inner)) {
+            return false;
+        }
+        memcpy(inner, operand + 1, length - 2);
+        inner[length - 2] = '\0';
+        return parse_register(inner, false, reg);
+    }
+    if ((operand[0] != 'R' && operand[0] != 'r') || !isdigit((unsigned char)operand[1])) {
+        return false;
+    }
+    char *end;
+    unsigned long index = strtoul(operand + 1, &end, 10);
+    if (*end != '\0' || index >= NUM_REGISTERS) {
+        return false;
+    }
+    *reg = (uint32_t)index;
+    return true;
+}
+
+// Helper function to parse a vector register operand ("V5")
+static bool parse_vector_register(const char *operand, uint32_t *reg) {
+    if (!operand || (operand[0] != 'V' && operand[0] != 'v') || !isdigit((unsigned char)operand[1])) {
+        return false;
+    }
+    char *end;
+    unsigned long index = strtoul(operand + 1, &end, 10);
+    if (*end != '\0' || index >= NUM_VECTOR_REGISTERS) {
+        return false;
+    }
+    *reg = (uint32_t)index;
+    return true;
+}
+
+// Helper function to parse a floating point register operand ("F5")
+static bool parse_fp_register(const char *operand, uint32_t *reg) {
+    if (!operand || (operand[0] != 'F' && operand[0] != 'f') || !isdigit((unsigned char)operand[1])) {
+        return false;
+    }
+    char *end;
+    unsigned long index = strtoul(operand + 1, &end, 10);
+    if (*end != '\0' || index >= NUM_FP_REGISTERS) {
+        return false;
+    }
+    *reg = (uint32_t)index;
+    return true;
+}
+
+// Helper function to parse a numeric operand or the address of a label
+static bool parse_value(const char *operand, symbol_t *symbolTable, int64_t *value) {
+    if (!operand) {
+        return false;
+    }
+    if (isdigit((unsigned char)operand[0]) || operand[0] == '-' || operand[0] == '+') {
+        char *end;
+        if (operand[0] == '-') {
+            *value = (int64_t)strtoll(operand, &end, 0);
+        } else {
+            *value = (int64_t)strtoull(operand, &end, 0); // Full 64-bit patterns such as 0xFFFF000000000000
+        }
+        return *end == '\0';
+    }
+    symbol_t *symbol = find_symbol(symbolTable, operand);
+    if (!symbol) {
+        return false;
+    }
+    *value = (int64_t)symbol->address;
+    return true;
+}
+
+// Helper function to parse a base register with an optional offset ("8(R2)", "-4(R2)" or "(R2)")
+static bool parse_offset_operand(const char *operand, symbol_t *symbolTable, int64_t *offset, uint32_t *reg) {
+    if (!operand) {
+        return false;
+    }
+    const char *open = strchr(operand, '(');
+    if (!open) {
+        return false;
+    }
+    *offset = 0;
+    if (open != operand) {
+        char value[64];
+        size_t length = (size_t)(open - operand);
+        if (length >= sizeof(value)) {
+            return false;
+        }
+        memcpy(value, operand, length);
+        value[length] = '\0';
+        if (!parse_value(value, symbolTable, offset)) {
+            return false;
+        }
+    }
+    return parse_register(open, true, reg);
+}
+
+// Helper function to parse a control and status register, by name or by number
+static bool parse_csr(const char *operand, uint32_t *csr) {
+    if (!operand) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(csr_names) / sizeof(csr_names[0]); i++) {
+        if (strcasecmp(csr_names[i].name, operand) == 0) {
+            *csr = csr_names[i].number;
+            return true;
+        }
+    }
+    char *end;
+    unsigned long number = strtoul(operand, &end, 0);
+    if (!isdigit((unsigned char)operand[0]) || *end != '\0' || number >= CSR_COUNT) {
+        return false;
+    }
+    *csr = (uint32_t)number;
+    return true;
+}
+
+// Helper function to check that a value fits a signed field of the given width
+static bool fits_signed(int64_t value, int bits) {
+    return value >= -((int64_t)1 << (bits - 1)) && value < ((int64_t)1 << (bits - 1));
+}
+
+// Helper function to find the encoding of a mnemonic (case-insensitive)
+static const instruction_encoding_t *find_encoding(const char *mnemonic) {
+    for (size_t i = 0; i < sizeof(instruction_table) / sizeof(instruction_table[0]); i++) {
+        if (strcasecmp(instruction_table[i].mnemonic, mnemonic) == 0) {
+            return &instruction_table[i];
+        }
+    }
+    return NULL;
+}
+
+bool encode_instruction(const assembly_line_t *line, symbol_t *symbolTable, uint64_t address, uint64_t *instruction_word) {
+    // .word emits a raw 64-bit value (a number or the address of a label)
+    if (strcasecmp(line->mnemonic, ".word") == 0) {
+        int64_t value;
+        if (!parse_value(line->operand1, symbolTable, &value) || line->operand2) {
+            fprintf(stderr, "Error: .word expects one value on line %d\n", line->line_number);
+            return false;
+        }
+        *instruction_word = (uint64_t)value;
+        return true;
+    }
+
+    // Vector mnemonics take a lane width suffix: .D (64-bit lanes, the default) or .W (32-bit lanes)
+    char mnemonic[MAX_LINE_LENGTH];
+    snprintf(mnemonic, sizeof(mnemonic), "%s", line->mnemonic);
+    char *suffix = strchr(mnemonic, '.');
+    bool narrow = false;
+    if (suffix && suffix != mnemonic) {
+        narrow = strcasecmp(suffix, ".W") == 0;
+        if (!narrow && strcasecmp(suffix, ".D") != 0) {
+            fprintf(stderr, "Error: Unknown lane width '%s' on line %d\n", suffix, line->line_number);
+            return false;
+        }
+        *suffix = '\0';
+    }
+
+    const instruction_encoding_t *encoding = find_encoding(mnemonic);
+    bool takes_width = encoding && (encoding->format == FORMAT_VRRR || encoding->format == FORMAT_VREDUCE ||
+                                    encoding->format == FORMAT_VSPLAT);
+    if (!encoding || (suffix && suffix != mnemonic && !takes_width)) {
+        fprintf(stderr, "Error: Unknown mnemonic '%s' on line %d\n", line->mnemonic, line->line_number);
+        return false;
+    }
+
+    uint64_t word = (uint64_t)encoding->opcode << OPCODE_SHIFT;
+    if (narrow) {
+        word |= (uint64_t)1 << VECTOR_NARROW_BIT;
+    }
+    uint32_t rd = 0, rs1 = 0, rs2 = 0, rs3 = 0;
+    int64_t value = 0;
+    bool ok = true;
+    const char *problem = "Incorrect operands";
+
+    switch (encoding->format) {
+        case FORMAT_NONE:
+            ok = !line->operand1;
+            break;
+        case FORMAT_RRR:
+            ok = parse_register(line->operand1, false, &rd) && parse_register(line->operand2, false, &rs1) &&
+                 parse_register(line->operand3, false, &rs2);
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21);
+            break;
+        case FORMAT_CMP:
+            ok = parse_register(line->operand1, false, &rs1) && parse_register(line->operand2, false, &rs2) &&
+                 !line->operand3;
+            word |= ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21);
+            break;
+        case FORMAT_RRI:
+            ok = parse_register(line->operand1, false, &rd) && parse_register(line->operand2, false, &rs1) &&
+                 parse_value(line->operand3, symbolTable, &value);
+            if (ok && !fits_signed(value, 16)) {
+                ok = false;
+                problem = "Immediate does not fit in 16 bits";
+            }
+            word |= ((uint64_t)rd << 21) | ((uint64_t)rs1 << 16) | ((uint64_t)value & 0xFFFF);
+            break;
+        case FORMAT_LI:
+            ok = parse_register(line->operand1, false, &rd) && parse_value(line->operand2, symbolTable, &value) &&
+                 !line->operand3;
+            if (ok && !fits_signed(value, 21)) {
+                ok = false;
+                problem = "Immediate does not fit in 21 bits";
+            }
+            word |= ((uint64_t)rd << 21) | ((uint64_t)value & 0x1FFFFF);
+            break;
+        case FORMAT_MEM:
+            ok = parse_register(line->operand1, false, &rd) && parse_value(line->operand2, symbolTable, &value) &&
+                 !line->operand3;
+            if (ok && (value < 0 || value > 0x1FFFFF)) {
+                ok = false;
+                problem = "Address does not fit in 21 bits";
+            }
+            word |= ((uint64_t)rd << 21) | ((uint64_t)value & 0x1FFFFF);
+            break;
+        case FORMAT_JUMP:
+            ok = parse_value(line->operand1, symbolTable, &value) && !line->operand2;
+            if (ok && (value < 0 || value > 0x3FFFFFF)) {
+                ok = false;
+                problem = "Jump target does not fit in 26 bits";
+            }
+            word |= (uint64_t)value & 0x3FFFFFF;
+            break;
+        case FORMAT_JR:
+            ok = parse_register(line->operand1, false, &rs1) && !line->operand2;
+            word |= (uint64_t)rs1 << 21;
+            break;
+        case FORMAT_BRANCH:
+            ok = parse_register(line->operand1, false, &rs1) && parse_register(line->operand2, false, &rs2);
+            if (ok && line->operand3 && find_symbol(symbolTable, line->operand3)) {
+                // Labels are converted to an offset from the next instruction
+                value = (int64_t)(find_symbol(symbolTable, line->operand3)->address - (address + sizeof(uint64_t)));
+            } else {
+                ok = parse_value(line->operand3, symbolTable, &value);
+            }
+            if (ok && !fits_signed(value, 16)) {
+                ok = false;
+                problem = "Branch offset does not fit in 16 bits";
+            }
+            word |= ((uint64_t)rs1 << 21) | ((uint64_t)rs2 << 16) | ((uint64_t)value & 0xFFFF);
+            break;
+        case FORMAT_ATOMIC:
+            ok = parse_register(line->operand1, false, &rd) && parse_register(line->operand2, true, &rs1);
+            if (encoding->opcode == OP_LR) {
+                ok = ok && !line->operand3;
+            } else {
+                ok = parse_register(line->operand3, false, &rs2);
+            }
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21);
+            break;
+        case FORMAT_OFFSET:
+            ok = parse_register(line->operand1, false, &rd) &&
+                 parse_offset_operand(line->operand2, symbolTable, &value, &rs1) && !line->operand3;
+            if (ok && !fits_signed(value, 16)) {
+                ok = false;
+                problem = "Offset does not fit in 16 bits";
+            }
+            word |= ((uint64_t)rd << 21) | ((uint64_t)rs1 << 16) | ((uint64_t)value & 0xFFFF);
+            break;
+        case FORMAT_VRRR:
+            ok = parse_vector_register(line->operand1, &rd) && parse_vector_register(line->operand2, &rs1) &&
+                 parse_vector_register(line->operand3, &rs2);
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21);
+            break;
+        case FORMAT_VMEM:
+            ok = parse_vector_register(line->operand1, &rd) &&
+                 parse_offset_operand(line->operand2, symbolTable, &value, &rs1) && !line->operand3;
+            if (ok && !fits_signed(value, 16)) {
+                ok = false;
+                problem = "Offset does not fit in 16 bits";
+            }
+            word |= ((uint64_t)rd << 21) | ((uint64_t)rs1 << 16) | ((uint64_t)value & 0xFFFF);
+            break;
+        case FORMAT_VREDUCE:
+            ok = parse_register(line->operand1, false, &rd) && parse_vector_register(line->operand2, &rs1) &&
+                 !line->operand3;
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16);
+            break;
+        case FORMAT_VSPLAT:
+            ok = parse_vector_register(line->operand1, &rd) && parse_register(line->operand2, false, &rs1) &&
+                 !line->operand3;
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16);
+            break;
+        case FORMAT_FRRR:
+            ok = parse_fp_register(line->operand1, &rd) && parse_fp_register(line->operand2, &rs1) &&
+                 parse_fp_register(line->operand3, &rs2);
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21);
+            break;
+        case FORMAT_FRR:
+            ok = parse_fp_register(line->operand1, &rd) && parse_fp_register(line->operand2, &rs1) && !line->operand3;
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16);
+            break;
+        case FORMAT_FRRRR:
+            ok = parse_fp_register(line->operand1, &rd) && parse_fp_register(line->operand2, &rs1) &&
+                 parse_fp_register(line->operand3, &rs2) && parse_fp_register(line->operand4, &rs3);
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21) | ((uint64_t)rs3 << FP_RS3_SHIFT);
+            break;
+        case FORMAT_FCMP:
+            ok = parse_register(line->operand1, false, &rd) && parse_fp_register(line->operand2, &rs1) &&
+                 parse_fp_register(line->operand3, &rs2);
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21);
+            break;
+        case FORMAT_ITOF:
+            ok = parse_fp_register(line->operand1, &rd) && parse_register(line->operand2, false, &rs1) &&
+                 !line->operand3;
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16);
+            break;
+        case FORMAT_FTOI:
+            ok = parse_register(line->operand1, false, &rd) && parse_fp_register(line->operand2, &rs1) &&
+                 !line->operand3;
+            word |= ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16);
+            break;
+        case FORMAT_FMEM:
+            ok = parse_fp_register(line->operand1, &rd) &&
+                 parse_offset_operand(line->operand2, symbolTable, &value, &rs1) && !line->operand3;
+            if (ok && !fits_signed(value, 16)) {
+                ok = false;
+                problem = "Offset does not fit in 16 bits";
+            }
+            word |= ((uint64_t)rd << 21) | ((uint64_t)rs1 << 16) | ((uint64_t)value & 0xFFFF);
+            break;
+        case FORMAT_CSRR: {
+            uint32_t csr = 0;
+            ok = parse_register(line->operand1, false, &rd) && parse_csr(line->operand2, &csr) && !line->operand3;
+            word |= ((uint64_t)rd << 21) | csr;
+            break;
+        }
+        case FORMAT_CSRW: {
+            uint32_t csr = 0;
+            ok = parse_csr(line->operand1, &csr) && parse_register(line->operand2, false, &rs1) && !line->operand3;
+            word |= ((uint64_t)rs1 << 16) | csr;
+            break;
+        }
+    }
+
+    if (line->operand4 && encoding->format != FORMAT_FRRRR) {
+        ok = false; // Only FMADD takes a fourth operand
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: %s for %s on line %d\n", problem, encoding->mnemonic, line->line_number);
+        return false;
+    }
+    *instruction_word = word;
+    return true;
+}
+
 bool assemble_pass2(FILE *inputFile, symbol_t *symbolTable, FILE *outputFile) {
     char line[MAX_LINE_LENGTH];
     int line_number = 1;
+    uint64_t current_address = 0;
     bool success = true;
 
     while (fgets(line, sizeof(line), inputFile)) {
         assembly_line_t *tokens = tokenize_line(line, line_number++);
         if (tokens->mnemonic) {
             uint64_t instruction_word = 0;
-            // Here you would implement the logic to translate the assembly mnemonic
-            // and operands into the 64-bit machine code instruction based on
-            // your SDSCKS instruction set definition (opcodes.h and instruction format).
-
-            // Example for a simple ADD instruction: ADD Rd, Rs1, Rs2
-            if (strcmp(tokens->mnemonic, "ADD") == 0) {
-                if (tokens->operand1 && tokens->operand2 && tokens->operand3) {
-                    int rd = atoi(tokens->operand1 + 1); // Assuming registers are R0, R1, etc.
-                    int rs1 = atoi(tokens->operand2 + 1);
-                    int rs2 = atoi(tokens->operand3 + 1);
-                    if (rd >= 0 && rd < NUM_REGISTERS && rs1 >= 0 && rs1 < NUM_REGISTERS && rs2 >= 0 && rs2 < NUM_REGISTERS) {
-                        instruction_word = ((uint64_t)OP_ADD << 58) | ((uint64_t)rd << 11) | ((uint64_t)rs1 << 16) | ((uint64_t)rs2 << 21);
-                        fwrite(&instruction_word, sizeof(uint64_t), 1, outputFile);
-                    } else {
-                        fprintf(stderr, "Error: Invalid register operand on line %d\n", tokens->line_number);
-                        success = false;
-                    }
-                } else {
-                    fprintf(stderr, "Error: Incorrect number of operands for ADD on line %d\n", tokens->line_number);
-                    success = false;
+            if (encode_instruction(tokens, symbolTable, current_address, &instruction_word)) {
+                // Instruction words are stored little-endian
+                uint8_t bytes[sizeof(uint64_t)];
+                for (size_t i = 0; i < sizeof(uint64_t); i++) {
+                    bytes[i] = (uint8_t)(instruction_word >> (i * 8));
                 }
-            }
-            // Implement similar logic for other instructions (SUB, LOAD, STORE, JMP, etc.)
-            // You'll need to parse operands (registers, immediate values, addresses)
-            // and encode them into the instruction word according to your format.
-            else if (strcmp(tokens->mnemonic, "HALT") == 0) {
-                instruction_word = ((uint64_t)OP_HALT << 58);
-                fwrite(&instruction_word, sizeof(uint64_t), 1, outputFile);
-            }
-            else {
-                fprintf(stderr, "Error: Unknown mnemonic '%s' on line %d\n", tokens->mnemonic, tokens->line_number);
+                fwrite(bytes, sizeof(bytes), 1, outputFile);
+            } else {
                 success = false;
             }
+            current_address += sizeof(uint64_t);
         }
         free_assembly_line(tokens);
     }
@@ -179,9 +657,58 @@ bool assemble_pass2(FILE *inputFile, symbol_t *symbolTable, FILE *outputFile) {
     return success;
 }
 
+// Helper function to store a little-endian header field
+static void put_header_field(uint8_t *header, int offset, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        header[offset + i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+// Helper function to write the header page of an executable whose code segment has been written
+static bool write_executable_header(FILE *outputFile, uint64_t code_size) {
+    uint8_t header[EXECUTABLE_SEGMENT_ALIGNMENT];
+    memset(header, 0, sizeof(header));
+    put_header_field(header, EXECUTABLE_MAGIC_OFFSET, SDSCKS_EXECUTABLE_MAGIC, 4);
+    put_header_field(header, EXECUTABLE_VERSION_OFFSET, EXECUTABLE_FILE_VERSION, 2);
+    put_header_field(header, EXECUTABLE_CODE_ADDRESS_OFFSET, 0, 8);
+    put_header_field(header, EXECUTABLE_CODE_SIZE_OFFSET, code_size, 8);
+    put_header_field(header, EXECUTABLE_CODE_FILE_OFFSET, EXECUTABLE_SEGMENT_ALIGNMENT, 8);
+    put_header_field(header, EXECUTABLE_ENTRY_POINT_OFFSET, 0, 8);
+    return fseek(outputFile, 0, SEEK_SET) == 0 && fwrite(header, sizeof(header), 1, outputFile) == 1;
+}
+
+bool write_symbol_file(const char *path, symbol_t *symbolTable) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Error opening symbol file");
+        return false;
+    }
+    for (symbol_t *symbol = symbolTable; symbol; symbol = symbol->next) {
+        fprintf(file, "0x%016llX %s\n", (unsigned long long)symbol->address, symbol->name);
+    }
+    bool ok = !ferror(file);
+    return fclose(file) == 0 && ok;
+}
+
 int main(int argc, char *argv[]) {
+    // --executable wraps the code in an SDSCKS executable header instead of writing a flat image,
+    // --symbols=FILE writes the label addresses for the VM's profiler
+    bool executable = false;
+    const char *symbol_file = NULL;
+    const char *program = argv[0];
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--executable") == 0) {
+            executable = true;
+        } else if (strncmp(argv[1], "--symbols=", strlen("--symbols=")) == 0) {
+            symbol_file = argv[1] + strlen("--symbols=");
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
     if (argc != 3) {
-        fprintf(stderr, "Usage: %s <input_assembly_file> <output_binary_file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--executable] [--symbols=FILE] <input_assembly_file> <output_binary_file>\n", program);
         return 1;
     }
 
@@ -204,7 +731,18 @@ int main(int argc, char *argv[]) {
 
     rewind(inputFile); // Ensure we read from the beginning for the second pass
 
-    if (assemble_pass2(inputFile, symbolTable, outputFile)) {
+    if (executable) {
+        // The code segment starts after the header page
+        fseek(outputFile, EXECUTABLE_SEGMENT_ALIGNMENT, SEEK_SET);
+    }
+    bool success = assemble_pass2(inputFile, symbolTable, outputFile);
+    if (success && executable) {
+        success = write_executable_header(outputFile, (uint64_t)program_size);
+    }
+    if (success && symbol_file) {
+        success = write_symbol_file(symbol_file, symbolTable);
+    }
+    if (success) {
         printf("Assembly successful. Output written to %s\n", argv[2]);
     } else {
         fprintf(stderr, "Assembly failed.\n");
@@ -222,5 +760,5 @@ int main(int argc, char *argv[]) {
         current = next;
     }
 
-    return 0;
+    return success ? 0 : 1;
 }
\ No newline at end of file
@@ -15,6 +15,7 @@ typedef struct {
     char *operand1;
     char *operand2;
     char *operand3;
+    char *operand4; // Only FMADD takes four operands
     int line_number;
 } assembly_line_t;
 
@@ -31,6 +32,12 @@ symbol_t *assemble_pass1(FILE *inputFile, long *program_size);
 // Function to perform the second pass of the assembler (code generation)
 bool assemble_pass2(FILE *inputFile, symbol_t *symbolTable, FILE *outputFile);
 
+// Function to encode one tokenized instruction at address (labels are resolved through symbolTable)
+bool encode_instruction(const assembly_line_t *line, symbol_t *symbolTable, uint64_t address, uint64_t *instruction_word);
+
+// Function to write the labels as a symbol file ("0x<address> <name>" per line)
+bool write_symbol_file(const char *path, symbol_t *symbolTable);
+
 // Helper function to tokenize a line of assembly code
 assembly_line_t *tokenize_line(char *line, int line_number);
 
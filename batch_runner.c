@@ -0,0 +1,443 @@
+#include "batch_runner.h"
+#include "trap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define BATCH_MAX_LINE_LENGTH 4096
+
+// Structure representing a program loaded once and cloned for each guest that runs it
+typedef struct {
+    char *path;
+    vm_state_t vm; // Never run; its memory is frozen and shared by the clones
+    bool loaded;
+    bool failed;
+} batch_template_t;
+
+// Lifecycle of one guest
+typedef enum {
+    GUEST_PENDING, // Not started yet (programs are loaded by the first worker that runs them)
+    GUEST_RUNNING,
+    GUEST_HALTED,
+    GUEST_FAILED
+} batch_guest_status_t;
+
+// Structure representing one guest of the batch
+typedef struct {
+    char *path;
+    size_t template_index;
+    vm_state_t vm;
+    batch_guest_status_t status;
+    uint64_t slices;
+    uint64_t instructions;
+    uint64_t program_counter; // Final state, kept after the VM is destroyed
+    reg_t registers[NUM_REGISTERS];
+    vm_fault_t fault;         // Why a failed guest stopped
+} batch_guest_t;
+
+// Structure representing the run queue of one worker (a ring buffer of guest indices)
+typedef struct {
+    pthread_mutex_t lock;
+    size_t *items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+} batch_queue_t;
+
+// Structure holding the shared state of a batch run
+typedef struct {
+    const batch_options_t *options;
+    batch_guest_t *guests;
+    size_t guest_count;
+    batch_template_t *templates; // One per distinct program
+    size_t template_count;
+    pthread_mutex_t template_lock;
+    batch_queue_t *queues; // One per worker
+    uint32_t worker_count;
+    size_t remaining;      // Guests that have not finished yet
+    uint64_t steals;
+} batch_t;
+
+// Structure passed to each worker thread
+typedef struct {
+    batch_t *batch;
+    uint32_t id;
+    unsigned int seed; // Picks the first victim when stealing
+} batch_worker_t;
+
+// Helper function to allocate memory or exit
+static void *batch_alloc(size_t size) {
+    void *block = malloc(size);
+    if (!block) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return block;
+}
+
+// Helper function to initialize an empty run queue that can hold every guest
+static void batch_queue_init(batch_queue_t *queue, size_t capacity) {
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->items = (size_t *)batch_alloc(capacity * sizeof(size_t));
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+}
+
+// Helper function to release a run queue
+static void batch_queue_free(batch_queue_t *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+}
+
+// Helper function to append a guest at the tail of a run queue
+static void batch_queue_push(batch_queue_t *queue, size_t guest) {
+    pthread_mutex_lock(&queue->lock);
+    queue->items[(queue->head + queue->count) % queue->capacity] = guest;
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Helper function to take the guest at the head of a run queue (the owner's end)
+static bool batch_queue_pop(batch_queue_t *queue, size_t *guest) {
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        *guest = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Helper function to take the guest at the tail of a run queue (the thieves' end)
+static bool batch_queue_steal(batch_queue_t *queue, size_t *guest) {
+    bool found = false;
+    // Do not wait for a busy victim, another one may be free
+    if (pthread_mutex_trylock(&queue->lock) != 0) {
+        return false;
+    }
+    if (queue->count > 0) {
+        queue->count--;
+        *guest = queue->items[(queue->head + queue->count) % queue->capacity];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Helper function to find work in the queues of the other workers
+static bool batch_steal(batch_worker_t *worker, size_t *guest) {
+    batch_t *batch = worker->batch;
+    uint32_t start = (uint32_t)rand_r(&worker->seed) % batch->worker_count;
+    for (uint32_t i = 0; i < batch->worker_count; i++) {
+        uint32_t victim = (start + i) % batch->worker_count;
+        if (victim != worker->id && batch_queue_steal(&batch->queues[victim], guest)) {
+            __atomic_fetch_add(&batch->steals, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Helper function to load a program into the VM of its template
+static bool batch_load_template(batch_template_t *template, const batch_options_t *options) {
+    vm_init(&template->vm);
+    template->vm.quiet = true;
+    template->vm.dispatch_mode = options->dispatch_mode;
+    template->vm.fusion_enabled = options->fusion_enabled;
+    template->vm.console.raw = options->console_raw;
+    template->vm.memory.page_limit = options->page_limit; // Inherited by the clones
+    if (!vm_load_program(&template->vm, template->path)) {
+        vm_destroy(&template->vm);
+        return false;
+    }
+    if (options->verify && !vm_verify_program(&template->vm)) {
+        fprintf(stderr, "Program failed verification: %s\n", template->path);
+        vm_destroy(&template->vm);
+        return false;
+    }
+    // Freeze the image now so that cloning it from several workers at once is safe
+    memory_freeze(&template->vm.memory);
+    return true;
+}
+
+// Helper function to start a guest as a clone of its program (loading the program on first use)
+static bool batch_load_guest(batch_t *batch, batch_guest_t *guest) {
+    batch_template_t *template = &batch->templates[guest->template_index];
+    pthread_mutex_lock(&batch->template_lock);
+    if (!template->loaded && !template->failed) {
+        template->loaded = batch_load_template(template, batch->options);
+        template->failed = !template->loaded;
+    }
+    bool loaded = template->loaded;
+    pthread_mutex_unlock(&batch->template_lock);
+
+    if (!loaded || !vm_clone(&template->vm, &guest->vm)) {
+        return false;
+    }
+    return true;
+}
+
+// Helper function to record the final state of a guest and release its VM
+static void batch_finish_guest(batch_guest_t *guest, bool loaded) {
+    if (loaded) {
+        cpu_state_t *cpu = &guest->vm.cpus[0];
+        guest->status = cpu->halted ? GUEST_HALTED : GUEST_FAILED;
+        guest->instructions = cpu->instructions_executed;
+        guest->program_counter = cpu->program_counter;
+        guest->fault = cpu->fault;
+        memcpy(guest->registers, cpu->registers, sizeof(guest->registers));
+        vm_destroy(&guest->vm);
+    } else {
+        guest->status = GUEST_FAILED;
+    }
+}
+
+// Helper function run by each worker thread
+static void *batch_worker_main(void *arg) {
+    batch_worker_t *worker = (batch_worker_t *)arg;
+    batch_t *batch = worker->batch;
+    batch_queue_t *own = &batch->queues[worker->id];
+
+    while (__atomic_load_n(&batch->remaining, __ATOMIC_ACQUIRE) > 0) {
+        size_t index;
+        if (!batch_queue_pop(own, &index) && !batch_steal(worker, &index)) {
+            sched_yield(); // The remaining guests are being run by other workers
+            continue;
+        }
+
+        batch_guest_t *guest = &batch->guests[index];
+        if (guest->status == GUEST_PENDING) {
+            if (!batch_load_guest(batch, guest)) {
+                batch_finish_guest(guest, false);
+                __atomic_fetch_sub(&batch->remaining, 1, __ATOMIC_RELEASE);
+                continue;
+            }
+            guest->status = GUEST_RUNNING;
+        }
+
+        cpu_state_t *cpu = &guest->vm.cpus[0];
+        cpu->fuel = batch->options->quantum;
+        vm_exit_reason_t reason = cpu_run(cpu);
+        guest->slices++;
+        if (reason == VM_EXIT_OUT_OF_FUEL || reason == VM_EXIT_BREAKPOINT) {
+            batch_queue_push(own, index); // Quantum used up (or EBREAK, which nobody debugs here), go to the back of the queue
+        } else {
+            batch_finish_guest(guest, true);
+            __atomic_fetch_sub(&batch->remaining, 1, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+// Helper function to find the template of a program, adding one if it is new
+static size_t batch_find_template(batch_t *batch, const char *path, size_t *capacity) {
+    for (size_t i = 0; i < batch->template_count; i++) {
+        if (strcmp(batch->templates[i].path, path) == 0) {
+            return i;
+        }
+    }
+    if (batch->template_count == *capacity) {
+        *capacity *= 2;
+        batch_template_t *grown = (batch_template_t *)realloc(batch->templates, *capacity * sizeof(batch_template_t));
+        if (!grown) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        batch->templates = grown;
+    }
+    batch_template_t *template = &batch->templates[batch->template_count];
+    memset(template, 0, sizeof(*template));
+    template->path = strdup(path);
+    return batch->template_count++;
+}
+
+// Helper function to read the program paths of a manifest
+static bool batch_read_manifest(const char *manifest, batch_t *batch) {
+    FILE *file = fopen(manifest, "r");
+    if (!file) {
+        perror("Error opening batch manifest");
+        return false;
+    }
+
+    size_t capacity = 64;
+    batch->guests = (batch_guest_t *)batch_alloc(capacity * sizeof(batch_guest_t));
+    batch->guest_count = 0;
+    size_t template_capacity = 16;
+    batch->templates = (batch_template_t *)batch_alloc(template_capacity * sizeof(batch_template_t));
+    batch->template_count = 0;
+
+    char line[BATCH_MAX_LINE_LENGTH];
+    while (fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char *start = line;
+        while (*start && isspace((unsigned char)*start)) {
+            start++;
+        }
+        char *end = start + strlen(start);
+        while (end > start && isspace((unsigned char)end[-1])) {
+            end--;
+        }
+        *end = '\0';
+        if (*start == '\0') {
+            continue;
+        }
+
+        if (batch->guest_count == capacity) {
+            capacity *= 2;
+            batch_guest_t *grown = (batch_guest_t *)realloc(batch->guests, capacity * sizeof(batch_guest_t));
+            if (!grown) {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            batch->guests = grown;
+        }
+        batch_guest_t *guest = &batch->guests[batch->guest_count++];
+        memset(guest, 0, sizeof(*guest));
+        guest->path = strdup(start);
+        guest->template_index = batch_find_template(batch, start, &template_capacity);
+        guest->status = GUEST_PENDING;
+    }
+    fclose(file);
+    return true;
+}
+
+// Helper function to print the outcome of one guest
+static void batch_print_guest(size_t index, const batch_guest_t *guest) {
+    if (guest->status != GUEST_HALTED && guest->slices == 0) {
+        printf("[%zu] %s: failed to load\n", index, guest->path);
+        return;
+    }
+    if (guest->status == GUEST_HALTED) {
+        printf("[%zu] %s: halted", index, guest->path);
+    } else {
+        printf("[%zu] %s: %s fault at 0x%llX", index, guest->path, trap_cause_name(guest->fault.cause),
+               (unsigned long long)guest->fault.pc);
+    }
+    printf(" after %llu instructions in %llu slices, PC 0x%llX", (unsigned long long)guest->instructions,
+           (unsigned long long)guest->slices, (unsigned long long)guest->program_counter);
+    for (int i = 0; i < NUM_REGISTERS; i++) {
+        if (guest->registers[i] != 0) {
+            printf(" R%d=0x%llX", i, (unsigned long long)guest->registers[i]);
+        }
+    }
+    printf("\n");
+}
+
+void batch_default_options(batch_options_t *options) {
+    options->workers = 0;
+    options->quantum = BATCH_DEFAULT_QUANTUM;
+    options->dispatch_mode = VM_DISPATCH_SWITCH;
+    options->fusion_enabled = true;
+    options->console_raw = false;
+    options->verify = false;
+    options->page_limit = 0;
+}
+
+bool batch_run_manifest(const char *manifest, const batch_options_t *options) {
+    batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.options = options;
+    if (!batch_read_manifest(manifest, &batch)) {
+        return false;
+    }
+    if (batch.guest_count == 0) {
+        fprintf(stderr, "Error: Batch manifest %s lists no programs\n", manifest);
+        free(batch.guests);
+        free(batch.templates);
+        return false;
+    }
+    pthread_mutex_init(&batch.template_lock, NULL);
+
+    uint32_t worker_count = options->workers;
+    if (worker_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cores > 0 ? (uint32_t)cores : 1;
+    }
+    if (worker_count > batch.guest_count) {
+        worker_count = (uint32_t)batch.guest_count;
+    }
+    batch.worker_count = worker_count;
+    batch.remaining = batch.guest_count;
+    batch.queues = (batch_queue_t *)batch_alloc(worker_count * sizeof(batch_queue_t));
+    for (uint32_t i = 0; i < worker_count; i++) {
+        batch_queue_init(&batch.queues[i], batch.guest_count);
+    }
+    // Deal the guests out round-robin; stealing evens out the rest
+    for (size_t i = 0; i < batch.guest_count; i++) {
+        batch_queue_push(&batch.queues[i % worker_count], i);
+    }
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    pthread_t *threads = (pthread_t *)batch_alloc(worker_count * sizeof(pthread_t));
+    batch_worker_t *workers = (batch_worker_t *)batch_alloc(worker_count * sizeof(batch_worker_t));
+    uint32_t running_workers = 0;
+    for (uint32_t i = 0; i < worker_count; i++) {
+        workers[i].batch = &batch;
+        workers[i].id = i;
+        workers[i].seed = i * 2654435761u + 1;
+        if (pthread_create(&threads[running_workers], NULL, batch_worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "Error: Could not start batch worker %u\n", i);
+            break;
+        }
+        running_workers++;
+    }
+    if (running_workers == 0) {
+        // Run everything on the calling thread; worker 0 steals the other queues
+        batch_worker_main(&workers[0]);
+    }
+    for (uint32_t i = 0; i < running_workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double seconds = (double)(finished.tv_sec - started.tv_sec) + (double)(finished.tv_nsec - started.tv_nsec) / 1e9;
+
+    uint64_t total_instructions = 0;
+    size_t halted = 0;
+    for (size_t i = 0; i < batch.guest_count; i++) {
+        batch_print_guest(i, &batch.guests[i]);
+        total_instructions += batch.guests[i].instructions;
+        if (batch.guests[i].status == GUEST_HALTED) {
+            halted++;
+        }
+    }
+    printf("\nBatch: %zu guests of %zu programs (%zu halted, %zu failed) on %u workers, quantum %llu instructions, %llu steals\n",
+           batch.guest_count, batch.template_count, halted, batch.guest_count - halted, worker_count,
+           (unsigned long long)options->quantum, (unsigned long long)batch.steals);
+    printf("Executed %llu instructions in %.3f s (%.0f instructions per second)\n",
+           (unsigned long long)total_instructions, seconds, seconds > 0 ? (double)total_instructions / seconds : 0.0);
+
+    for (size_t i = 0; i < batch.guest_count; i++) {
+        free(batch.guests[i].path);
+    }
+    for (size_t i = 0; i < batch.template_count; i++) {
+        if (batch.templates[i].loaded) {
+            vm_destroy(&batch.templates[i].vm);
+        }
+        free(batch.templates[i].path);
+    }
+    pthread_mutex_destroy(&batch.template_lock);
+    free(batch.templates);
+    for (uint32_t i = 0; i < worker_count; i++) {
+        batch_queue_free(&batch.queues[i]);
+    }
+    free(workers);
+    free(threads);
+    free(batch.queues);
+    free(batch.guests);
+    return halted == batch.guest_count;
+}
\ No newline at end of file
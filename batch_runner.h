@@ -0,0 +1,35 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vm.h"
+
+// Batch host mode: every program of a manifest gets its own single-hart VM, and
+// a pool of host threads time-slices the guests. Each worker owns a run queue and
+// runs the guest at its head for one quantum before putting it back at the tail;
+// a worker whose queue is empty steals a guest from another worker's queue.
+// Each distinct program is loaded once; its guests are copy-on-write clones of it.
+
+// Default number of guest instructions run before a guest is rescheduled
+#define BATCH_DEFAULT_QUANTUM 100000
+
+// Structure holding the settings of a batch run
+typedef struct {
+    uint32_t workers;    // Host threads (0: one per online core)
+    uint64_t quantum;    // Instructions per time slice
+    vm_dispatch_mode_t dispatch_mode;
+    bool fusion_enabled;
+    bool verify;         // Verify each program at load time and run it unchecked
+    bool console_raw;    // Guests' consoles copy bytes instead of formatting numbers
+    uint64_t page_limit; // Guest pages each guest may write on top of its program (0: no limit)
+} batch_options_t;
+
+// Function to fill in the default batch settings
+void batch_default_options(batch_options_t *options);
+
+// Function to run every program listed in a manifest (one path per line, '#' starts a comment)
+// and print per-guest results and the aggregate throughput (returns false if any guest failed)
+bool batch_run_manifest(const char *manifest, const batch_options_t *options);
+
+#endif // BATCH_RUNNER_H
\ No newline at end of file
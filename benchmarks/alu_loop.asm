@@ -0,0 +1,18 @@
+; Tight ALU loop: dependent integer arithmetic and logic, no memory traffic.
+; 4M iterations of 9 instructions. R4 holds the checksum.
+        LI R1, 1
+        LI R9, 22
+        SLL R1, R1, R9          ; R1 = iterations
+        LI R2, 12345
+        LI R3, 7
+        LI R4, 0
+loop:   ADD R4, R4, R2
+        XOR R2, R2, R4
+        MUL R5, R2, R3
+        SRL R6, R5, R3
+        AND R7, R6, R2
+        OR R4, R4, R7
+        SUB R2, R2, R3
+        ADDI R1, R1, -1
+        BNE R1, R0, loop
+        HALT
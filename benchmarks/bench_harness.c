@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// Benchmark harness: assembles each SDSCKS kernel with the assembler, runs it with the VM
+// a number of times and reports MIPS, ns per instruction and peak RSS, as a table on
+// stdout and as JSON for regression tracking.
+//
+// Build:  cc -o sdscks-as assembler.c
+//         cc -o sdscks-vm main.c vm.c memory.c instruction_decoder.c predecode_cache.c
+//            instruction_execution.c threaded_interpreter.c jit.c program_verifier.c
+//            superinstructions.c batch_runner.c snapshot.c vector_unit.c profiler.c trace.c
+//            input_output.c block_device.c timer_device.c trap.c -lm -lpthread
+//         cc -o bench_harness benchmarks/bench_harness.c
+// Run:    ./bench_harness --runs=5 --json=bench.json benchmarks/*.asm
+//         ./bench_harness --vm-args="--jit" benchmarks/*.asm
+//
+// The instruction count and the time of each run come from the VM's own --stats output
+// (every dispatch mode and the JIT count the instructions they run), so process start-up
+// and program loading are excluded. Peak RSS is the largest resident set of the VM process
+// over the runs.
+
+#define MAX_VM_ARGS 32
+#define MAX_RUNS 1000
+#define OUTPUT_LIMIT (1 << 20)
+
+// Structure holding the options of the harness
+typedef struct {
+    const char *vm_path;
+    const char *assembler_path;
+    const char *json_path;
+    char *vm_args[MAX_VM_ARGS];
+    int vm_arg_count;
+    int runs;
+} bench_options_t;
+
+// Structure holding the measurements of one kernel
+typedef struct {
+    char name[256];
+    uint64_t instructions;
+    double median_seconds;
+    double min_seconds;
+    double max_seconds;
+    long peak_rss_kib;
+} bench_result_t;
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <kernel.asm>...\n", program);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --vm=PATH         VM binary (default: ./sdscks-vm)\n");
+    fprintf(stderr, "  --assembler=PATH  Assembler binary (default: ./sdscks-as)\n");
+    fprintf(stderr, "  --runs=N          Timed runs per kernel (default: 5)\n");
+    fprintf(stderr, "  --vm-args=ARGS    Space separated options passed to every timed run, e.g. \"--jit\"\n");
+    fprintf(stderr, "  --json=FILE       Write the results as JSON (default: bench_results.json)\n");
+}
+
+// Helper function to split the --vm-args string into separate arguments
+static bool split_vm_args(char *args, bench_options_t *options) {
+    char *saveptr;
+    for (char *token = strtok_r(args, " \t", &saveptr); token; token = strtok_r(NULL, " \t", &saveptr)) {
+        if (options->vm_arg_count == MAX_VM_ARGS) {
+            return false;
+        }
+        options->vm_args[options->vm_arg_count++] = token;
+    }
+    return true;
+}
+
+// Helper function to run a command, capturing its stdout into output. Returns the exit status
+// (-1 if it could not be run) and stores the peak RSS of the child in peak_rss_kib.
+static int run_command(char *const argv[], char *output, size_t output_size, long *peak_rss_kib) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        perror("Error creating pipe");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Error starting process");
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        execv(argv[0], argv);
+        fprintf(stderr, "Error: Could not run %s\n", argv[0]);
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+    size_t used = 0;
+    char discard[4096];
+    for (;;) {
+        // Keep reading past the buffer so a chatty child never blocks on a full pipe
+        char *target = used + 1 < output_size ? output + used : discard;
+        size_t room = used + 1 < output_size ? output_size - used - 1 : sizeof(discard);
+        ssize_t count = read(pipe_fds[0], target, room);
+        if (count <= 0) {
+            break;
+        }
+        if (target != discard) {
+            used += (size_t)count;
+        }
+    }
+    output[used] = '\0';
+    close(pipe_fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        perror("Error waiting for process");
+        return -1;
+    }
+    if (peak_rss_kib) {
+        *peak_rss_kib = usage.ru_maxrss; // Kilobytes on Linux
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Helper function to find "<key> <number>" in the output of the VM
+static bool find_number(const char *output, const char *key, double *value) {
+    const char *found = strstr(output, key);
+    if (!found) {
+        return false;
+    }
+    char *end;
+    *value = strtod(found + strlen(key), &end);
+    return end != found + strlen(key);
+}
+
+// Helper function to run the VM once on a program with --stats and read its counters
+static bool run_vm(const bench_options_t *options, const char *binary, char *output,
+                   double *instructions, double *seconds, long *peak_rss_kib) {
+    char *argv[MAX_VM_ARGS + 4];
+    int argc = 0;
+    argv[argc++] = (char *)options->vm_path;
+    argv[argc++] = "--stats";
+    for (int i = 0; i < options->vm_arg_count; i++) {
+        argv[argc++] = options->vm_args[i];
+    }
+    argv[argc++] = (char *)binary;
+    argv[argc] = NULL;
+    if (run_command(argv, output, OUTPUT_LIMIT, peak_rss_kib) != 0) {
+        fprintf(stderr, "Error: %s failed on %s\n", options->vm_path, binary);
+        return false;
+    }
+    if (!find_number(output, "Instructions executed:", instructions) ||
+        !find_number(output, "Execution time:", seconds)) {
+        fprintf(stderr, "Error: %s did not report --stats counters\n", options->vm_path);
+        return false;
+    }
+    return true;
+}
+
+// Helper function to compare two run times for qsort
+static int compare_seconds(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper function to derive the name of a kernel from its path ("benchmarks/alu_loop.asm" -> "alu_loop")
+static void kernel_name(const char *path, char *name, size_t size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(name, size, "%s", base);
+    char *dot = strrchr(name, '.');
+    if (dot && dot != name) {
+        *dot = '\0';
+    }
+}
+
+// Function to assemble and measure one kernel
+static bool bench_kernel(const bench_options_t *options, const char *source, const char *work_dir,
+                         char *output, bench_result_t *result) {
+    kernel_name(source, result->name, sizeof(result->name));
+    char binary[4096];
+    snprintf(binary, sizeof(binary), "%s/%s.bin", work_dir, result->name);
+
+    char *assemble_argv[] = { (char *)options->assembler_path, (char *)source, binary, NULL };
+    if (run_command(assemble_argv, output, OUTPUT_LIMIT, NULL) != 0) {
+        fprintf(stderr, "Error: Could not assemble %s\n", source);
+        return false;
+    }
+
+    double times[MAX_RUNS];
+    result->peak_rss_kib = 0;
+    for (int run = 0; run < options->runs; run++) {
+        double instructions;
+        long peak_rss_kib = 0;
+        if (!run_vm(options, binary, output, &instructions, &times[run], &peak_rss_kib)) {
+            unlink(binary);
+            return false;
+        }
+        result->instructions = (uint64_t)instructions; // The same in every run
+        if (peak_rss_kib > result->peak_rss_kib) {
+            result->peak_rss_kib = peak_rss_kib;
+        }
+    }
+    unlink(binary);
+
+    qsort(times, (size_t)options->runs, sizeof(double), compare_seconds);
+    int middle = options->runs / 2;
+    result->median_seconds = options->runs % 2 ? times[middle] : (times[middle - 1] + times[middle]) / 2;
+    result->min_seconds = times[0];
+    result->max_seconds = times[options->runs - 1];
+    return true;
+}
+
+// Helper function to write a string as a JSON string literal
+static void write_json_string(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const char *c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Function to write the results as JSON
+static bool write_json(const bench_options_t *options, const bench_result_t *results, int count) {
+    FILE *file = fopen(options->json_path, "w");
+    if (!file) {
+        perror("Error opening JSON file");
+        return false;
+    }
+    fprintf(file, "{\n  \"vm\": ");
+    write_json_string(file, options->vm_path);
+    fprintf(file, ",\n  \"vm_args\": [");
+    for (int i = 0; i < options->vm_arg_count; i++) {
+        fprintf(file, i ? ", " : "");
+        write_json_string(file, options->vm_args[i]);
+    }
+    fprintf(file, "],\n  \"runs\": %d,\n  \"benchmarks\": [\n", options->runs);
+    for (int i = 0; i < count; i++) {
+        const bench_result_t *r = &results[i];
+        double instructions = (double)r->instructions;
+        fprintf(file, "    {\n      \"name\": ");
+        write_json_string(file, r->name);
+        fprintf(file, ",\n");
+        fprintf(file, "      \"instructions\": %llu,\n", (unsigned long long)r->instructions);
+        fprintf(file, "      \"median_seconds\": %.9f,\n", r->median_seconds);
+        fprintf(file, "      \"min_seconds\": %.9f,\n", r->min_seconds);
+        fprintf(file, "      \"max_seconds\": %.9f,\n", r->max_seconds);
+        fprintf(file, "      \"mips\": %.3f,\n", r->median_seconds > 0 ? instructions / r->median_seconds / 1e6 : 0.0);
+        fprintf(file, "      \"ns_per_instruction\": %.4f,\n", instructions > 0 ? r->median_seconds * 1e9 / instructions : 0.0);
+        fprintf(file, "      \"peak_rss_kib\": %ld\n", r->peak_rss_kib);
+        fprintf(file, "    }%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    bool ok = !ferror(file);
+    return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.vm_path = "./sdscks-vm";
+    options.assembler_path = "./sdscks-as";
+    options.json_path = "bench_results.json";
+    options.runs = 5;
+    int first_kernel = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--vm=", strlen("--vm=")) == 0) {
+            options.vm_path = argv[i] + strlen("--vm=");
+        } else if (strncmp(argv[i], "--assembler=", strlen("--assembler=")) == 0) {
+            options.assembler_path = argv[i] + strlen("--assembler=");
+        } else if (strncmp(argv[i], "--json=", strlen("--json=")) == 0) {
+            options.json_path = argv[i] + strlen("--json=");
+        } else if (strncmp(argv[i], "--runs=", strlen("--runs=")) == 0) {
+            char *end;
+            long runs = strtol(argv[i] + strlen("--runs="), &end, 10);
+            if (*end != '\0' || runs < 1 || runs > MAX_RUNS) {
+                fprintf(stderr, "Error: --runs expects a number between 1 and %d\n", MAX_RUNS);
+                return 1;
+            }
+            options.runs = (int)runs;
+        } else if (strncmp(argv[i], "--vm-args=", strlen("--vm-args=")) == 0) {
+            if (!split_vm_args(argv[i] + strlen("--vm-args="), &options)) {
+                fprintf(stderr, "Error: --vm-args accepts at most %d arguments\n", MAX_VM_ARGS);
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            first_kernel = i;
+            break;
+        }
+    }
+    if (first_kernel == argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    char work_dir[] = "/tmp/sdscks-bench-XXXXXX";
+    if (!mkdtemp(work_dir)) {
+        perror("Error creating work directory");
+        return 1;
+    }
+    char *output = (char *)malloc(OUTPUT_LIMIT);
+    bench_result_t *results = (bench_result_t *)calloc((size_t)(argc - first_kernel), sizeof(bench_result_t));
+    if (!output || !results) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-16s %14s %12s %10s %10s %12s\n", "kernel", "instructions", "median (s)", "MIPS", "ns/instr", "peak RSS KiB");
+    int count = 0;
+    bool ok = true;
+    for (int i = first_kernel; i < argc; i++) {
+        bench_result_t *r = &results[count];
+        if (!bench_kernel(&options, argv[i], work_dir, output, r)) {
+            ok = false;
+            continue;
+        }
+        double instructions = (double)r->instructions;
+        printf("%-16s %14llu %12.6f %10.2f %10.3f %12ld\n", r->name, (unsigned long long)r->instructions,
+               r->median_seconds, r->median_seconds > 0 ? instructions / r->median_seconds / 1e6 : 0.0,
+               instructions > 0 ? r->median_seconds * 1e9 / instructions : 0.0, r->peak_rss_kib);
+        count++;
+    }
+    rmdir(work_dir);
+
+    if (!write_json(&options, results, count)) {
+        ok = false;
+    } else {
+        printf("Results written to %s\n", options.json_path);
+    }
+    free(results);
+    free(output);
+    return ok ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+; Branchy code: a xorshift generator drives data-dependent branches that a
+; predictor cannot learn. 2M iterations. R5-R8 count the paths taken.
+        LI R1, 1
+        LI R9, 21
+        SLL R1, R1, R9          ; R1 = iterations
+        LI R2, 0x5EED           ; Generator state
+        LI R10, 13
+        LI R11, 7
+        LI R12, 17
+loop:   SLL R3, R2, R10
+        XOR R2, R2, R3
+        SRL R3, R2, R11
+        XOR R2, R2, R3
+        SLL R3, R2, R12
+        XOR R2, R2, R3
+        ANDI R4, R2, 1
+        BEQ R4, R0, even
+        ADDI R5, R5, 1
+        ANDI R4, R2, 2
+        BEQ R4, R0, next
+        ADDI R6, R6, 1
+        JMP next
+even:   ADDI R7, R7, 1
+        ANDI R4, R2, 4
+        BNE R4, R0, next
+        ADDI R8, R8, 1
+next:   ADDI R1, R1, -1
+        BNE R1, R0, loop
+        HALT
@@ -0,0 +1,30 @@
+; Call-heavy code: naive recursive fib(27), computed 3 times. Calls pass the
+; argument in R1 and the result in R2, JAL and RET keep the return address in
+; R31 and R30 is the stack pointer. R21 holds 3 * fib(27) = 589254.
+        LI R30, 0xFF000         ; Stack top
+        LI R29, 1
+        LI R20, 3
+main:   LI R1, 27
+        JAL fib
+        ADD R21, R21, R2
+        ADDI R20, R20, -1
+        BNE R20, R0, main
+        HALT
+fib:    SRL R3, R1, R29
+        BNE R3, R0, recurse     ; n >= 2
+        ADDI R2, R1, 0
+        RET
+recurse: ADDI R30, R30, -24
+        SD R31, 0(R30)
+        SD R1, 8(R30)
+        ADDI R1, R1, -1
+        JAL fib
+        SD R2, 16(R30)
+        LD R1, 8(R30)
+        ADDI R1, R1, -2
+        JAL fib
+        LD R3, 16(R30)
+        ADD R2, R2, R3
+        LD R31, 0(R30)
+        ADDI R30, R30, 24
+        RET
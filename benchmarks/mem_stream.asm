@@ -0,0 +1,35 @@
+; Memory streaming: 32 passes over a 1 MiB array at 0x100000, each loading,
+; summing, incrementing and storing back every word. R11 holds the sum.
+        LI R1, 1
+        LI R9, 20
+        SLL R1, R1, R9          ; R1 = array base
+        ADD R2, R1, R1          ; R2 = array end
+        LI R3, 0
+        ADDI R4, R1, 0
+init:   SD R3, 0(R4)
+        ADDI R3, R3, 1
+        ADDI R4, R4, 8
+        BNE R4, R2, init
+        LI R5, 32               ; Passes
+pass:   ADDI R4, R1, 0
+stream: LD R6, 0(R4)
+        LD R7, 8(R4)
+        LD R8, 16(R4)
+        LD R10, 24(R4)
+        ADD R11, R11, R6
+        ADD R11, R11, R7
+        ADD R11, R11, R8
+        ADD R11, R11, R10
+        ADDI R6, R6, 1
+        ADDI R7, R7, 1
+        ADDI R8, R8, 1
+        ADDI R10, R10, 1
+        SD R6, 0(R4)
+        SD R7, 8(R4)
+        SD R8, 16(R4)
+        SD R10, 24(R4)
+        ADDI R4, R4, 32
+        BNE R4, R2, stream
+        ADDI R5, R5, -1
+        BNE R5, R0, pass
+        HALT
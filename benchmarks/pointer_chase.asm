@@ -0,0 +1,34 @@
+; Pointer chasing: 65536 nodes of 64 bytes at 0x100000 linked into a single
+; cycle in a scattered order (index += 40503 mod 65536), then 4M dependent
+; loads walk the cycle. R12 holds the final node address.
+        LI R1, 1
+        LI R9, 20
+        SLL R1, R1, R9          ; R1 = node base
+        LI R2, 0                ; Current index
+        LI R3, 40503            ; Odd step, so the walk visits every node
+        LI R4, 0xFFFF           ; Index mask
+        LI R5, 6                ; log2 of the node size
+        LI R6, 1
+        LI R9, 16
+        SLL R6, R6, R9          ; R6 = nodes
+build:  ADD R7, R2, R3
+        AND R7, R7, R4          ; Next index
+        SLL R10, R2, R5
+        ADD R10, R10, R1
+        SLL R11, R7, R5
+        ADD R11, R11, R1
+        SD R11, 0(R10)          ; node[current].next = &node[next]
+        ADDI R2, R7, 0
+        ADDI R6, R6, -1
+        BNE R6, R0, build
+        ADDI R12, R1, 0
+        LI R13, 1
+        LI R9, 20
+        SLL R13, R13, R9        ; R13 = iterations of 4 hops
+chase:  LD R12, 0(R12)
+        LD R12, 0(R12)
+        LD R12, 0(R12)
+        LD R12, 0(R12)
+        ADDI R13, R13, -1
+        BNE R13, R0, chase
+        HALT
@@ -0,0 +1,291 @@
+#include "block_device.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// Guest pages transferred by one preadv/pwritev call
+#define BLOCK_IOV_MAX 256
+
+// Source of the data written from guest pages that were never touched (never read into)
+static const uint8_t block_zero_page[MEMORY_PAGE_SIZE];
+
+// Helper function to transfer the data of a read or write request (returns the status)
+static uint32_t block_transfer(block_device_t *block, const block_request_t *request) {
+    bool is_write = request->type == BLOCK_REQUEST_WRITE;
+    if (is_write && block->read_only) {
+        return BLOCK_STATUS_IO_ERROR;
+    }
+    uint64_t file_offset = request->sector * BLOCK_SECTOR_SIZE;
+    uint64_t done = 0;
+    while (done < request->length) {
+        // Gather the host pages behind the next part of the guest buffer
+        struct iovec iov[BLOCK_IOV_MAX];
+        int count = 0;
+        uint64_t batch = 0;
+        while (count < BLOCK_IOV_MAX && done + batch < request->length) {
+            uint64_t address = request->address + done + batch;
+            uint64_t chunk = MEMORY_PAGE_SIZE - (address & MEMORY_PAGE_MASK);
+            if (chunk > request->length - done - batch) {
+                chunk = request->length - done - batch;
+            }
+            // Reads need a private page to land in; writes read shared or untouched pages as they are
+            uint8_t *page = memory_get_page(block->memory, address, !is_write);
+            if (!page && !is_write) {
+                return BLOCK_STATUS_NO_MEMORY;
+            }
+            iov[count].iov_base = page ? page + (address & MEMORY_PAGE_MASK) : (void *)block_zero_page;
+            iov[count].iov_len = (size_t)chunk;
+            count++;
+            batch += chunk;
+        }
+        ssize_t transferred = is_write ? pwritev(block->fd, iov, count, (off_t)(file_offset + done))
+                                       : preadv(block->fd, iov, count, (off_t)(file_offset + done));
+        if (transferred < 0 && errno == EINTR) {
+            continue;
+        }
+        if (transferred <= 0) {
+            return BLOCK_STATUS_IO_ERROR;
+        }
+        done += (uint64_t)transferred;
+    }
+    return BLOCK_STATUS_OK;
+}
+
+// Helper function to write the status of a request to its descriptor and count it as completed
+static void block_complete(block_device_t *block, const block_request_t *request, uint32_t status) {
+    // Descriptors are aligned to their size, so the status never straddles a page
+    uint8_t *page = memory_get_page(block->memory, request->descriptor + 4, true);
+    if (page) { // Out of guest pages the status is lost, but COMPLETED still counts the request
+        uint32_t *field = (uint32_t *)(void *)(page + ((request->descriptor + 4) & MEMORY_PAGE_MASK));
+        __atomic_store_n(field, MEMORY_SWAP32(status), __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&block->completed, 1, __ATOMIC_RELEASE);
+}
+
+// Helper function run by each worker thread
+static void *block_worker_main(void *arg) {
+    block_device_t *block = (block_device_t *)arg;
+    pthread_mutex_lock(&block->lock);
+    for (;;) {
+        while (block->queue_head == block->queue_tail && !block->stop) {
+            pthread_cond_wait(&block->work_ready, &block->lock);
+        }
+        if (block->queue_head == block->queue_tail) {
+            break; // Stopping and nothing left to do
+        }
+        block_request_t request = block->queue[block->queue_head % BLOCK_MAX_RING_SIZE];
+        block->queue_head++;
+        pthread_mutex_unlock(&block->lock);
+
+        uint32_t status;
+        if (request.type == BLOCK_REQUEST_FLUSH) {
+            status = fdatasync(block->fd) == 0 ? BLOCK_STATUS_OK : BLOCK_STATUS_IO_ERROR;
+        } else {
+            status = block_transfer(block, &request);
+        }
+        block_complete(block, &request, status);
+
+        pthread_mutex_lock(&block->lock);
+        pthread_cond_broadcast(&block->work_done);
+    }
+    pthread_mutex_unlock(&block->lock);
+    return NULL;
+}
+
+// Helper function to read a descriptor from the ring and check it (returns false for a bad request)
+static bool block_read_descriptor(block_device_t *block, uint64_t index, block_request_t *request) {
+    uint64_t descriptor = block->ring_address + (index & (block->ring_size - 1)) * BLOCK_DESCRIPTOR_SIZE;
+    request->descriptor = descriptor;
+    request->type = (uint32_t)memory_read_word(block->memory, descriptor);
+    request->sector = memory_read_word(block->memory, descriptor + 8);
+    request->address = memory_read_word(block->memory, descriptor + 16);
+    request->length = memory_read_word(block->memory, descriptor + 24);
+    if (request->type == BLOCK_REQUEST_FLUSH) {
+        return true;
+    }
+    if (request->type != BLOCK_REQUEST_READ && request->type != BLOCK_REQUEST_WRITE) {
+        return false;
+    }
+    uint64_t sectors = request->length / BLOCK_SECTOR_SIZE;
+    return request->length % BLOCK_SECTOR_SIZE == 0 && request->sector <= block->capacity &&
+           sectors <= block->capacity - request->sector && request->address + request->length >= request->address;
+}
+
+// Helper function to take the descriptors queued up to notify from the ring; the caller holds the lock
+static void block_take_requests(block_device_t *block, uint64_t notify) {
+    if (block->ring_size == 0) {
+        fprintf(stderr, "Error: Block device notified before its ring was set up\n");
+        return;
+    }
+    if (notify > block->submitted + block->ring_size) {
+        notify = block->submitted + block->ring_size; // More than the ring can hold
+    }
+    while (block->submitted < notify) {
+        block_request_t request;
+        if (!block_read_descriptor(block, block->submitted, &request)) {
+            block_complete(block, &request, BLOCK_STATUS_BAD_REQUEST);
+        } else {
+            while (block->queue_tail - block->queue_head == BLOCK_MAX_RING_SIZE) {
+                pthread_cond_wait(&block->work_done, &block->lock); // The workers are behind
+            }
+            block->queue[block->queue_tail % BLOCK_MAX_RING_SIZE] = request;
+            block->queue_tail++;
+            pthread_cond_signal(&block->work_ready);
+        }
+        __atomic_store_n(&block->submitted, block->submitted + 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Helper function called for guest loads from the device registers
+static uint64_t block_device_read(memory_device_t *device, uint64_t offset, unsigned size) {
+    block_device_t *block = (block_device_t *)device;
+    (void)size;
+    switch (offset & ~(uint64_t)7) {
+        case BLOCK_REG_CAPACITY:
+            return block->capacity;
+        case BLOCK_REG_RING_ADDRESS:
+            return block->ring_address;
+        case BLOCK_REG_RING_SIZE:
+            return block->ring_size;
+        case BLOCK_REG_NOTIFY:
+            return __atomic_load_n(&block->submitted, __ATOMIC_RELAXED);
+        case BLOCK_REG_COMPLETED: {
+            uint64_t completed = __atomic_load_n(&block->completed, __ATOMIC_ACQUIRE);
+            if (completed < __atomic_load_n(&block->submitted, __ATOMIC_RELAXED)) {
+                sched_yield(); // A polling guest lets the workers run when they share its core
+            }
+            return completed;
+        }
+        default:
+            return 0;
+    }
+}
+
+// Helper function called for guest stores to the device registers
+static void block_device_write(memory_device_t *device, uint64_t offset, unsigned size, uint64_t value) {
+    block_device_t *block = (block_device_t *)device;
+    (void)size;
+    pthread_mutex_lock(&block->lock);
+    switch (offset & ~(uint64_t)7) {
+        case BLOCK_REG_RING_ADDRESS:
+            block->ring_address = value & ~(uint64_t)(BLOCK_DESCRIPTOR_SIZE - 1);
+            break;
+        case BLOCK_REG_RING_SIZE:
+            if (value == 0 || value > BLOCK_MAX_RING_SIZE || (value & (value - 1)) != 0) {
+                fprintf(stderr, "Error: Block device ring size %llu is not a power of two up to %d\n",
+                        (unsigned long long)value, BLOCK_MAX_RING_SIZE);
+                block->ring_size = 0;
+            } else {
+                block->ring_size = value;
+            }
+            break;
+        case BLOCK_REG_NOTIFY:
+            block_take_requests(block, value);
+            break;
+        default:
+            break; // Read-only register
+    }
+    pthread_mutex_unlock(&block->lock);
+}
+
+block_device_t *block_device_open(const char *path, vm_memory_t *memory) {
+    bool read_only = false;
+    int fd = open(path, O_RDWR);
+    if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+        fd = open(path, O_RDONLY);
+        read_only = true;
+    }
+    if (fd < 0) {
+        perror("Error opening block device file");
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Error reading block device file");
+        close(fd);
+        return NULL;
+    }
+
+    block_device_t *block = (block_device_t *)calloc(1, sizeof(block_device_t));
+    if (!block) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    block->device.start = BLOCK_DEVICE_ADDRESS;
+    block->device.size = BLOCK_DEVICE_SIZE;
+    block->device.read = block_device_read;
+    block->device.write = block_device_write;
+    block->memory = memory;
+    block->fd = fd;
+    block->read_only = read_only;
+    block->capacity = (uint64_t)info.st_size / BLOCK_SECTOR_SIZE;
+    pthread_mutex_init(&block->lock, NULL);
+    pthread_cond_init(&block->work_ready, NULL);
+    pthread_cond_init(&block->work_done, NULL);
+    for (uint32_t i = 0; i < BLOCK_DEVICE_WORKERS; i++) {
+        if (pthread_create(&block->workers[i], NULL, block_worker_main, block) != 0) {
+            break;
+        }
+        block->worker_count++;
+    }
+    if (block->worker_count == 0) {
+        fprintf(stderr, "Error: Could not start the block device worker threads\n");
+        block_device_close(block);
+        return NULL;
+    }
+    return block;
+}
+
+void block_device_drain(block_device_t *block) {
+    pthread_mutex_lock(&block->lock);
+    while (__atomic_load_n(&block->completed, __ATOMIC_ACQUIRE) < block->submitted) {
+        pthread_cond_wait(&block->work_done, &block->lock);
+    }
+    pthread_mutex_unlock(&block->lock);
+}
+
+void block_device_get_state(block_device_t *block, block_device_state_t *state) {
+    block_device_drain(block);
+    pthread_mutex_lock(&block->lock);
+    state->ring_address = block->ring_address;
+    state->ring_size = block->ring_size;
+    state->submitted = block->submitted;
+    state->completed = block->completed;
+    pthread_mutex_unlock(&block->lock);
+}
+
+bool block_device_set_state(block_device_t *block, const block_device_state_t *state) {
+    if (state->ring_address % BLOCK_DESCRIPTOR_SIZE != 0 || state->ring_size > BLOCK_MAX_RING_SIZE ||
+        (state->ring_size & (state->ring_size - 1)) != 0 || state->completed != state->submitted) {
+        return false;
+    }
+    block_device_drain(block); // Requests of the old guest must not write the new one's memory
+    pthread_mutex_lock(&block->lock);
+    block->ring_address = state->ring_address;
+    block->ring_size = state->ring_size;
+    __atomic_store_n(&block->submitted, state->submitted, __ATOMIC_RELAXED);
+    __atomic_store_n(&block->completed, state->completed, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&block->lock);
+    return true;
+}
+
+void block_device_close(block_device_t *block) {
+    pthread_mutex_lock(&block->lock);
+    block->stop = true;
+    pthread_cond_broadcast(&block->work_ready);
+    pthread_mutex_unlock(&block->lock);
+    for (uint32_t i = 0; i < block->worker_count; i++) {
+        pthread_join(block->workers[i], NULL);
+    }
+    pthread_cond_destroy(&block->work_done);
+    pthread_cond_destroy(&block->work_ready);
+    pthread_mutex_destroy(&block->lock);
+    close(block->fd);
+    free(block);
+}
\ No newline at end of file
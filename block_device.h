@@ -0,0 +1,120 @@
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "memory.h"
+
+// The block device gives a guest DMA access to a host backing file. The guest builds a
+// ring of request descriptors in its own memory, tells the device where the ring is and
+// how many descriptors it has queued, and polls for completions. A pool of host threads
+// serves the requests with preadv/pwritev straight into and out of the host pages behind
+// guest memory, so data is never copied through an intermediate buffer.
+//
+// Registers (64-bit, at BLOCK_DEVICE_ADDRESS + offset):
+//   CAPACITY      load:  size of the backing file in sectors
+//   RING_ADDRESS  load/store: guest address of the descriptor ring (aligned to a descriptor)
+//   RING_SIZE     load/store: number of descriptors in the ring (a power of two)
+//   NOTIFY        store: total number of descriptors queued so far; the device takes
+//                        the new ones from the ring. load: the number taken
+//   COMPLETED     load:  number of requests finished
+//
+// Descriptor (BLOCK_DESCRIPTOR_SIZE bytes, little-endian), slot i of the ring holds
+// the request number i modulo RING_SIZE:
+//   +0  u32 type      BLOCK_REQUEST_READ, BLOCK_REQUEST_WRITE or BLOCK_REQUEST_FLUSH
+//   +4  u32 status    set to BLOCK_STATUS_PENDING by the guest, written by the device
+//   +8  u64 sector    first sector of the transfer
+//   +16 u64 address   guest address of the data
+//   +24 u64 length    bytes to transfer (a multiple of BLOCK_SECTOR_SIZE)
+//
+// Requests may complete out of order. A slot may be reused once its status is no longer
+// pending. The device does not drop decoded copies of code it writes: run FENCE before
+// executing code read from the disk.
+
+#define BLOCK_DEVICE_ADDRESS 0xFFFFE000
+#define BLOCK_DEVICE_SIZE 0x28
+
+// Register offsets
+#define BLOCK_REG_CAPACITY 0x00
+#define BLOCK_REG_RING_ADDRESS 0x08
+#define BLOCK_REG_RING_SIZE 0x10
+#define BLOCK_REG_NOTIFY 0x18
+#define BLOCK_REG_COMPLETED 0x20
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_DESCRIPTOR_SIZE 32
+#define BLOCK_MAX_RING_SIZE 4096
+
+// Request types
+#define BLOCK_REQUEST_READ 0
+#define BLOCK_REQUEST_WRITE 1
+#define BLOCK_REQUEST_FLUSH 2
+
+// Request status
+#define BLOCK_STATUS_PENDING 0
+#define BLOCK_STATUS_OK 1
+#define BLOCK_STATUS_IO_ERROR 2
+#define BLOCK_STATUS_BAD_REQUEST 3 // Unknown type, misaligned length or beyond the end of the disk
+#define BLOCK_STATUS_NO_MEMORY 4   // A read needed a guest page beyond the page limit
+
+// Host threads serving requests
+#define BLOCK_DEVICE_WORKERS 4
+
+// Structure representing one request taken from the ring
+typedef struct {
+    uint64_t descriptor; // Guest address of the descriptor, the status is written back there
+    uint32_t type;
+    uint64_t sector;
+    uint64_t address;
+    uint64_t length;
+} block_request_t;
+
+// Structure holding the registers of a block device with no request in flight (saved in snapshots)
+typedef struct {
+    uint64_t ring_address;
+    uint64_t ring_size;
+    uint64_t submitted;
+    uint64_t completed;
+} block_device_state_t;
+
+// Structure representing a block device and its worker threads
+typedef struct block_device_s {
+    memory_device_t device; // Registered in the VM's address space
+    vm_memory_t *memory;    // Guest memory the requests transfer to and from
+    int fd;
+    bool read_only;
+    uint64_t capacity;      // Sectors
+    uint64_t ring_address;
+    uint64_t ring_size;
+    uint64_t submitted;     // Requests taken from the ring
+    uint64_t completed;     // Requests finished (read by the guest without the lock)
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    block_request_t queue[BLOCK_MAX_RING_SIZE]; // Requests not yet picked up by a worker
+    uint64_t queue_head;
+    uint64_t queue_tail;
+    bool stop;
+    pthread_t workers[BLOCK_DEVICE_WORKERS];
+    uint32_t worker_count;
+} block_device_t;
+
+// Function to open a backing file and start the worker threads (NULL on failure). The file is
+// opened read-only if it cannot be written, write requests then fail with BLOCK_STATUS_IO_ERROR.
+block_device_t *block_device_open(const char *path, vm_memory_t *memory);
+
+// Function to wait until every request taken from the ring has completed
+void block_device_drain(block_device_t *block);
+
+// Function to wait for the outstanding requests and get the registers of the device
+void block_device_get_state(block_device_t *block, block_device_state_t *state);
+
+// Function to wait for the outstanding requests and replace the registers of the device
+// (returns false if the state is not one block_device_get_state can produce)
+bool block_device_set_state(block_device_t *block, const block_device_state_t *state);
+
+// Function to finish the outstanding requests, stop the workers and close the backing file
+void block_device_close(block_device_t *block);
+
+#endif // BLOCK_DEVICE_H
\ No newline at end of file
@@ -2,7 +2,13 @@
 #define CPU_STATE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "instruction_set.h"
+#include "memory.h"
+#include "predecode_cache.h"
+#include "superinstructions.h"
+#include "jit.h"
+#include "vector_unit.h"
 
 // Define the number of general-purpose registers (from instruction_set.h)
 #define NUM_REGISTERS 32
@@ -10,17 +16,70 @@
 // Define the register type (from instruction_set.h)
 typedef uint64_t reg_t;
 
-// Structure representing the state of the SDSCKS virtual CPU
+struct vm_state_s;
+struct profile_s;
+struct trace_ring_s;
+
+// Reason a hart last returned from cpu_run. vm_run reports the last one in this list
+// that any of its harts returned with.
+typedef enum {
+    VM_EXIT_NONE,        // Not run yet
+    VM_EXIT_HALT,        // Executed HALT
+    VM_EXIT_OUT_OF_FUEL, // Used up its fuel; running it again resumes where it stopped
+    VM_EXIT_BREAKPOINT,  // Executed EBREAK; running it again resumes after it
+    VM_EXIT_FAULT        // Stopped by an error (reported on stderr)
+} vm_exit_reason_t;
+
+// Structure describing the fault that stopped a hart (see cpu_fault in trap.h)
 typedef struct {
+    uint64_t cause; // TRAP_CAUSE_* of trap.h
+    uint64_t pc;    // Address of the faulting instruction
+    uint64_t value; // Faulting address or opcode, as CSR_TVAL would hold it
+} vm_fault_t;
+
+// Structure representing the state of one SDSCKS virtual CPU (hart). Every hart
+// has its own registers and its own decoded and compiled copies of the code; the
+// guest memory is shared by all harts of a VM.
+typedef struct cpu_state_s {
     reg_t registers[NUM_REGISTERS];
     uint64_t program_counter;
     // Add other CPU state components here as needed:
     // - Status flags (e.g., zero flag, negative flag, carry flag, overflow flag)
-    uint8_t zero_flag;
-    uint8_t negative_flag;
+    uint8_t zero_flag;     // Set by CMP
+    uint8_t negative_flag; // Set by CMP
     uint8_t carry_flag;
     uint8_t overflow_flag;
+    vector_reg_t vector_registers[NUM_VECTOR_REGISTERS];
+    double fp_registers[NUM_FP_REGISTERS];
     // - Other control registers if your architecture requires them
+    uint32_t hart_id;
+    struct vm_state_s *vm;       // Machine this hart belongs to
+    vm_memory_t *memory;         // Guest address space shared with the other harts
+    memory_tlb_t tlb;            // Host pages of recently accessed guest pages
+    predecode_cache_t predecode; // Decoded copies of recently executed code pages
+    jit_state_t *jit;            // Basic-block compiler, NULL when running interpreted only
+    struct profile_s *profile;   // Counters of --profile, NULL when not profiling
+    struct trace_ring_s *trace_ring; // Records of --trace, NULL when not tracing
+    uint64_t reservation_address; // Address and value seen by the last LR (SC fails unless it still holds)
+    uint64_t reservation_value;
+    bool reservation_valid;
+    // Trap state (see trap.h)
+    uint64_t trap_status;           // CSR_STATUS
+    uint64_t trap_vector;           // CSR_VECTOR, 0 when the guest has not installed a handler
+    uint64_t trap_epc;              // CSR_EPC
+    uint64_t trap_cause;            // CSR_CAUSE
+    uint64_t trap_value;            // CSR_TVAL
+    uint64_t trap_scratch;          // CSR_SCRATCH
+    uint64_t interrupt_enable;      // CSR_IE
+    uint64_t interrupt_pending;     // CSR_IP, set and cleared by devices on other threads
+    uint8_t interrupt_signal;       // Non-zero when the interrupt state must be checked at the next block boundary
+    uint64_t fusion_executed[SUPER_COUNT]; // Superinstructions executed by the threaded loop
+    uint64_t fuel;                  // Instructions the hart may still execute (UINT64_MAX: unlimited), charged per basic block
+    uint64_t instructions_executed; // Instructions executed by every tier, the JIT included
+    vm_exit_reason_t exit_reason;   // Why cpu_run last returned
+    vm_fault_t fault;               // Set when exit_reason is VM_EXIT_FAULT
+    bool halted;                    // Stopped by HALT rather than by an error
+    bool running;
 } cpu_state_t;
 
 #endif // CPU_STATE_H
\ No newline at end of file
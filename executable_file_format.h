@@ -3,18 +3,45 @@
 
 #include <stdint.h>
 
-// Magic number to identify SDSCKS executable files
-#define SDSCKS_EXECUTABLE_MAGIC_0xSDSCKSEXEC
+// Executable file layout (all integers little-endian):
+//   header        the fields below at fixed offsets, padded to EXECUTABLE_SEGMENT_ALIGNMENT
+//   code segment  code_size bytes at file offset code_offset, loaded at code_address
+//   data segment  data_size bytes at file offset data_offset, loaded at data_address
+// Segment offsets and addresses are multiples of EXECUTABLE_SEGMENT_ALIGNMENT so the
+// loader can map the segments straight from the file instead of copying them.
+// Files that do not start with the magic number are loaded as flat images at address 0.
+
+// Magic number to identify SDSCKS executable files (the bytes "SDSX")
+#define SDSCKS_EXECUTABLE_MAGIC 0x58534453
 
 // Version of the executable file format
 #define EXECUTABLE_FILE_VERSION 1
 
-// Structure for the executable file header
+// Size of the header on disk and alignment of the segments (one guest page)
+#define EXECUTABLE_HEADER_SIZE 64
+#define EXECUTABLE_SEGMENT_ALIGNMENT 4096
+
+// File offsets of the header fields
+#define EXECUTABLE_MAGIC_OFFSET 0
+#define EXECUTABLE_VERSION_OFFSET 4
+#define EXECUTABLE_CODE_ADDRESS_OFFSET 8
+#define EXECUTABLE_CODE_SIZE_OFFSET 16
+#define EXECUTABLE_CODE_FILE_OFFSET 24
+#define EXECUTABLE_DATA_ADDRESS_OFFSET 32
+#define EXECUTABLE_DATA_SIZE_OFFSET 40
+#define EXECUTABLE_DATA_FILE_OFFSET 48
+#define EXECUTABLE_ENTRY_POINT_OFFSET 56
+
+// Structure for the executable file header (decoded from the on-disk layout above)
 typedef struct {
     uint32_t magic;
     uint16_t version;
+    uint64_t code_address;
     uint64_t code_size;
+    uint64_t code_offset;
+    uint64_t data_address;
     uint64_t data_size;
+    uint64_t data_offset;
     uint64_t entry_point; // Address of the first instruction to execute
 } executable_file_header_t;
 
@@ -1,24 +1,212 @@
 #include "input_output.h"
-#include <stdio.h>
-
-uint64_t io_read(uint64_t address) {
-    if (address == INPUT_DEVICE_ADDRESS) {
-        // Simulate reading from input (e.g., keyboard)
-        printf("Enter a 64-bit value: ");
-        uint64_t value;
-        scanf("%llu", &value);
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Longest line of a formatted output value: "Output: 0x" + 16 hex digits + " (" + 20 digits + ")\n"
+#define CONSOLE_MAX_LINE 64
+
+// Helper function to write the buffered output; the caller holds the lock
+static void console_flush_locked(console_t *console) {
+    if (console->output_used > 0) {
+        fwrite(console->output, 1, console->output_used, console->output_file);
+        console->output_used = 0;
+    }
+    fflush(console->output_file);
+}
+
+// Helper function to allocate a console buffer on its first use, so a VM that never
+// touches the console does not pay for it
+static uint8_t *console_buffer(uint8_t **buffer) {
+    if (!*buffer) {
+        *buffer = (uint8_t *)malloc(CONSOLE_BUFFER_SIZE);
+        if (!*buffer) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return *buffer;
+}
+
+// Helper function to make room for length more output bytes; the caller holds the lock
+static uint8_t *console_reserve(console_t *console, size_t length) {
+    console_buffer(&console->output);
+    if (console->output_used + length > CONSOLE_BUFFER_SIZE) {
+        fwrite(console->output, 1, console->output_used, console->output_file);
+        console->output_used = 0;
+    }
+    return console->output + console->output_used;
+}
+
+// Helper function to format a number in the given base (10 or 16), returns the number of digits
+static size_t console_format_number(char *out, uint64_t value, unsigned base) {
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = "0123456789ABCDEF"[value % base];
+        value /= base;
+    } while (value != 0);
+    for (size_t i = 0; i < count; i++) {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+// Helper function to append one output value; the caller holds the lock
+static void console_write_value(console_t *console, uint64_t value, unsigned size) {
+    if (console->raw) {
+        uint8_t *out = console_reserve(console, size);
+        for (unsigned i = 0; i < size; i++) {
+            out[i] = (uint8_t)(value >> (i * 8));
+        }
+        console->output_used += size;
+        return;
+    }
+    // Same text as printf("Output: 0x%llX (%llu)\n"), without going through stdio for every value
+    char *out = (char *)console_reserve(console, CONSOLE_MAX_LINE);
+    size_t length = 0;
+    memcpy(out, "Output: 0x", 10);
+    length += 10;
+    length += console_format_number(out + length, value, 16);
+    out[length++] = ' ';
+    out[length++] = '(';
+    length += console_format_number(out + length, value, 10);
+    out[length++] = ')';
+    out[length++] = '\n';
+    console->output_used += length;
+}
+
+// Helper function to get the next input byte, refilling the buffer when it is empty (-1 at the end of the input).
+// The caller holds the lock.
+static int console_next_byte(console_t *console) {
+    if (console->input_start == console->input_end) {
+        if (console->input_eof) {
+            return -1;
+        }
+        console_flush_locked(console); // The guest may have printed a prompt
+        ssize_t count;
+        do {
+            count = read(console->input_fd, console_buffer(&console->input), CONSOLE_BUFFER_SIZE);
+        } while (count < 0 && errno == EINTR);
+        if (count <= 0) {
+            console->input_eof = true;
+            return -1;
+        }
+        console->input_start = 0;
+        console->input_end = (size_t)count;
+    }
+    return console->input[console->input_start++];
+}
+
+// Helper function to read one input value; the caller holds the lock
+static uint64_t console_read_value(console_t *console, unsigned size) {
+    if (console->raw) {
+        uint64_t value = 0;
+        for (unsigned i = 0; i < size; i++) {
+            int byte = console_next_byte(console);
+            if (byte < 0) {
+                break; // Missing bytes read as zero
+            }
+            value |= (uint64_t)byte << (i * 8);
+        }
         return value;
-    } else {
-        fprintf(stderr, "Error: Invalid input device address 0x%llX\n", address);
-        return 0; // Or some error value
     }
+    int c;
+    do {
+        c = console_next_byte(console);
+    } while (c >= 0 && isspace(c));
+    char text[CONSOLE_MAX_LINE];
+    size_t length = 0;
+    while (c >= 0 && !isspace(c)) {
+        if (length + 1 < sizeof(text)) {
+            text[length++] = (char)c;
+        }
+        c = console_next_byte(console);
+    }
+    text[length] = '\0';
+    if (length == 0) {
+        return 0; // End of the input
+    }
+    char *end;
+    uint64_t value = (uint64_t)strtoull(text, &end, 0);
+    if (*end != '\0') {
+        fprintf(stderr, "Error: Invalid console input '%s'\n", text);
+    }
+    return value;
+}
+
+// Helper function to check whether another input value follows (waits for input if needed).
+// The caller holds the lock.
+static bool console_input_exhausted(console_t *console) {
+    for (;;) {
+        int c = console_next_byte(console);
+        if (c < 0) {
+            return true;
+        }
+        if (console->raw || !isspace(c)) {
+            console->input_start--; // Leave the byte for the next INPUT load
+            return false;
+        }
+    }
+}
+
+// Helper function called for guest loads from the console registers
+static uint64_t console_device_read(memory_device_t *device, uint64_t offset, unsigned size) {
+    console_t *console = (console_t *)device;
+    uint64_t address = CONSOLE_STATUS_ADDRESS + offset;
+    uint64_t value = 0;
+    pthread_mutex_lock(&console->lock);
+    if (address >= INPUT_DEVICE_ADDRESS && address < OUTPUT_DEVICE_ADDRESS) {
+        value = console_read_value(console, size);
+    } else if (address < INPUT_DEVICE_ADDRESS) {
+        value = console_input_exhausted(console) ? CONSOLE_STATUS_INPUT_EOF : 0;
+    }
+    pthread_mutex_unlock(&console->lock);
+    return value;
+}
+
+// Helper function called for guest stores to the console registers
+static void console_device_write(memory_device_t *device, uint64_t offset, unsigned size, uint64_t value) {
+    console_t *console = (console_t *)device;
+    uint64_t address = CONSOLE_STATUS_ADDRESS + offset;
+    pthread_mutex_lock(&console->lock);
+    if (address >= OUTPUT_DEVICE_ADDRESS) {
+        console_write_value(console, value, size);
+    } else if (address < INPUT_DEVICE_ADDRESS) {
+        console_flush_locked(console);
+    }
+    pthread_mutex_unlock(&console->lock);
+}
+
+void console_init(console_t *console, bool raw) {
+    memset(console, 0, sizeof(*console));
+    console->device.start = CONSOLE_STATUS_ADDRESS;
+    console->device.size = CONSOLE_DEVICE_SIZE;
+    console->device.read = console_device_read;
+    console->device.write = console_device_write;
+    console->raw = raw;
+    pthread_mutex_init(&console->lock, NULL);
+    console->output_file = stdout;
+    console->input_fd = STDIN_FILENO;
+}
+
+void console_flush(console_t *console) {
+    pthread_mutex_lock(&console->lock);
+    console_flush_locked(console);
+    pthread_mutex_unlock(&console->lock);
 }
 
-void io_write(uint64_t address, uint64_t value) {
-    if (address == OUTPUT_DEVICE_ADDRESS) {
-        // Simulate writing to output (e.g., console)
-        printf("Output: 0x%llX (%llu)\n", value, value);
-    } else {
-        fprintf(stderr, "Error: Invalid output device address 0x%llX, value 0x%llX\n", address, value);
+void console_destroy(console_t *console) {
+    if (!console->device.read) {
+        return; // Never initialized
     }
+    console_flush(console);
+    pthread_mutex_destroy(&console->lock);
+    free(console->output); // Either buffer may never have been allocated
+    free(console->input);
+    console->output = NULL;
+    console->input = NULL;
+    console->device.read = NULL;
 }
\ No newline at end of file
@@ -3,15 +3,57 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "memory.h"
 
-// Define addresses for virtual input/output devices (example)
+// The console is a memory-mapped device with three 64-bit registers:
+//   STATUS  load:  bit 0 is set when no input value is left (waits for input if necessary)
+//           store: flushes the buffered output
+//   INPUT   load:  next value from standard input (0 once the input is exhausted)
+//   OUTPUT  store: value written to standard output
+// In text mode every output value is printed as "Output: 0x<hex> (<decimal>)" on its own
+// line and input values are whitespace separated numbers (decimal, or hex with 0x). In raw
+// mode the bytes of the access are copied as they are, so SB writes one byte and LW reads
+// four bytes. Output is collected in a host buffer that is flushed when it fills up, before
+// the console blocks for input, when a hart halts and when the VM stops, so a guest writing
+// millions of values costs a few large writes rather than one stdio call per value.
+
+// Addresses of the console registers
+#define CONSOLE_STATUS_ADDRESS 0xFFFFFFE8
 #define INPUT_DEVICE_ADDRESS 0xFFFFFFF0
 #define OUTPUT_DEVICE_ADDRESS 0xFFFFFFF8
+#define CONSOLE_DEVICE_SIZE 24
+
+// Bits of the status register
+#define CONSOLE_STATUS_INPUT_EOF 0x1
+
+// Size of the host-side input and output buffers
+#define CONSOLE_BUFFER_SIZE 65536
+
+// Structure representing the console device of a VM
+typedef struct {
+    memory_device_t device;  // Registered in the VM's address space
+    bool raw;                // Copy bytes instead of formatting numbers
+    pthread_mutex_t lock;    // Harts share the console
+    FILE *output_file;
+    int input_fd;
+    uint8_t *output;         // Bytes not yet written to output_file (allocated on the first output)
+    size_t output_used;
+    uint8_t *input;          // Bytes read from input_fd but not yet consumed (allocated on the first input)
+    size_t input_start;
+    size_t input_end;
+    bool input_eof;
+} console_t;
+
+// Function to set up a console on standard input and output
+void console_init(console_t *console, bool raw);
 
-// Function to read from the virtual input device
-uint64_t io_read(uint64_t address);
+// Function to write the buffered output
+void console_flush(console_t *console);
 
-// Function to write to the virtual output device
-void io_write(uint64_t address, uint64_t value);
+// Function to flush and release a console
+void console_destroy(console_t *console);
 
 #endif // INPUT_OUTPUT_H
\ No newline at end of file
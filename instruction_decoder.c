@@ -1,14 +1,22 @@
 #include "instruction_decoder.h"
 #include "opcodes.h"
 
+// Helper function to sign-extend the low bits of an instruction field
+static int64_t sign_extend(uint64_t value, int bits) {
+    uint64_t sign_bit = (uint64_t)1 << (bits - 1);
+    value &= (sign_bit << 1) - 1;
+    return (int64_t)((value ^ sign_bit) - sign_bit);
+}
+
 decoded_instruction_t decode_instruction(uint64_t instruction_word) {
     decoded_instruction_t decoded;
-    decoded.opcode = (uint32_t)(instruction_word >> 58); // Example: Top 6 bits for opcode
+    decoded.opcode = (uint32_t)(instruction_word >> OPCODE_SHIFT); // Top 8 bits for opcode
 
     // Initialize operands to a default value (e.g., 0 or -1)
     decoded.rd = 0;
     decoded.rs1 = 0;
     decoded.rs2 = 0;
+    decoded.rs3 = 0;
     decoded.immediate = 0;
     decoded.address = 0;
 
@@ -24,6 +32,11 @@ decoded_instruction_t decode_instruction(uint64_t instruction_word) {
         case OP_SRL:
         case OP_SRA:
         case OP_CMP:
+        case OP_LR: // LR Rd, (Rs1)
+        case OP_SC: // SC Rd, (Rs1), Rs2
+        case OP_CAS: // CAS Rd, (Rs1), Rs2
+        case OP_MEMCPY: // MEMCPY Rd, Rs1, Rs2
+        case OP_MEMSET:
             decoded.rd = (instruction_word >> 11) & 0x1F;
             decoded.rs1 = (instruction_word >> 16) & 0x1F;
             decoded.rs2 = (instruction_word >> 21) & 0x1F;
@@ -35,11 +48,75 @@ decoded_instruction_t decode_instruction(uint64_t instruction_word) {
         case OP_XORI:
             decoded.rd = (instruction_word >> 21) & 0x1F;
             decoded.rs1 = (instruction_word >> 16) & 0x1F;
-            decoded.immediate = (int64_t)(instruction_word & 0x1FFFFF); // Example: Lower 21 bits for immediate (sign-extended)
+            decoded.immediate = sign_extend(instruction_word, 16); // Lower 16 bits for immediate (sign-extended), Rs1 sits above it
+            break;
+        case OP_LB: // LB Rd, Offset(Rs1)
+        case OP_LH:
+        case OP_LW:
+        case OP_LD:
+        case OP_SB: // SB Rd, Offset(Rs1)
+        case OP_SH:
+        case OP_SW:
+        case OP_SD:
+            decoded.rd = (instruction_word >> 21) & 0x1F;
+            decoded.rs1 = (instruction_word >> 16) & 0x1F;
+            decoded.immediate = sign_extend(instruction_word, 16); // Lower 16 bits for the offset from Rs1
+            break;
+        case OP_VADD: // VADD Vd, Vs1, Vs2
+        case OP_VSUB:
+        case OP_VMUL:
+        case OP_VAND:
+        case OP_VOR:
+        case OP_VXOR:
+        case OP_VSLL:
+        case OP_VSRL:
+        case OP_VSRA:
+        case OP_VCMPEQ:
+        case OP_VCMPLT:
+        case OP_VREDSUM: // VREDSUM Rd, Vs1
+        case OP_VSPLAT: // VSPLAT Vd, Rs1
+            decoded.rd = (instruction_word >> 11) & 0x1F;
+            decoded.rs1 = (instruction_word >> 16) & 0x1F;
+            decoded.rs2 = (instruction_word >> 21) & 0x1F;
+            decoded.immediate = ((instruction_word >> VECTOR_NARROW_BIT) & 1) ? 4 : 8; // Lane width in bytes
+            break;
+        case OP_VLOAD: // VLOAD Vd, Offset(Rs1)
+        case OP_VSTORE:
+            decoded.rd = (instruction_word >> 21) & 0x1F;
+            decoded.rs1 = (instruction_word >> 16) & 0x1F;
+            decoded.immediate = sign_extend(instruction_word, 16);
+            break;
+        case OP_FADD: // FADD Fd, Fs1, Fs2
+        case OP_FSUB:
+        case OP_FMUL:
+        case OP_FDIV:
+        case OP_FSQRT: // FSQRT Fd, Fs1
+        case OP_FEQ: // FEQ Rd, Fs1, Fs2
+        case OP_FLT:
+        case OP_FLE:
+        case OP_FCVTDL: // FCVTDL Fd, Rs1
+        case OP_FCVTLD: // FCVTLD Rd, Fs1
+        case OP_FMVDX:
+        case OP_FMVXD:
+            decoded.rd = (instruction_word >> 11) & 0x1F;
+            decoded.rs1 = (instruction_word >> 16) & 0x1F;
+            decoded.rs2 = (instruction_word >> 21) & 0x1F;
+            break;
+        case OP_FMADD: // FMADD Fd, Fs1, Fs2, Fs3
+            decoded.rd = (instruction_word >> 11) & 0x1F;
+            decoded.rs1 = (instruction_word >> 16) & 0x1F;
+            decoded.rs2 = (instruction_word >> 21) & 0x1F;
+            decoded.rs3 = (instruction_word >> FP_RS3_SHIFT) & 0x1F;
+            break;
+        case OP_FLD: // FLD Fd, Offset(Rs1)
+        case OP_FSD:
+            decoded.rd = (instruction_word >> 21) & 0x1F;
+            decoded.rs1 = (instruction_word >> 16) & 0x1F;
+            decoded.immediate = sign_extend(instruction_word, 16);
             break;
         case OP_LI: // LI Rd, Immediate
             decoded.rd = (instruction_word >> 21) & 0x1F;
-            decoded.immediate = (int64_t)(instruction_word & 0x1FFFFF);
+            decoded.immediate = sign_extend(instruction_word, 21); // Lower 21 bits for immediate (sign-extended)
             break;
         case OP_LOAD: // LOAD Rd, Address
         case OP_STORE:
@@ -52,12 +129,36 @@ decoded_instruction_t decode_instruction(uint64_t instruction_word) {
         case OP_JR: // JR Rs
             decoded.rs1 = (instruction_word >> 21) & 0x1F;
             break;
+        case OP_JAL: // JAL Address
+            decoded.rd = LINK_REGISTER;
+            decoded.address = (uint64_t)(instruction_word & 0x3FFFFFF); // Same 26 bits as JMP
+            break;
+        case OP_JALR: // JALR Rs
+            decoded.rd = LINK_REGISTER;
+            decoded.rs1 = (instruction_word >> 21) & 0x1F;
+            break;
+        case OP_RET: // RET
+            decoded.rs1 = LINK_REGISTER;
+            break;
         case OP_BEQ: // BEQ Rs1, Rs2, Offset
         case OP_BNE:
             decoded.rs1 = (instruction_word >> 21) & 0x1F;
             decoded.rs2 = (instruction_word >> 16) & 0x1F;
-            decoded.immediate = (int64_t)(instruction_word & 0xFFFF); // Example: Lower 16 bits for offset (sign-extended)
+            decoded.immediate = sign_extend(instruction_word, 16); // Lower 16 bits for offset from the next instruction (sign-extended)
+            break;
+        case OP_CSRR: // CSRR Rd, Csr
+            decoded.rd = (instruction_word >> 21) & 0x1F;
+            decoded.immediate = (int64_t)(instruction_word & 0xFFFF); // Lower 16 bits for the register number
             break;
+        case OP_CSRW: // CSRW Csr, Rs1
+            decoded.rs1 = (instruction_word >> 16) & 0x1F;
+            decoded.immediate = (int64_t)(instruction_word & 0xFFFF);
+            break;
+        case OP_ECALL:
+        case OP_ERET:
+        case OP_WFI:
+        case OP_EBREAK:
+        case OP_FENCE:
         case OP_HALT:
             // No operands to decode for HALT in this example
             break;
@@ -67,4 +168,87 @@ decoded_instruction_t decode_instruction(uint64_t instruction_word) {
     }
 
     return decoded;
+}
+
+const char* get_opcode_mnemonic(uint32_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return "ADD";
+        case OP_SUB: return "SUB";
+        case OP_MUL: return "MUL";
+        case OP_DIV: return "DIV";
+        case OP_AND: return "AND";
+        case OP_OR: return "OR";
+        case OP_XOR: return "XOR";
+        case OP_SLL: return "SLL";
+        case OP_SRL: return "SRL";
+        case OP_SRA: return "SRA";
+        case OP_CMP: return "CMP";
+        case OP_ADDI: return "ADDI";
+        case OP_SUBI: return "SUBI";
+        case OP_ANDI: return "ANDI";
+        case OP_ORI: return "ORI";
+        case OP_XORI: return "XORI";
+        case OP_LI: return "LI";
+        case OP_LOAD: return "LOAD";
+        case OP_STORE: return "STORE";
+        case OP_LB: return "LB";
+        case OP_LH: return "LH";
+        case OP_LW: return "LW";
+        case OP_LD: return "LD";
+        case OP_SB: return "SB";
+        case OP_SH: return "SH";
+        case OP_SW: return "SW";
+        case OP_SD: return "SD";
+        case OP_MEMCPY: return "MEMCPY";
+        case OP_MEMSET: return "MEMSET";
+        case OP_JMP: return "JMP";
+        case OP_JR: return "JR";
+        case OP_JAL: return "JAL";
+        case OP_JALR: return "JALR";
+        case OP_RET: return "RET";
+        case OP_BEQ: return "BEQ";
+        case OP_BNE: return "BNE";
+        case OP_LR: return "LR";
+        case OP_SC: return "SC";
+        case OP_CAS: return "CAS";
+        case OP_FENCE: return "FENCE";
+        case OP_VADD: return "VADD";
+        case OP_VSUB: return "VSUB";
+        case OP_VMUL: return "VMUL";
+        case OP_VAND: return "VAND";
+        case OP_VOR: return "VOR";
+        case OP_VXOR: return "VXOR";
+        case OP_VSLL: return "VSLL";
+        case OP_VSRL: return "VSRL";
+        case OP_VSRA: return "VSRA";
+        case OP_VCMPEQ: return "VCMPEQ";
+        case OP_VCMPLT: return "VCMPLT";
+        case OP_VLOAD: return "VLOAD";
+        case OP_VSTORE: return "VSTORE";
+        case OP_VREDSUM: return "VREDSUM";
+        case OP_VSPLAT: return "VSPLAT";
+        case OP_FADD: return "FADD";
+        case OP_FSUB: return "FSUB";
+        case OP_FMUL: return "FMUL";
+        case OP_FDIV: return "FDIV";
+        case OP_FSQRT: return "FSQRT";
+        case OP_FMADD: return "FMADD";
+        case OP_FEQ: return "FEQ";
+        case OP_FLT: return "FLT";
+        case OP_FLE: return "FLE";
+        case OP_FCVTDL: return "FCVTDL";
+        case OP_FCVTLD: return "FCVTLD";
+        case OP_FMVDX: return "FMVDX";
+        case OP_FMVXD: return "FMVXD";
+        case OP_FLD: return "FLD";
+        case OP_FSD: return "FSD";
+        case OP_ECALL: return "ECALL";
+        case OP_ERET: return "ERET";
+        case OP_CSRR: return "CSRR";
+        case OP_CSRW: return "CSRW";
+        case OP_WFI: return "WFI";
+        case OP_EBREAK: return "EBREAK";
+        case OP_HALT: return "HALT";
+        default: return "???";
+    }
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ typedef struct decoded_instruction_s {
     uint8_t rd;
     uint8_t rs1;
     uint8_t rs2;
+    uint8_t rs3; // Third source of FMADD
     int64_t immediate;
     uint64_t address;
     // ... other operand fields as needed
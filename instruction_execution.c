@@ -1,229 +1,1088 @@
 #include "instruction_execution.h"
 #include "memory.h"
+#include "trap.h"
+#include "timer_device.h"
+#include <math.h>
+#include <string.h>
 
-void execute_add(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void fault_invalid_register(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu_fault(cpu, TRAP_CAUSE_ILLEGAL_INSTRUCTION, decoded->opcode);
+}
+
+void fault_out_of_memory(cpu_state_t *cpu, uint64_t address) {
+    cpu_fault(cpu, TRAP_CAUSE_ACCESS_FAULT, address);
+}
+
+void execute_add_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] + cpu->registers[decoded->rs2];
+}
+
+void execute_add(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] + vm->registers[decoded->rs2];
+        execute_add_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in ADD instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_sub(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_sub_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] - cpu->registers[decoded->rs2];
+}
+
+void execute_sub(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] - vm->registers[decoded->rs2];
+        execute_sub_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in SUB instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_mul(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_mul_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] * cpu->registers[decoded->rs2];
+}
+
+void execute_mul(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] * vm->registers[decoded->rs2];
+        execute_mul_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in MUL instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_div(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_div_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (cpu->registers[decoded->rs2] != 0) {
+        cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] / cpu->registers[decoded->rs2];
+    } else {
+        cpu_fault(cpu, TRAP_CAUSE_DIVIDE_BY_ZERO, 0);
+    }
+}
+
+void execute_div(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        if (vm->registers[decoded->rs2] != 0) {
-            vm->registers[decoded->rd] = vm->registers[decoded->rs1] / vm->registers[decoded->rs2];
-        } else {
-            fprintf(stderr, "Error: Division by zero.\n");
-            vm->running = false;
-        }
+        execute_div_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in DIV instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_and(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_and_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] & cpu->registers[decoded->rs2];
+}
+
+void execute_and(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] & vm->registers[decoded->rs2];
+        execute_and_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in AND instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_or(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_or_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] | cpu->registers[decoded->rs2];
+}
+
+void execute_or(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] | vm->registers[decoded->rs2];
+        execute_or_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in OR instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_xor(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_xor_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] ^ cpu->registers[decoded->rs2];
+}
+
+void execute_xor(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] ^ vm->registers[decoded->rs2];
+        execute_xor_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in XOR instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_sll(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_sll_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] << cpu->registers[decoded->rs2];
+}
+
+void execute_sll(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] << vm->registers[decoded->rs2];
+        execute_sll_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in SLL instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_srl(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_srl_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] >> cpu->registers[decoded->rs2]; // Logical right shift
+}
+
+void execute_srl(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] >> vm->registers[decoded->rs2]; // Logical right shift
+        execute_srl_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in SRL instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_sra(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_sra_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = (int64_t)cpu->registers[decoded->rs1] >> cpu->registers[decoded->rs2]; // Arithmetic right shift
+}
+
+void execute_sra(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = (int64_t)vm->registers[decoded->rs1] >> vm->registers[decoded->rs2]; // Arithmetic right shift
+        execute_sra_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_cmp_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    // Example: Set flags based on comparison (you'll need to define flags in cpu_state.h)
+    if (cpu->registers[decoded->rs1] == cpu->registers[decoded->rs2]) {
+        cpu->zero_flag = 1;
+    } else {
+        cpu->zero_flag = 0;
+    }
+    if ((int64_t)cpu->registers[decoded->rs1] < (int64_t)cpu->registers[decoded->rs2]) {
+        cpu->negative_flag = 1;
     } else {
-        fprintf(stderr, "Error: Invalid register index in SRA instruction.\n");
-        vm->running = false;
+        cpu->negative_flag = 0;
     }
+    // Implement carry and overflow flags if needed for your CMP instruction
 }
 
-void execute_cmp(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_cmp(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        // Example: Set flags based on comparison (you'll need to define flags in cpu_state.h)
-        if (vm->registers[decoded->rs1] == vm->registers[decoded->rs2]) {
-            vm->zero_flag = 1;
-        } else {
-            vm->zero_flag = 0;
-        }
-        if ((int64_t)vm->registers[decoded->rs1] < (int64_t)vm->registers[decoded->rs2]) {
-            vm->negative_flag = 1;
-        } else {
-            vm->negative_flag = 0;
-        }
-        // Implement carry and overflow flags if needed for your CMP instruction
+        execute_cmp_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in CMP instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_addi(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_addi_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] + decoded->immediate;
+}
+
+void execute_addi(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] + decoded->immediate;
+        execute_addi_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in ADDI instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_subi(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_subi_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] - decoded->immediate;
+}
+
+void execute_subi(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] - decoded->immediate;
+        execute_subi_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in SUBI instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_andi(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_andi_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] & decoded->immediate;
+}
+
+void execute_andi(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] & decoded->immediate;
+        execute_andi_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in ANDI instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_ori(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_ori_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] | decoded->immediate;
+}
+
+void execute_ori(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] | decoded->immediate;
+        execute_ori_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in ORI instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_xori(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_xori_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] ^ decoded->immediate;
+}
+
+void execute_xori(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = vm->registers[decoded->rs1] ^ decoded->immediate;
+        execute_xori_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in XORI instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_li(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_li_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = decoded->immediate;
+}
+
+void execute_li(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rd < NUM_REGISTERS) {
-        vm->registers[decoded->rd] = decoded->immediate;
+        execute_li_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in LI instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_load(vm_state_t *vm, const decoded_instruction_t *decoded) {
-    if (decoded->rd < NUM_REGISTERS && decoded->address < MEMORY_SIZE - sizeof(reg_t) + 1) {
-        vm->registers[decoded->rd] = memory_read_word(decoded->address);
+void execute_load_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = memory_tlb_read_word(&cpu->tlb, cpu->memory, decoded->address);
+}
+
+void execute_load(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS) {
+        execute_load_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index or memory address in LOAD instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_store(vm_state_t *vm, const decoded_instruction_t *decoded) {
-    if (decoded->rd < NUM_REGISTERS && decoded->address < MEMORY_SIZE - sizeof(reg_t) + 1) {
-        memory_write_word(decoded->address, vm->registers[decoded->rd]);
+void execute_store_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (!memory_tlb_write_word(&cpu->tlb, cpu->memory, decoded->address, cpu->registers[decoded->rd])) {
+        fault_out_of_memory(cpu, decoded->address);
+        return;
+    }
+    cpu_note_code_write(cpu, decoded->address, sizeof(reg_t));
+}
+
+void execute_store(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS) {
+        execute_store_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index or memory address in STORE instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_jmp(vm_state_t *vm, const decoded_instruction_t *decoded) {
-    vm->program_counter = decoded->address;
+// Helper function to compute the address of a sized load or store (Rs1 + Offset)
+static inline uint64_t sized_access_address(const cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    return cpu->registers[decoded->rs1] + (uint64_t)decoded->immediate;
+}
+
+void execute_lb_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = memory_tlb_read(&cpu->tlb, cpu->memory, sized_access_address(cpu, decoded), 1);
 }
 
-void execute_jr(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_lb(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_lb_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_lh_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = memory_tlb_read(&cpu->tlb, cpu->memory, sized_access_address(cpu, decoded), 2);
+}
+
+void execute_lh(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_lh_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_lw_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = memory_tlb_read(&cpu->tlb, cpu->memory, sized_access_address(cpu, decoded), 4);
+}
+
+void execute_lw(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_lw_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_ld_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[decoded->rd] = memory_tlb_read(&cpu->tlb, cpu->memory, sized_access_address(cpu, decoded), 8);
+}
+
+void execute_ld(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_ld_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_sb_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t address = sized_access_address(cpu, decoded);
+    if (!memory_tlb_write(&cpu->tlb, cpu->memory, address, 1, cpu->registers[decoded->rd])) {
+        fault_out_of_memory(cpu, address);
+        return;
+    }
+    cpu_note_code_write(cpu, address, 1);
+}
+
+void execute_sb(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_sb_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_sh_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t address = sized_access_address(cpu, decoded);
+    if (!memory_tlb_write(&cpu->tlb, cpu->memory, address, 2, cpu->registers[decoded->rd])) {
+        fault_out_of_memory(cpu, address);
+        return;
+    }
+    cpu_note_code_write(cpu, address, 2);
+}
+
+void execute_sh(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_sh_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_sw_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t address = sized_access_address(cpu, decoded);
+    if (!memory_tlb_write(&cpu->tlb, cpu->memory, address, 4, cpu->registers[decoded->rd])) {
+        fault_out_of_memory(cpu, address);
+        return;
+    }
+    cpu_note_code_write(cpu, address, 4);
+}
+
+void execute_sw(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_sw_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_sd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t address = sized_access_address(cpu, decoded);
+    if (!memory_tlb_write(&cpu->tlb, cpu->memory, address, 8, cpu->registers[decoded->rd])) {
+        fault_out_of_memory(cpu, address);
+        return;
+    }
+    cpu_note_code_write(cpu, address, 8);
+}
+
+void execute_sd(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_sd_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+// Helper function to check that a block of memory does not wrap around the address space
+static bool check_block_range(cpu_state_t *cpu, uint64_t address, uint64_t length) {
+    if (address + length < address) {
+        cpu_fault(cpu, TRAP_CAUSE_ACCESS_FAULT, address);
+        return false;
+    }
+    return true;
+}
+
+// Helper function to finish one step of a block instruction: with bytes left, the instruction runs again
+static void finish_block_step(cpu_state_t *cpu, const decoded_instruction_t *decoded, uint64_t left) {
+    cpu->registers[decoded->rs2] = left;
+    if (left > 0) {
+        cpu->program_counter -= sizeof(uint64_t); // Charged and interruptible like any other instruction
+    }
+}
+
+void execute_memcpy(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_REGISTERS || decoded->rs2 >= NUM_REGISTERS ||
+        decoded->rs2 == decoded->rd || decoded->rs2 == decoded->rs1) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t destination = cpu->registers[decoded->rd];
+    uint64_t source = cpu->registers[decoded->rs1];
+    uint64_t length = cpu->registers[decoded->rs2];
+    if (length == 0 || !check_block_range(cpu, destination, length) ||
+        !check_block_range(cpu, source, length)) {
+        return;
+    }
+    uint64_t step = length < BLOCK_STEP_BYTES ? length : BLOCK_STEP_BYTES;
+    // A destination overlapping the end of the source is copied from the end, which stays unread until then
+    bool backwards = destination > source && destination - source < length;
+    uint64_t offset = backwards ? length - step : 0;
+    bool copied = memory_copy(cpu->memory, destination + offset, source + offset, step);
+    cpu_note_code_write(cpu, destination + offset, step); // Even a partial copy may have overwritten code
+    if (!copied) {
+        fault_out_of_memory(cpu, destination + offset);
+        return;
+    }
+    if (!backwards) {
+        cpu->registers[decoded->rd] = destination + step;
+        cpu->registers[decoded->rs1] = source + step;
+    }
+    finish_block_step(cpu, decoded, length - step);
+}
+
+void execute_memset(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_REGISTERS || decoded->rs2 >= NUM_REGISTERS ||
+        decoded->rs1 == decoded->rd || decoded->rs2 == decoded->rd || decoded->rs2 == decoded->rs1) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t destination = cpu->registers[decoded->rd];
+    uint64_t length = cpu->registers[decoded->rs2];
+    if (length == 0 || !check_block_range(cpu, destination, length)) {
+        return;
+    }
+    uint64_t step = length < BLOCK_STEP_BYTES ? length : BLOCK_STEP_BYTES;
+    bool filled = memory_fill(cpu->memory, destination, (uint8_t)cpu->registers[decoded->rs1], step);
+    cpu_note_code_write(cpu, destination, step); // Even a partial fill may have overwritten code
+    if (!filled) {
+        fault_out_of_memory(cpu, destination);
+        return;
+    }
+    cpu->registers[decoded->rd] = destination + step;
+    finish_block_step(cpu, decoded, length - step);
+}
+
+// Helper function to execute a lane-wise vector instruction (the immediate holds the lane width in bytes)
+static void execute_vector_op(cpu_state_t *cpu, const decoded_instruction_t *decoded, vector_op_t op) {
+    if (decoded->rd >= NUM_VECTOR_REGISTERS || decoded->rs1 >= NUM_VECTOR_REGISTERS || decoded->rs2 >= NUM_VECTOR_REGISTERS) {
+        cpu_fault(cpu, TRAP_CAUSE_ILLEGAL_INSTRUCTION, decoded->opcode);
+        return;
+    }
+    vector_execute(op, decoded->immediate == sizeof(uint32_t), &cpu->vector_registers[decoded->rd],
+                   &cpu->vector_registers[decoded->rs1], &cpu->vector_registers[decoded->rs2]);
+}
+
+void execute_vadd(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_ADD);
+}
+
+void execute_vsub(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_SUB);
+}
+
+void execute_vmul(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_MUL);
+}
+
+void execute_vand(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_AND);
+}
+
+void execute_vor(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_OR);
+}
+
+void execute_vxor(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_XOR);
+}
+
+void execute_vsll(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_SLL);
+}
+
+void execute_vsrl(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_SRL);
+}
+
+void execute_vsra(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_SRA);
+}
+
+void execute_vcmpeq(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_CMPEQ);
+}
+
+void execute_vcmplt(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    execute_vector_op(cpu, decoded, VECTOR_CMPLT);
+}
+
+void execute_vload(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_VECTOR_REGISTERS || decoded->rs1 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t address = sized_access_address(cpu, decoded);
+    vector_reg_t *vector = &cpu->vector_registers[decoded->rd];
+    for (int i = 0; i < VECTOR_LANES; i++) {
+        vector->lanes[i] = memory_tlb_read_word(&cpu->tlb, cpu->memory, address + i * sizeof(uint64_t));
+    }
+}
+
+void execute_vstore(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_VECTOR_REGISTERS || decoded->rs1 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t address = sized_access_address(cpu, decoded);
+    const vector_reg_t *vector = &cpu->vector_registers[decoded->rd];
+    for (int i = 0; i < VECTOR_LANES; i++) {
+        if (!memory_tlb_write_word(&cpu->tlb, cpu->memory, address + i * sizeof(uint64_t), vector->lanes[i])) {
+            fault_out_of_memory(cpu, address + i * sizeof(uint64_t));
+            break; // The lanes stored so far may hold code
+        }
+    }
+    cpu_note_code_write(cpu, address, VECTOR_BYTES);
+}
+
+void execute_vredsum(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_VECTOR_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    cpu->registers[decoded->rd] = vector_reduce_sum(&cpu->vector_registers[decoded->rs1], decoded->immediate == sizeof(uint32_t));
+}
+
+void execute_vsplat(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_VECTOR_REGISTERS || decoded->rs1 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    vector_splat(&cpu->vector_registers[decoded->rd], cpu->registers[decoded->rs1], decoded->immediate == sizeof(uint32_t));
+}
+
+void execute_fadd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->fp_registers[decoded->rd] = cpu->fp_registers[decoded->rs1] + cpu->fp_registers[decoded->rs2];
+}
+
+void execute_fadd(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_FP_REGISTERS && decoded->rs1 < NUM_FP_REGISTERS && decoded->rs2 < NUM_FP_REGISTERS) {
+        execute_fadd_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_fsub_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->fp_registers[decoded->rd] = cpu->fp_registers[decoded->rs1] - cpu->fp_registers[decoded->rs2];
+}
+
+void execute_fsub(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_FP_REGISTERS && decoded->rs1 < NUM_FP_REGISTERS && decoded->rs2 < NUM_FP_REGISTERS) {
+        execute_fsub_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_fmul_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->fp_registers[decoded->rd] = cpu->fp_registers[decoded->rs1] * cpu->fp_registers[decoded->rs2];
+}
+
+void execute_fmul(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_FP_REGISTERS && decoded->rs1 < NUM_FP_REGISTERS && decoded->rs2 < NUM_FP_REGISTERS) {
+        execute_fmul_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_fdiv_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->fp_registers[decoded->rd] = cpu->fp_registers[decoded->rs1] / cpu->fp_registers[decoded->rs2];
+}
+
+void execute_fdiv(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_FP_REGISTERS && decoded->rs1 < NUM_FP_REGISTERS && decoded->rs2 < NUM_FP_REGISTERS) {
+        execute_fdiv_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_fsqrt(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_FP_REGISTERS || decoded->rs1 >= NUM_FP_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    cpu->fp_registers[decoded->rd] = sqrt(cpu->fp_registers[decoded->rs1]);
+}
+
+void execute_fmadd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->fp_registers[decoded->rd] = fma(cpu->fp_registers[decoded->rs1], cpu->fp_registers[decoded->rs2], cpu->fp_registers[decoded->rs3]);
+}
+
+void execute_fmadd(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_FP_REGISTERS && decoded->rs1 < NUM_FP_REGISTERS && decoded->rs2 < NUM_FP_REGISTERS &&
+        decoded->rs3 < NUM_FP_REGISTERS) {
+        execute_fmadd_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_feq(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_FP_REGISTERS || decoded->rs2 >= NUM_FP_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    cpu->registers[decoded->rd] = cpu->fp_registers[decoded->rs1] == cpu->fp_registers[decoded->rs2];
+}
+
+void execute_flt(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_FP_REGISTERS || decoded->rs2 >= NUM_FP_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    cpu->registers[decoded->rd] = cpu->fp_registers[decoded->rs1] < cpu->fp_registers[decoded->rs2];
+}
+
+void execute_fle(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_FP_REGISTERS || decoded->rs2 >= NUM_FP_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    cpu->registers[decoded->rd] = cpu->fp_registers[decoded->rs1] <= cpu->fp_registers[decoded->rs2];
+}
+
+void execute_fcvtdl(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_FP_REGISTERS || decoded->rs1 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    cpu->fp_registers[decoded->rd] = (double)(int64_t)cpu->registers[decoded->rs1];
+}
+
+void execute_fcvtld(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_FP_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    // Out-of-range values saturate instead of being undefined as in C (NaN converts to the maximum)
+    double value = cpu->fp_registers[decoded->rs1];
+    int64_t result;
+    if (isnan(value) || value >= 9223372036854775808.0) {
+        result = INT64_MAX;
+    } else if (value < -9223372036854775808.0) {
+        result = INT64_MIN;
+    } else {
+        result = (int64_t)value; // Rounds toward zero
+    }
+    cpu->registers[decoded->rd] = (uint64_t)result;
+}
+
+void execute_fmvdx(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_FP_REGISTERS || decoded->rs1 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    memcpy(&cpu->fp_registers[decoded->rd], &cpu->registers[decoded->rs1], sizeof(double));
+}
+
+void execute_fmvxd(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_FP_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    memcpy(&cpu->registers[decoded->rd], &cpu->fp_registers[decoded->rs1], sizeof(double));
+}
+
+void execute_fld_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t bits = memory_tlb_read(&cpu->tlb, cpu->memory, sized_access_address(cpu, decoded), 8);
+    memcpy(&cpu->fp_registers[decoded->rd], &bits, sizeof(bits));
+}
+
+void execute_fld(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_FP_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_fld_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_fsd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t address = sized_access_address(cpu, decoded);
+    uint64_t bits;
+    memcpy(&bits, &cpu->fp_registers[decoded->rd], sizeof(bits));
+    if (!memory_tlb_write(&cpu->tlb, cpu->memory, address, 8, bits)) {
+        fault_out_of_memory(cpu, address);
+        return;
+    }
+    cpu_note_code_write(cpu, address, 8);
+}
+
+void execute_fsd(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd < NUM_FP_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+        execute_fsd_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_jmp(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->program_counter = decoded->address;
+}
+
+void execute_jr_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->program_counter = cpu->registers[decoded->rs1];
+}
+
+void execute_jr(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rs1 < NUM_REGISTERS) {
+        execute_jr_unchecked(cpu, decoded);
+    } else {
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_jal(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu->registers[LINK_REGISTER] = cpu->program_counter; // PC already points past the JAL
+    cpu->program_counter = decoded->address;
+}
+
+void execute_jalr_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t target = cpu->registers[decoded->rs1]; // Read first: JALR R31 calls the old R31
+    cpu->registers[LINK_REGISTER] = cpu->program_counter;
+    cpu->program_counter = target;
+}
+
+void execute_jalr(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rs1 < NUM_REGISTERS) {
-        vm->program_counter = vm->registers[decoded->rs1];
+        execute_jalr_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in JR instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
     }
 }
 
-void execute_beq(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_ret(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    (void)decoded;
+    cpu->program_counter = cpu->registers[LINK_REGISTER];
+}
+
+void execute_beq_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (cpu->registers[decoded->rs1] == cpu->registers[decoded->rs2]) {
+        cpu->program_counter += decoded->immediate;
+    }
+}
+
+void execute_beq(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        if (vm->registers[decoded->rs1] == vm->registers[decoded->rs2]) {
-            vm->program_counter += decoded->immediate;
-        }
+        execute_beq_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in BEQ instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+void execute_bne_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (cpu->registers[decoded->rs1] != cpu->registers[decoded->rs2]) {
+        cpu->program_counter += decoded->immediate;
     }
 }
 
-void execute_bne(vm_state_t *vm, const decoded_instruction_t *decoded) {
+void execute_bne(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
     if (decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
-        if (vm->registers[decoded->rs1] != vm->registers[decoded->rs2]) {
-            vm->program_counter += decoded->immediate;
-        }
+        execute_bne_unchecked(cpu, decoded);
     } else {
-        fprintf(stderr, "Error: Invalid register index in BNE instruction.\n");
-        vm->running = false;
+        fault_invalid_register(cpu, decoded);
+    }
+}
+
+// Helper function to check the address of an atomic access (atomics work on whole aligned words)
+static bool check_atomic_address(cpu_state_t *cpu, uint64_t address) {
+    if ((address & (sizeof(uint64_t) - 1)) != 0) {
+        cpu_fault(cpu, TRAP_CAUSE_MISALIGNED, address);
+        return false;
+    }
+    return true;
+}
+
+void execute_lr(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t address = cpu->registers[decoded->rs1];
+    if (!check_atomic_address(cpu, address)) {
+        return;
+    }
+    uint64_t value = memory_load_reserved_word(cpu->memory, address);
+    cpu->reservation_address = address;
+    cpu->reservation_value = value;
+    cpu->reservation_valid = true;
+    cpu->registers[decoded->rd] = value;
+}
+
+void execute_sc(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_REGISTERS || decoded->rs2 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t address = cpu->registers[decoded->rs1];
+    if (!check_atomic_address(cpu, address)) {
+        return;
     }
+    // The reservation is emulated by the value LR saw: SC succeeds if memory still holds it
+    bool stored = false;
+    if (cpu->reservation_valid && cpu->reservation_address == address) {
+        uint64_t expected = cpu->reservation_value;
+        uint64_t previous;
+        if (!memory_compare_exchange_word(cpu->memory, address, expected, cpu->registers[decoded->rs2], &previous)) {
+            fault_out_of_memory(cpu, address);
+            return;
+        }
+        stored = previous == expected;
+    }
+    cpu->reservation_valid = false;
+    cpu->registers[decoded->rd] = stored ? 0 : 1;
+    if (stored) {
+        cpu_note_code_write(cpu, address, sizeof(reg_t));
+    }
+}
+
+void execute_cas(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS || decoded->rs1 >= NUM_REGISTERS || decoded->rs2 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t address = cpu->registers[decoded->rs1];
+    if (!check_atomic_address(cpu, address)) {
+        return;
+    }
+    uint64_t expected = cpu->registers[decoded->rd];
+    uint64_t previous;
+    if (!memory_compare_exchange_word(cpu->memory, address, expected, cpu->registers[decoded->rs2], &previous)) {
+        fault_out_of_memory(cpu, address);
+        return;
+    }
+    cpu->registers[decoded->rd] = previous;
+    if (previous == expected) {
+        cpu_note_code_write(cpu, address, sizeof(reg_t));
+    }
+}
+
+void execute_fence(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    (void)decoded;
+    cpu_fence(cpu);
+}
+
+void execute_halt(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    (void)decoded;
+    cpu_halt(cpu);
+}
+
+void execute_ecall(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    (void)decoded;
+    cpu_fault(cpu, TRAP_CAUSE_ECALL, 0);
+}
+
+void execute_eret(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    (void)decoded;
+    uint64_t status = cpu->trap_status & ~(uint64_t)(TRAP_STATUS_IE | TRAP_STATUS_HANDLER);
+    if (cpu->trap_status & TRAP_STATUS_PIE) {
+        status |= TRAP_STATUS_IE;
+    }
+    cpu->trap_status = status | TRAP_STATUS_PIE;
+    cpu->program_counter = cpu->trap_epc;
+    cpu_request_interrupt_check(cpu); // An interrupt raised inside the handler may be deliverable now
+}
+
+// Helper function to report a CSRR or CSRW of a register that does not exist
+static void unknown_control_register(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    cpu_fault(cpu, TRAP_CAUSE_ILLEGAL_INSTRUCTION, decoded->opcode);
 }
 
-void execute_halt(vm_state_t *vm, const decoded_instruction_t *decoded) {
-    printf("VM halted.\n");
-    vm->running = false;
+void execute_csrr(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rd >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t value;
+    switch (decoded->immediate) {
+        case CSR_STATUS: value = cpu->trap_status; break;
+        case CSR_VECTOR: value = cpu->trap_vector; break;
+        case CSR_EPC: value = cpu->trap_epc; break;
+        case CSR_CAUSE: value = cpu->trap_cause; break;
+        case CSR_TVAL: value = cpu->trap_value; break;
+        case CSR_IE: value = cpu->interrupt_enable; break;
+        case CSR_IP: value = __atomic_load_n(&cpu->interrupt_pending, __ATOMIC_RELAXED); break;
+        case CSR_SCRATCH: value = cpu->trap_scratch; break;
+        case CSR_HARTID: value = cpu->hart_id; break;
+        default:
+            unknown_control_register(cpu, decoded);
+            return;
+    }
+    cpu->registers[decoded->rd] = value;
+}
+
+void execute_csrw(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    if (decoded->rs1 >= NUM_REGISTERS) {
+        fault_invalid_register(cpu, decoded);
+        return;
+    }
+    uint64_t value = cpu->registers[decoded->rs1];
+    switch (decoded->immediate) {
+        case CSR_STATUS:
+            cpu->trap_status = (cpu->trap_status & ~(uint64_t)TRAP_STATUS_WRITABLE) | (value & TRAP_STATUS_WRITABLE);
+            cpu_request_interrupt_check(cpu);
+            break;
+        case CSR_VECTOR: cpu->trap_vector = value & ~(uint64_t)(sizeof(uint64_t) - 1); break;
+        case CSR_EPC: cpu->trap_epc = value; break;
+        case CSR_CAUSE: cpu->trap_cause = value; break;
+        case CSR_TVAL: cpu->trap_value = value; break;
+        case CSR_IE:
+            cpu->interrupt_enable = value;
+            cpu_request_interrupt_check(cpu);
+            break;
+        case CSR_SCRATCH: cpu->trap_scratch = value; break;
+        case CSR_IP: case CSR_HARTID: break; // Read-only, the write is ignored
+        default:
+            unknown_control_register(cpu, decoded);
+            break;
+    }
+}
+
+void execute_wfi(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    (void)decoded;
+    timer_device_wait(cpu->vm->timer, cpu);
+}
+
+void execute_ebreak(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    (void)decoded;
+    cpu->exit_reason = VM_EXIT_BREAKPOINT; // cpu_run returns with the hart still runnable
+    cpu->running = false;
+}
+
+instruction_handler_t get_instruction_handler(uint32_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return execute_add;
+        case OP_SUB: return execute_sub;
+        case OP_MUL: return execute_mul;
+        case OP_DIV: return execute_div;
+        case OP_AND: return execute_and;
+        case OP_OR: return execute_or;
+        case OP_XOR: return execute_xor;
+        case OP_SLL: return execute_sll;
+        case OP_SRL: return execute_srl;
+        case OP_SRA: return execute_sra;
+        case OP_CMP: return execute_cmp;
+        case OP_ADDI: return execute_addi;
+        case OP_SUBI: return execute_subi;
+        case OP_ANDI: return execute_andi;
+        case OP_ORI: return execute_ori;
+        case OP_XORI: return execute_xori;
+        case OP_LI: return execute_li;
+        case OP_LOAD: return execute_load;
+        case OP_STORE: return execute_store;
+        case OP_LB: return execute_lb;
+        case OP_LH: return execute_lh;
+        case OP_LW: return execute_lw;
+        case OP_LD: return execute_ld;
+        case OP_SB: return execute_sb;
+        case OP_SH: return execute_sh;
+        case OP_SW: return execute_sw;
+        case OP_SD: return execute_sd;
+        case OP_MEMCPY: return execute_memcpy;
+        case OP_MEMSET: return execute_memset;
+        case OP_VADD: return execute_vadd;
+        case OP_VSUB: return execute_vsub;
+        case OP_VMUL: return execute_vmul;
+        case OP_VAND: return execute_vand;
+        case OP_VOR: return execute_vor;
+        case OP_VXOR: return execute_vxor;
+        case OP_VSLL: return execute_vsll;
+        case OP_VSRL: return execute_vsrl;
+        case OP_VSRA: return execute_vsra;
+        case OP_VCMPEQ: return execute_vcmpeq;
+        case OP_VCMPLT: return execute_vcmplt;
+        case OP_VLOAD: return execute_vload;
+        case OP_VSTORE: return execute_vstore;
+        case OP_VREDSUM: return execute_vredsum;
+        case OP_VSPLAT: return execute_vsplat;
+        case OP_FADD: return execute_fadd;
+        case OP_FSUB: return execute_fsub;
+        case OP_FMUL: return execute_fmul;
+        case OP_FDIV: return execute_fdiv;
+        case OP_FSQRT: return execute_fsqrt;
+        case OP_FMADD: return execute_fmadd;
+        case OP_FEQ: return execute_feq;
+        case OP_FLT: return execute_flt;
+        case OP_FLE: return execute_fle;
+        case OP_FCVTDL: return execute_fcvtdl;
+        case OP_FCVTLD: return execute_fcvtld;
+        case OP_FMVDX: return execute_fmvdx;
+        case OP_FMVXD: return execute_fmvxd;
+        case OP_FLD: return execute_fld;
+        case OP_FSD: return execute_fsd;
+        case OP_JMP: return execute_jmp;
+        case OP_JR: return execute_jr;
+        case OP_JAL: return execute_jal;
+        case OP_JALR: return execute_jalr;
+        case OP_RET: return execute_ret;
+        case OP_BEQ: return execute_beq;
+        case OP_BNE: return execute_bne;
+        case OP_LR: return execute_lr;
+        case OP_SC: return execute_sc;
+        case OP_CAS: return execute_cas;
+        case OP_FENCE: return execute_fence;
+        case OP_ECALL: return execute_ecall;
+        case OP_ERET: return execute_eret;
+        case OP_CSRR: return execute_csrr;
+        case OP_CSRW: return execute_csrw;
+        case OP_WFI: return execute_wfi;
+        case OP_EBREAK: return execute_ebreak;
+        case OP_HALT: return execute_halt;
+        default: return NULL;
+    }
+}
+
+instruction_handler_t get_unchecked_instruction_handler(uint32_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return execute_add_unchecked;
+        case OP_SUB: return execute_sub_unchecked;
+        case OP_MUL: return execute_mul_unchecked;
+        case OP_DIV: return execute_div_unchecked;
+        case OP_AND: return execute_and_unchecked;
+        case OP_OR: return execute_or_unchecked;
+        case OP_XOR: return execute_xor_unchecked;
+        case OP_SLL: return execute_sll_unchecked;
+        case OP_SRL: return execute_srl_unchecked;
+        case OP_SRA: return execute_sra_unchecked;
+        case OP_CMP: return execute_cmp_unchecked;
+        case OP_ADDI: return execute_addi_unchecked;
+        case OP_SUBI: return execute_subi_unchecked;
+        case OP_ANDI: return execute_andi_unchecked;
+        case OP_ORI: return execute_ori_unchecked;
+        case OP_XORI: return execute_xori_unchecked;
+        case OP_LI: return execute_li_unchecked;
+        case OP_LOAD: return execute_load_unchecked;
+        case OP_STORE: return execute_store_unchecked;
+        case OP_LB: return execute_lb_unchecked;
+        case OP_LH: return execute_lh_unchecked;
+        case OP_LW: return execute_lw_unchecked;
+        case OP_LD: return execute_ld_unchecked;
+        case OP_SB: return execute_sb_unchecked;
+        case OP_SH: return execute_sh_unchecked;
+        case OP_SW: return execute_sw_unchecked;
+        case OP_SD: return execute_sd_unchecked;
+        case OP_FADD: return execute_fadd_unchecked;
+        case OP_FSUB: return execute_fsub_unchecked;
+        case OP_FMUL: return execute_fmul_unchecked;
+        case OP_FDIV: return execute_fdiv_unchecked;
+        case OP_FMADD: return execute_fmadd_unchecked;
+        case OP_FLD: return execute_fld_unchecked;
+        case OP_FSD: return execute_fsd_unchecked;
+        case OP_JR: return execute_jr_unchecked;
+        case OP_JALR: return execute_jalr_unchecked;
+        case OP_BEQ: return execute_beq_unchecked;
+        case OP_BNE: return execute_bne_unchecked;
+        default: return get_instruction_handler(opcode);
+    }
+}
+
+bool instruction_ends_block(uint32_t opcode) {
+    switch (opcode) {
+        case OP_STORE: case OP_SC: case OP_CAS: case OP_FENCE:
+        case OP_SB: case OP_SH: case OP_SW: case OP_SD:
+        case OP_MEMCPY: case OP_MEMSET: case OP_VSTORE: case OP_FSD:
+        case OP_CSRW: case OP_WFI: // May have made an interrupt deliverable
+            return true;
+        default:
+            return false;
+    }
 }
\ No newline at end of file
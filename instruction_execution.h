@@ -5,76 +5,365 @@
 #include "vm.h"
 #include "instruction_decoder.h"
 
+// Function to raise an illegal instruction fault for a register index that is out of range
+void fault_invalid_register(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to raise an access fault for a store to a page the address space could not allocate
+void fault_out_of_memory(cpu_state_t *cpu, uint64_t address);
+
 // Function to execute the ADD instruction
-void execute_add(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_add(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the ADD instruction without register checks (verified code only)
+void execute_add_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the SUB instruction
-void execute_sub(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_sub(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SUB instruction without register checks (verified code only)
+void execute_sub_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the MUL instruction
-void execute_mul(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_mul(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the MUL instruction without register checks (verified code only)
+void execute_mul_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the DIV instruction
-void execute_div(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_div(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the DIV instruction without register checks (verified code only)
+void execute_div_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the AND instruction
-void execute_and(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_and(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the AND instruction without register checks (verified code only)
+void execute_and_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the OR instruction
-void execute_or(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_or(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the OR instruction without register checks (verified code only)
+void execute_or_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the XOR instruction
-void execute_xor(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_xor(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the XOR instruction without register checks (verified code only)
+void execute_xor_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the SLL instruction
-void execute_sll(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_sll(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SLL instruction without register checks (verified code only)
+void execute_sll_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the SRL instruction
-void execute_srl(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_srl(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SRL instruction without register checks (verified code only)
+void execute_srl_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the SRA instruction
-void execute_sra(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_sra(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SRA instruction without register checks (verified code only)
+void execute_sra_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the CMP instruction
-void execute_cmp(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_cmp(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the CMP instruction without register checks (verified code only)
+void execute_cmp_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the ADDI instruction
-void execute_addi(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_addi(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the ADDI instruction without register checks (verified code only)
+void execute_addi_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the SUBI instruction
-void execute_subi(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_subi(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SUBI instruction without register checks (verified code only)
+void execute_subi_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the ANDI instruction
-void execute_andi(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_andi(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the ANDI instruction without register checks (verified code only)
+void execute_andi_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the ORI instruction
-void execute_ori(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_ori(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the ORI instruction without register checks (verified code only)
+void execute_ori_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the XORI instruction
-void execute_xori(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_xori(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the XORI instruction without register checks (verified code only)
+void execute_xori_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the LI instruction
-void execute_li(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_li(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LI instruction without register checks (verified code only)
+void execute_li_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the LOAD instruction
-void execute_load(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_load(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LOAD instruction without register checks (verified code only)
+void execute_load_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the STORE instruction
-void execute_store(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_store(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the STORE instruction without register checks (verified code only)
+void execute_store_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LB instruction
+void execute_lb(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LB instruction without register checks (verified code only)
+void execute_lb_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LH instruction
+void execute_lh(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LH instruction without register checks (verified code only)
+void execute_lh_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LW instruction
+void execute_lw(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LW instruction without register checks (verified code only)
+void execute_lw_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LD instruction
+void execute_ld(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LD instruction without register checks (verified code only)
+void execute_ld_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SB instruction
+void execute_sb(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SB instruction without register checks (verified code only)
+void execute_sb_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SH instruction
+void execute_sh(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SH instruction without register checks (verified code only)
+void execute_sh_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SW instruction
+void execute_sw(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SW instruction without register checks (verified code only)
+void execute_sw_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SD instruction
+void execute_sd(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SD instruction without register checks (verified code only)
+void execute_sd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the MEMCPY instruction
+void execute_memcpy(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the MEMSET instruction
+void execute_memset(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VADD instruction
+void execute_vadd(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VSUB instruction
+void execute_vsub(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VMUL instruction
+void execute_vmul(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VAND instruction
+void execute_vand(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VOR instruction
+void execute_vor(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VXOR instruction
+void execute_vxor(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VSLL instruction
+void execute_vsll(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VSRL instruction
+void execute_vsrl(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VSRA instruction
+void execute_vsra(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VCMPEQ instruction
+void execute_vcmpeq(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VCMPLT instruction
+void execute_vcmplt(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VLOAD instruction
+void execute_vload(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VSTORE instruction
+void execute_vstore(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VREDSUM instruction
+void execute_vredsum(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the VSPLAT instruction
+void execute_vsplat(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FADD instruction
+void execute_fadd(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FADD instruction without register checks (verified code only)
+void execute_fadd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FSUB instruction
+void execute_fsub(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FSUB instruction without register checks (verified code only)
+void execute_fsub_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FMUL instruction
+void execute_fmul(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FMUL instruction without register checks (verified code only)
+void execute_fmul_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FDIV instruction
+void execute_fdiv(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FDIV instruction without register checks (verified code only)
+void execute_fdiv_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FSQRT instruction
+void execute_fsqrt(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FMADD instruction
+void execute_fmadd(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FMADD instruction without register checks (verified code only)
+void execute_fmadd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FEQ instruction
+void execute_feq(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FLT instruction
+void execute_flt(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FLE instruction
+void execute_fle(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FCVTDL instruction
+void execute_fcvtdl(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FCVTLD instruction
+void execute_fcvtld(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FMVDX instruction
+void execute_fmvdx(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FMVXD instruction
+void execute_fmvxd(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FLD instruction
+void execute_fld(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FLD instruction without register checks (verified code only)
+void execute_fld_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FSD instruction
+void execute_fsd(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FSD instruction without register checks (verified code only)
+void execute_fsd_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the JMP instruction
-void execute_jmp(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_jmp(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the JR instruction
-void execute_jr(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_jr(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the JR instruction without register checks (verified code only)
+void execute_jr_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the JAL instruction
+void execute_jal(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the JALR instruction
+void execute_jalr(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the JALR instruction without register checks (verified code only)
+void execute_jalr_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the RET instruction
+void execute_ret(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the BEQ instruction
-void execute_beq(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_beq(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the BEQ instruction without register checks (verified code only)
+void execute_beq_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the BNE instruction
-void execute_bne(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_bne(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the BNE instruction without register checks (verified code only)
+void execute_bne_unchecked(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the LR instruction
+void execute_lr(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the SC instruction
+void execute_sc(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the CAS instruction
+void execute_cas(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the FENCE instruction
+void execute_fence(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 // Function to execute the HALT instruction
-void execute_halt(vm_state_t *vm, const decoded_instruction_t *decoded);
+void execute_halt(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the ECALL instruction
+void execute_ecall(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the ERET instruction
+void execute_eret(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the CSRR instruction
+void execute_csrr(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the CSRW instruction
+void execute_csrw(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the WFI instruction
+void execute_wfi(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to execute the EBREAK instruction
+void execute_ebreak(cpu_state_t *cpu, const decoded_instruction_t *decoded);
+
+// Function to get the handler for an opcode (NULL for unknown opcodes)
+instruction_handler_t get_instruction_handler(uint32_t opcode);
+
+// Function to get the unchecked handler for an opcode in verified code (NULL for unknown opcodes)
+instruction_handler_t get_unchecked_instruction_handler(uint32_t opcode);
+
+// Function to check whether an instruction may have written code, flushed the decoded pages
+// or made an interrupt deliverable
+bool instruction_ends_block(uint32_t opcode);
 
 #endif // INSTRUCTION_EXECUTION_H
\ No newline at end of file
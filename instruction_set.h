@@ -7,6 +7,12 @@
 // Define the number of general-purpose registers
 #define NUM_REGISTERS 32
 
+// Register receiving the return address of JAL and JALR; RET jumps to it
+#define LINK_REGISTER 31
+
+// Define the number of floating point registers (F0-F31, IEEE 754 double precision)
+#define NUM_FP_REGISTERS 32
+
 // Define the size of a register in bits (64-bit architecture)
 #define REGISTER_SIZE 64
 
@@ -22,7 +28,7 @@ typedef enum {
 } instruction_type_t;
 
 // Structure to represent a decoded instruction
-typedef struct {
+typedef struct instruction_s {
     uint32_t opcode;
     instruction_type_t type;
 
@@ -44,9 +50,6 @@ typedef struct {
     } operands;
 } instruction_t;
 
-// Function to decode a raw instruction word (64-bit) into the instruction_t structure
-instruction_t decode_instruction(uint64_t instruction_word);
-
 // Function to get the mnemonic (string representation) of an opcode (for debugging/disassembly)
 const char* get_opcode_mnemonic(uint32_t opcode);
 
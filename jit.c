@@ -0,0 +1,684 @@
+#include "jit.h"
+#include "vm.h"
+#include "instruction_decoder.h"
+#include "opcodes.h"
+#include "trap.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#include <sys/mman.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// Number of slots in the block map (must be a power of two)
+#define JIT_BLOCK_MAP_SIZE 4096
+
+// Number of distinct guest pages that may hold compiled code before a flush
+#define JIT_CODE_PAGE_SET_SIZE 256
+
+// Upper bound of host bytes emitted for one guest instruction, including a block exit
+// (a call also pushes its return address and emits a return stub)
+#define JIT_MAX_INSTRUCTION_BYTES 128
+
+// Number of entries of the return address stack (a power of two)
+#define JIT_RAS_SIZE 16
+
+// Host registers used by the generated code
+#define HOST_RAX 0
+#define HOST_RCX 1
+#define HOST_RDX 2
+
+// Structure representing a block map entry
+typedef struct {
+    uint64_t guest_pc;
+    uint8_t *code;   // Native entry point, NULL until compiled
+    uint32_t hits;   // Times the dispatcher reached this PC while it was not compiled
+    bool used;
+    bool failed;     // The first instruction cannot be translated
+    uint16_t length; // Fuel the native code charges on entry (instructions it executes)
+} jit_block_t;
+
+// Structure representing a return address stack entry
+typedef struct {
+    uint64_t return_pc;
+    const uint8_t *code; // Return stub of the call, the leave trampoline in empty entries
+} jit_ras_entry_t;
+
+// Structure representing the return address stack of compiled code. A compiled call pushes its
+// return address and the stub that continues there; a compiled RET pops the top entry and jumps
+// to its stub if the return address matches, without going back to the dispatcher.
+typedef struct {
+    uint64_t top;
+    jit_ras_entry_t entries[JIT_RAS_SIZE];
+} jit_ras_t;
+
+// Structure representing a block exit that jumps to a not yet compiled target
+typedef struct {
+    uint64_t target_pc;
+    uint8_t *site;
+} jit_patch_t;
+
+struct jit_state_s {
+    uint8_t *code;
+    size_t code_size;
+    size_t code_used;
+    size_t code_reserved; // Bytes used by the enter/leave trampolines
+    uint8_t *enter;       // push rbx; mov rbx, rdi; jmp rsi
+    uint8_t *leave;       // pop rbx; ret (rax holds the next guest PC)
+    jit_block_t blocks[JIT_BLOCK_MAP_SIZE];
+    size_t block_count;
+    jit_patch_t *patches;
+    size_t patch_count;
+    size_t patch_capacity;
+    uint64_t code_pages[JIT_CODE_PAGE_SET_SIZE]; // Page number + 1 of pages with compiled code, 0 if empty
+    size_t code_page_count;
+    jit_ras_t ras;        // Addressed by the generated code, so it must not move
+    uint64_t blocks_compiled;
+    uint64_t exits_chained;
+    uint64_t flushes;
+    uint64_t native_entries;
+};
+
+typedef uint64_t (*jit_enter_t)(cpu_state_t *cpu, const uint8_t *code);
+
+bool jit_available(void) {
+    return JIT_SUPPORTED;
+}
+
+// Helper function to hash a guest address into a table of size entries
+static size_t jit_hash(uint64_t value, size_t size) {
+    return (size_t)((value * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+}
+
+// --- Code emission -----------------------------------------------------------
+
+static void emit_byte(jit_state_t *jit, uint8_t value) {
+    jit->code[jit->code_used++] = value;
+}
+
+static void emit_u32(jit_state_t *jit, uint32_t value) {
+    memcpy(jit->code + jit->code_used, &value, sizeof(value));
+    jit->code_used += sizeof(value);
+}
+
+static void emit_u64(jit_state_t *jit, uint64_t value) {
+    memcpy(jit->code + jit->code_used, &value, sizeof(value));
+    jit->code_used += sizeof(value);
+}
+
+// Helper function to emit a rel32 operand pointing at target
+static void emit_rel32(jit_state_t *jit, const uint8_t *target) {
+    int64_t rel = target - (jit->code + jit->code_used + sizeof(uint32_t));
+    emit_u32(jit, (uint32_t)(int32_t)rel);
+}
+
+// mov host, [rbx + registers[guest]]
+static void emit_load_guest(jit_state_t *jit, int host, int guest) {
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0x8B);
+    emit_byte(jit, (uint8_t)(0x83 | (host << 3)));
+    emit_u32(jit, (uint32_t)(offsetof(cpu_state_t, registers) + guest * sizeof(reg_t)));
+}
+
+// mov [rbx + registers[guest]], host
+static void emit_store_guest(jit_state_t *jit, int guest, int host) {
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0x89);
+    emit_byte(jit, (uint8_t)(0x83 | (host << 3)));
+    emit_u32(jit, (uint32_t)(offsetof(cpu_state_t, registers) + guest * sizeof(reg_t)));
+}
+
+// mov host, imm64
+static void emit_mov_imm64(jit_state_t *jit, int host, uint64_t value) {
+    emit_byte(jit, 0x48);
+    emit_byte(jit, (uint8_t)(0xB8 + host));
+    emit_u64(jit, value);
+}
+
+// <op> rax, rcx for the 01/29/21/09/31/39 family
+static void emit_alu_rax_rcx(jit_state_t *jit, uint8_t opcode) {
+    emit_byte(jit, 0x48);
+    emit_byte(jit, opcode);
+    emit_byte(jit, 0xC8);
+}
+
+// shl/shr/sar rax, cl (extension selects the shift)
+static void emit_shift_rax_cl(jit_state_t *jit, uint8_t extension) {
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0xD3);
+    emit_byte(jit, (uint8_t)(0xC0 | (extension << 3)));
+}
+
+// setcc byte [rbx + offset]
+static void emit_setcc_cpu_byte(jit_state_t *jit, uint8_t condition, size_t offset) {
+    emit_byte(jit, 0x0F);
+    emit_byte(jit, condition);
+    emit_byte(jit, 0x83);
+    emit_u32(jit, (uint32_t)offset);
+}
+
+// Helper function to emit a push of return_pc onto the return address stack. Returns the offset
+// of the stub address, which the caller fills in once the stub is emitted. Clobbers rax, rcx, rdx.
+static size_t emit_ras_push(jit_state_t *jit, uint64_t return_pc) {
+    emit_mov_imm64(jit, HOST_RCX, (uint64_t)(uintptr_t)&jit->ras);
+    static const uint8_t bump[] = {
+        0x48, 0x8B, 0x01,       // mov rax, [rcx]
+        0x48, 0x8D, 0x50, 0x01, // lea rdx, [rax + 1]
+        0x48, 0x89, 0x11,       // mov [rcx], rdx
+        0x83, 0xE0, JIT_RAS_SIZE - 1, // and eax, JIT_RAS_SIZE - 1
+        0xC1, 0xE0, 0x04,       // shl eax, 4 (sizeof(jit_ras_entry_t))
+    };
+    for (size_t i = 0; i < sizeof(bump); i++) {
+        emit_byte(jit, bump[i]);
+    }
+    // mov [rcx + rax + entries[].return_pc], rdx; mov [rcx + rax + entries[].code], rdx
+    emit_mov_imm64(jit, HOST_RDX, return_pc);
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0x89);
+    emit_byte(jit, 0x54);
+    emit_byte(jit, 0x01);
+    emit_byte(jit, (uint8_t)(offsetof(jit_ras_t, entries) + offsetof(jit_ras_entry_t, return_pc)));
+    size_t stub_field = jit->code_used + 2;
+    emit_mov_imm64(jit, HOST_RDX, 0);
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0x89);
+    emit_byte(jit, 0x54);
+    emit_byte(jit, 0x01);
+    emit_byte(jit, (uint8_t)(offsetof(jit_ras_t, entries) + offsetof(jit_ras_entry_t, code)));
+    return stub_field;
+}
+
+// Helper function to emit a return: pop the return address stack and jump to the stub of the
+// popped entry if it returns to the address in rax, otherwise leave to the dispatcher
+static void emit_ras_return(jit_state_t *jit) {
+    emit_mov_imm64(jit, HOST_RCX, (uint64_t)(uintptr_t)&jit->ras);
+    static const uint8_t pop[] = {
+        0x48, 0x8B, 0x11, // mov rdx, [rcx]
+        0x48, 0xFF, 0xCA, // dec rdx
+        0x48, 0x89, 0x11, // mov [rcx], rdx
+        0x83, 0xE2, JIT_RAS_SIZE - 1, // and edx, JIT_RAS_SIZE - 1
+        0xC1, 0xE2, 0x04, // shl edx, 4
+    };
+    for (size_t i = 0; i < sizeof(pop); i++) {
+        emit_byte(jit, pop[i]);
+    }
+    // cmp rax, [rcx + rdx + entries[].return_pc]; jne leave
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0x3B);
+    emit_byte(jit, 0x44);
+    emit_byte(jit, 0x11);
+    emit_byte(jit, (uint8_t)(offsetof(jit_ras_t, entries) + offsetof(jit_ras_entry_t, return_pc)));
+    emit_byte(jit, 0x0F);
+    emit_byte(jit, 0x85);
+    emit_rel32(jit, jit->leave);
+    // jmp [rcx + rdx + entries[].code]
+    emit_byte(jit, 0xFF);
+    emit_byte(jit, 0x64);
+    emit_byte(jit, 0x11);
+    emit_byte(jit, (uint8_t)(offsetof(jit_ras_t, entries) + offsetof(jit_ras_entry_t, code)));
+}
+
+// Helper function to empty the return address stack (its stubs are about to be discarded)
+static void jit_ras_clear(jit_state_t *jit) {
+    for (size_t i = 0; i < JIT_RAS_SIZE; i++) {
+        jit->ras.entries[i].return_pc = 0;
+        jit->ras.entries[i].code = jit->leave; // A match on PC 0 still leaves with the right PC
+    }
+}
+
+// Helper function to find (or create) the block map entry for a guest PC
+static jit_block_t *jit_find_block(jit_state_t *jit, uint64_t guest_pc, bool create) {
+    size_t index = jit_hash(guest_pc, JIT_BLOCK_MAP_SIZE);
+    for (;;) {
+        jit_block_t *block = &jit->blocks[index];
+        if (!block->used) {
+            if (!create) {
+                return NULL;
+            }
+            if (jit->block_count >= JIT_BLOCK_MAP_SIZE * 3 / 4) {
+                jit_flush(jit);
+                return jit_find_block(jit, guest_pc, true);
+            }
+            block->used = true;
+            block->guest_pc = guest_pc;
+            jit->block_count++;
+            return block;
+        }
+        if (block->guest_pc == guest_pc) {
+            return block;
+        }
+        index = (index + 1) & (JIT_BLOCK_MAP_SIZE - 1);
+    }
+}
+
+// Helper function to emit a block exit to target_pc, chained directly when possible
+static void emit_exit(jit_state_t *jit, uint64_t target_pc, bool chain) {
+    if (chain) {
+        jit_block_t *target = jit_find_block(jit, target_pc, false);
+        if (target && target->code) {
+            emit_byte(jit, 0xE9);
+            emit_rel32(jit, target->code);
+            jit->exits_chained++;
+            return;
+        }
+        if (jit->patch_count == jit->patch_capacity) {
+            size_t capacity = jit->patch_capacity ? jit->patch_capacity * 2 : 64;
+            jit_patch_t *patches = (jit_patch_t *)realloc(jit->patches, capacity * sizeof(jit_patch_t));
+            if (!patches) {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            jit->patches = patches;
+            jit->patch_capacity = capacity;
+        }
+        jit->patches[jit->patch_count].target_pc = target_pc;
+        jit->patches[jit->patch_count].site = jit->code + jit->code_used;
+        jit->patch_count++;
+    }
+    // mov rax, target_pc; jmp leave (the first 5 bytes are overwritten when chained)
+    emit_mov_imm64(jit, HOST_RAX, target_pc);
+    emit_byte(jit, 0xE9);
+    emit_rel32(jit, jit->leave);
+}
+
+// Helper function to turn pending exits to target_pc into direct jumps
+static void jit_apply_patches(jit_state_t *jit, uint64_t target_pc, uint8_t *code) {
+    size_t i = 0;
+    while (i < jit->patch_count) {
+        jit_patch_t *patch = &jit->patches[i];
+        if (patch->target_pc != target_pc) {
+            i++;
+            continue;
+        }
+        int64_t rel = code - (patch->site + 5);
+        int32_t rel32 = (int32_t)rel;
+        patch->site[0] = 0xE9;
+        memcpy(patch->site + 1, &rel32, sizeof(rel32));
+        jit->exits_chained++;
+        jit->patches[i] = jit->patches[--jit->patch_count];
+    }
+}
+
+// Helper function to remember that a guest page has compiled code
+static bool jit_add_code_page(jit_state_t *jit, uint64_t page_number) {
+    size_t index = jit_hash(page_number, JIT_CODE_PAGE_SET_SIZE);
+    for (;;) {
+        if (jit->code_pages[index] == page_number + 1) {
+            return true;
+        }
+        if (jit->code_pages[index] == 0) {
+            if (jit->code_page_count >= JIT_CODE_PAGE_SET_SIZE / 2) {
+                return false;
+            }
+            jit->code_pages[index] = page_number + 1;
+            jit->code_page_count++;
+            return true;
+        }
+        index = (index + 1) & (JIT_CODE_PAGE_SET_SIZE - 1);
+    }
+}
+
+// Helper function to check whether a guest page has compiled code
+static bool jit_has_code_page(const jit_state_t *jit, uint64_t page_number) {
+    if (jit->code_page_count == 0) {
+        return false;
+    }
+    size_t index = jit_hash(page_number, JIT_CODE_PAGE_SET_SIZE);
+    while (jit->code_pages[index] != 0) {
+        if (jit->code_pages[index] == page_number + 1) {
+            return true;
+        }
+        index = (index + 1) & (JIT_CODE_PAGE_SET_SIZE - 1);
+    }
+    return false;
+}
+
+// Helper function to check whether an opcode is translated and falls through to the next instruction
+static bool jit_is_straight_line(uint32_t opcode) {
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR: case OP_XOR:
+        case OP_SLL: case OP_SRL: case OP_SRA: case OP_CMP:
+        case OP_ADDI: case OP_SUBI: case OP_ANDI: case OP_ORI: case OP_XORI: case OP_LI:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Helper function to emit the interrupt and fuel checks of a block and return its entry point.
+// Chained exits jump to the entry as well, so a loop of compiled blocks still notices a pending
+// interrupt and runs out of fuel. The block length is not known yet: fuel_fields receives the
+// offsets of the two immediates that jit_set_block_length fills in.
+static uint8_t *emit_block_entry(jit_state_t *jit, uint64_t guest_pc, size_t fuel_fields[2]) {
+    // Taken when the interrupt hint is set: leave to the dispatcher at the start of the block
+    uint8_t *pending = jit->code + jit->code_used;
+    emit_mov_imm64(jit, HOST_RAX, guest_pc);
+    emit_byte(jit, 0xE9);
+    emit_rel32(jit, jit->leave);
+    // Taken when the fuel does not cover the block: add qword [rbx + fuel], length; jmp pending
+    uint8_t *refund = jit->code + jit->code_used;
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0x81);
+    emit_byte(jit, 0x83);
+    emit_u32(jit, (uint32_t)offsetof(cpu_state_t, fuel));
+    fuel_fields[0] = jit->code_used;
+    emit_u32(jit, 0);
+    emit_byte(jit, 0xEB);
+    emit_byte(jit, (uint8_t)(int8_t)(pending - (jit->code + jit->code_used + 1)));
+    // cmp byte [rbx + interrupt_signal], 0; jne pending
+    uint8_t *entry = jit->code + jit->code_used;
+    emit_byte(jit, 0x80);
+    emit_byte(jit, 0xBB);
+    emit_u32(jit, (uint32_t)offsetof(cpu_state_t, interrupt_signal));
+    emit_byte(jit, 0x00);
+    emit_byte(jit, 0x75);
+    emit_byte(jit, (uint8_t)(int8_t)(pending - (jit->code + jit->code_used + 1)));
+    // sub qword [rbx + fuel], length; jb refund (the subtraction borrowed)
+    emit_byte(jit, 0x48);
+    emit_byte(jit, 0x81);
+    emit_byte(jit, 0xAB);
+    emit_u32(jit, (uint32_t)offsetof(cpu_state_t, fuel));
+    fuel_fields[1] = jit->code_used;
+    emit_u32(jit, 0);
+    emit_byte(jit, 0x72);
+    emit_byte(jit, (uint8_t)(int8_t)(refund - (jit->code + jit->code_used + 1)));
+    return entry;
+}
+
+// Helper function to fill in the fuel a compiled block charges on entry
+static void jit_set_block_length(jit_state_t *jit, const size_t fuel_fields[2], uint32_t length) {
+    memcpy(jit->code + fuel_fields[0], &length, sizeof(length));
+    memcpy(jit->code + fuel_fields[1], &length, sizeof(length));
+}
+
+// Helper function to translate the basic block starting at guest_pc (NULL if nothing can be translated).
+// length receives the number of guest instructions the native code executes.
+static uint8_t *jit_compile_block(cpu_state_t *cpu, jit_state_t *jit, uint64_t guest_pc, uint32_t *length) {
+    size_t code_start = jit->code_used;
+    size_t fuel_fields[2];
+    uint8_t *start = emit_block_entry(jit, guest_pc, fuel_fields);
+    uint64_t pc = guest_pc;
+    int count = 0;
+    uint32_t native = 0;
+
+    for (;;) {
+        if (count == JIT_MAX_BLOCK_INSTRUCTIONS || (count > 0 && (pc & MEMORY_PAGE_MASK) == 0)) {
+            // Blocks never cross a page so invalidation stays per page
+            emit_exit(jit, pc, true);
+            break;
+        }
+
+        decoded_instruction_t d = decode_instruction(memory_read_word(cpu->memory, pc));
+        uint64_t next_pc = pc + sizeof(uint64_t);
+        bool block_done = true;
+        bool translated = true;
+
+        switch (d.opcode) {
+            case OP_ADD: case OP_SUB: case OP_AND: case OP_OR: case OP_XOR:
+                emit_load_guest(jit, HOST_RAX, d.rs1);
+                emit_load_guest(jit, HOST_RCX, d.rs2);
+                emit_alu_rax_rcx(jit, d.opcode == OP_ADD ? 0x01 : d.opcode == OP_SUB ? 0x29 :
+                                      d.opcode == OP_AND ? 0x21 : d.opcode == OP_OR ? 0x09 : 0x31);
+                emit_store_guest(jit, d.rd, HOST_RAX);
+                block_done = false;
+                break;
+            case OP_MUL:
+                emit_load_guest(jit, HOST_RAX, d.rs1);
+                emit_load_guest(jit, HOST_RCX, d.rs2);
+                emit_byte(jit, 0x48); // imul rax, rcx
+                emit_byte(jit, 0x0F);
+                emit_byte(jit, 0xAF);
+                emit_byte(jit, 0xC1);
+                emit_store_guest(jit, d.rd, HOST_RAX);
+                block_done = false;
+                break;
+            case OP_SLL: case OP_SRL: case OP_SRA:
+                emit_load_guest(jit, HOST_RAX, d.rs1);
+                emit_load_guest(jit, HOST_RCX, d.rs2);
+                emit_shift_rax_cl(jit, d.opcode == OP_SLL ? 4 : d.opcode == OP_SRL ? 5 : 7);
+                emit_store_guest(jit, d.rd, HOST_RAX);
+                block_done = false;
+                break;
+            case OP_CMP:
+                emit_load_guest(jit, HOST_RAX, d.rs1);
+                emit_load_guest(jit, HOST_RCX, d.rs2);
+                emit_alu_rax_rcx(jit, 0x39);
+                emit_setcc_cpu_byte(jit, 0x94, offsetof(cpu_state_t, zero_flag));     // sete
+                emit_setcc_cpu_byte(jit, 0x9C, offsetof(cpu_state_t, negative_flag)); // setl
+                block_done = false;
+                break;
+            case OP_ADDI: case OP_SUBI: case OP_ANDI: case OP_ORI: case OP_XORI:
+                emit_load_guest(jit, HOST_RAX, d.rs1);
+                emit_mov_imm64(jit, HOST_RCX, (uint64_t)d.immediate);
+                emit_alu_rax_rcx(jit, d.opcode == OP_ADDI ? 0x01 : d.opcode == OP_SUBI ? 0x29 :
+                                      d.opcode == OP_ANDI ? 0x21 : d.opcode == OP_ORI ? 0x09 : 0x31);
+                emit_store_guest(jit, d.rd, HOST_RAX);
+                block_done = false;
+                break;
+            case OP_LI:
+                emit_mov_imm64(jit, HOST_RAX, (uint64_t)d.immediate);
+                emit_store_guest(jit, d.rd, HOST_RAX);
+                block_done = false;
+                break;
+            case OP_JMP:
+                emit_exit(jit, d.address, true);
+                break;
+            case OP_JR:
+                emit_load_guest(jit, HOST_RAX, d.rs1);
+                emit_byte(jit, 0xE9);
+                emit_rel32(jit, jit->leave);
+                break;
+            case OP_JAL:
+            case OP_JALR: {
+                size_t stub_field = emit_ras_push(jit, next_pc);
+                if (d.opcode == OP_JALR) {
+                    emit_load_guest(jit, HOST_RAX, d.rs1); // Before R31 is written: JALR R31 calls the old R31
+                }
+                emit_mov_imm64(jit, HOST_RCX, next_pc);
+                emit_store_guest(jit, LINK_REGISTER, HOST_RCX);
+                if (d.opcode == OP_JAL) {
+                    emit_exit(jit, d.address, true);
+                } else {
+                    emit_byte(jit, 0xE9);
+                    emit_rel32(jit, jit->leave);
+                }
+                // The return stub: a chained exit to the return address, reached through the stack
+                uint64_t stub = (uint64_t)(uintptr_t)(jit->code + jit->code_used);
+                memcpy(jit->code + stub_field, &stub, sizeof(stub));
+                emit_exit(jit, next_pc, true);
+                break;
+            }
+            case OP_RET:
+                emit_load_guest(jit, HOST_RAX, LINK_REGISTER);
+                emit_ras_return(jit);
+                break;
+            case OP_BEQ:
+            case OP_BNE: {
+                emit_load_guest(jit, HOST_RAX, d.rs1);
+                emit_load_guest(jit, HOST_RCX, d.rs2);
+                emit_alu_rax_rcx(jit, 0x39);
+                // Skip the taken exit with the inverse condition (jne for BEQ, je for BNE)
+                emit_byte(jit, 0x0F);
+                emit_byte(jit, d.opcode == OP_BEQ ? 0x85 : 0x84);
+                size_t skip = jit->code_used;
+                emit_u32(jit, 0);
+                emit_exit(jit, next_pc + d.immediate, true);
+                uint32_t distance = (uint32_t)(jit->code_used - (skip + sizeof(uint32_t)));
+                memcpy(jit->code + skip, &distance, sizeof(distance));
+                emit_exit(jit, next_pc, true);
+                break;
+            }
+            default:
+                // HALT, memory access and anything else go back to the interpreter
+                if (count == 0) {
+                    jit->code_used = code_start; // Drop the entry check
+                    return NULL;
+                }
+                emit_exit(jit, pc, false);
+                translated = false; // The interpreter runs (and charges) it
+                break;
+        }
+
+        if (translated) {
+            native++;
+        }
+        count++;
+        pc = next_pc;
+        if (block_done) {
+            break;
+        }
+    }
+
+    jit_set_block_length(jit, fuel_fields, native);
+    *length = native;
+    jit->blocks_compiled++;
+    return start;
+}
+
+// Helper function to interpret from the current PC up to the end of its basic block or the fuel
+static void jit_interpret(cpu_state_t *cpu, bool single_step) {
+    uint64_t fuel = cpu->fuel;
+    for (;;) {
+        const predecoded_instruction_t *entry = predecode_lookup(&cpu->predecode, cpu->memory, cpu->program_counter);
+        uint64_t next_pc = cpu->program_counter + sizeof(uint64_t);
+        cpu->program_counter = next_pc;
+        cpu_execute_decoded(cpu, &entry->decoded);
+        fuel--;
+        if (single_step || fuel == 0 || !cpu->running || cpu->program_counter != next_pc || !jit_is_straight_line(entry->decoded.opcode)) {
+            cpu->fuel = fuel;
+            return;
+        }
+    }
+}
+
+jit_state_t *jit_create(void) {
+#if JIT_SUPPORTED
+    jit_state_t *jit = (jit_state_t *)calloc(1, sizeof(jit_state_t));
+    if (!jit) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    void *code = mmap(NULL, JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        perror("Error mapping JIT code buffer");
+        free(jit);
+        return NULL;
+    }
+    jit->code = (uint8_t *)code;
+    jit->code_size = JIT_CODE_BUFFER_SIZE;
+
+    jit->enter = jit->code + jit->code_used;
+    emit_byte(jit, 0x53);       // push rbx
+    emit_byte(jit, 0x48);       // mov rbx, rdi
+    emit_byte(jit, 0x89);
+    emit_byte(jit, 0xFB);
+    emit_byte(jit, 0xFF);       // jmp rsi
+    emit_byte(jit, 0xE6);
+    jit->leave = jit->code + jit->code_used;
+    emit_byte(jit, 0x5B);       // pop rbx
+    emit_byte(jit, 0xC3);       // ret
+    jit->code_reserved = jit->code_used;
+    jit_ras_clear(jit);
+    return jit;
+#else
+    return NULL;
+#endif
+}
+
+void jit_destroy(jit_state_t *jit) {
+    if (!jit) {
+        return;
+    }
+#if JIT_SUPPORTED
+    munmap(jit->code, jit->code_size);
+#endif
+    free(jit->patches);
+    free(jit);
+}
+
+void jit_flush(jit_state_t *jit) {
+    jit->code_used = jit->code_reserved;
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    jit->block_count = 0;
+    jit->patch_count = 0;
+    memset(jit->code_pages, 0, sizeof(jit->code_pages));
+    jit->code_page_count = 0;
+    jit_ras_clear(jit);
+    jit->flushes++;
+}
+
+void jit_note_store(jit_state_t *jit, uint64_t address, uint64_t size) {
+    if (jit->code_page_count == 0) {
+        return;
+    }
+    uint64_t first = address >> MEMORY_PAGE_SHIFT;
+    uint64_t last = (address + size - 1) >> MEMORY_PAGE_SHIFT;
+    if (last - first < JIT_CODE_PAGE_SET_SIZE) {
+        for (uint64_t page_number = first; page_number != last + 1; page_number++) {
+            if (jit_has_code_page(jit, page_number)) {
+                jit_flush(jit);
+                return;
+            }
+        }
+        return;
+    }
+    // A block store covering more pages than the set holds, check the compiled pages instead
+    for (size_t i = 0; i < JIT_CODE_PAGE_SET_SIZE; i++) {
+        uint64_t entry = jit->code_pages[i];
+        if (entry != 0 && entry - 1 >= first && entry - 1 <= last) {
+            jit_flush(jit);
+            return;
+        }
+    }
+}
+
+void jit_run(cpu_state_t *cpu) {
+    jit_state_t *jit = cpu->jit;
+    jit_enter_t enter = (jit_enter_t)(void *)jit->enter;
+
+    cpu->running = true;
+    while (cpu->running && cpu->fuel > 0) {
+        cpu_poll_interrupts(cpu);
+        uint64_t pc = cpu->program_counter;
+        jit_block_t *block = jit_find_block(jit, pc, true);
+
+        if (!block->code && !block->failed && ++block->hits >= JIT_HOT_THRESHOLD) {
+            size_t worst_case = (JIT_MAX_BLOCK_INSTRUCTIONS + 1) * JIT_MAX_INSTRUCTION_BYTES;
+            if (jit->code_used + worst_case > jit->code_size || !jit_add_code_page(jit, pc >> MEMORY_PAGE_SHIFT)) {
+                jit_flush(jit);
+                block = jit_find_block(jit, pc, true);
+                jit_add_code_page(jit, pc >> MEMORY_PAGE_SHIFT);
+            }
+            uint32_t length = 0;
+            uint8_t *code = jit_compile_block(cpu, jit, pc, &length);
+            if (code) {
+                block->code = code;
+                block->length = (uint16_t)length;
+                jit_apply_patches(jit, pc, code);
+            } else {
+                block->failed = true;
+            }
+        }
+
+        if (block->code && cpu->fuel >= block->length) {
+            jit->native_entries++;
+            cpu->program_counter = enter(cpu, block->code);
+        } else {
+            // Cold blocks run a whole basic block in the interpreter, untranslatable ones a single
+            // instruction; so does a compiled block the remaining fuel does not cover
+            jit_interpret(cpu, block->failed);
+        }
+    }
+}
+
+void jit_print_stats(const jit_state_t *jit) {
+    printf("JIT: %llu blocks compiled, %llu exits chained, %llu native entries, %llu flushes, %zu bytes of code\n",
+           (unsigned long long)jit->blocks_compiled, (unsigned long long)jit->exits_chained,
+           (unsigned long long)jit->native_entries, (unsigned long long)jit->flushes,
+           jit->code_used - jit->code_reserved);
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Tier-2 compiler translating hot SDSCKS basic blocks to x86-64 machine code.
+// Blocks end at JMP, JR, JAL, JALR, RET, BEQ, BNE, HALT, the first instruction the
+// JIT cannot translate or the end of the guest page. Guest registers live in
+// cpu->registers[] and are addressed through a pinned host register. Block exits
+// with a known target are patched into direct jumps once the target is compiled.
+// Calls push their return address onto a small return address stack, so a RET
+// whose target matches the top entry continues in compiled code instead of
+// returning to the dispatcher for the lookup of an indirect jump.
+// Every block starts by testing the hart's interrupt hint (see trap.h) and returns to
+// the dispatcher when it is set. It then charges its whole length against the hart's fuel
+// with one compare and one subtract, returning to the dispatcher when the fuel does not
+// cover the block.
+
+// Number of times a block entry has to be reached before it is compiled
+#define JIT_HOT_THRESHOLD 16
+
+// Maximum number of guest instructions translated into one block
+#define JIT_MAX_BLOCK_INSTRUCTIONS 64
+
+// Size of the executable code buffer of one hart
+#define JIT_CODE_BUFFER_SIZE (4 * 1024 * 1024)
+
+struct cpu_state_s;
+
+typedef struct jit_state_s jit_state_t;
+
+// Function to check whether the host can run JIT compiled code
+bool jit_available(void);
+
+// Function to create the JIT state of a hart (NULL if the JIT is not available)
+jit_state_t *jit_create(void);
+
+// Function to release the code buffer and block map of a JIT
+void jit_destroy(jit_state_t *jit);
+
+// Function to drop every compiled block
+void jit_flush(jit_state_t *jit);
+
+// Function to drop compiled code if a store of size bytes at address hits a compiled page
+void jit_note_store(jit_state_t *jit, uint64_t address, uint64_t size);
+
+// Function to run a hart, executing compiled blocks and interpreting everything else
+void jit_run(struct cpu_state_s *cpu);
+
+// Function to print block and code buffer counters
+void jit_print_stats(const jit_state_t *jit);
+
+#endif // JIT_H
\ No newline at end of file
@@ -1,30 +1,301 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "vm.h" // Include the main VM header
+#include "batch_runner.h"
+#include "snapshot.h"
+#include "profiler.h"
+#include "trap.h"
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <program_binary_file>\n", program);
+    fprintf(stderr, "       %s [options] --restore=<snapshot_file>\n", program);
+    fprintf(stderr, "       %s [options] --batch=<manifest>\n", program);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --cpus=N                         Number of harts sharing the guest memory, one host thread each (default: 1)\n");
+    fprintf(stderr, "  --dispatch=switch|threaded|call  Interpreter loop to use (default: switch)\n");
+    fprintf(stderr, "  --block=FILE                     Give the guest a block device backed by FILE (see block_device.h)\n");
+    fprintf(stderr, "  --max-pages=N                    Fault guest stores that need more than N pages of memory (default: no limit)\n");
+    fprintf(stderr, "  --console=text|raw               Print console output values as text lines or copy their bytes (default: text)\n");
+    fprintf(stderr, "  --jit                            Compile hot basic blocks to native code\n");
+    fprintf(stderr, "  --verify                         Verify the program at load time and run it without register checks\n");
+    fprintf(stderr, "  --no-fusion                      Do not fuse instruction pairs into superinstructions\n");
+    fprintf(stderr, "  --fusion-stats                   Print how often each superinstruction fired\n");
+    fprintf(stderr, "  --stats                          Print the instructions executed and the execution time\n");
+    fprintf(stderr, "  --stop-after=N                   Stop every hart once it has executed N instructions (its fuel)\n");
+    fprintf(stderr, "  --profile=FILE                   Count instructions, branches and memory accesses and sample PCs; write a flat\n");
+    fprintf(stderr, "                                   profile to FILE and collapsed stacks to FILE.folded (switch interpreter only)\n");
+    fprintf(stderr, "  --symbols=FILE                   Name profiled PCs with a symbol file written by the assembler's --symbols\n");
+    fprintf(stderr, "  --trace=FILE                     Record the PC, instruction word and destination value of every\n");
+    fprintf(stderr, "                                   instruction to FILE (switch interpreter only, see trace_decoder)\n");
+    fprintf(stderr, "  --save-snapshot=FILE             Write the VM state to FILE when execution stops\n");
+    fprintf(stderr, "  --restore=FILE                   Resume from a snapshot instead of loading a program\n");
+    fprintf(stderr, "  --batch=FILE                     Run every program listed in FILE (one path per line) on a thread pool\n");
+    fprintf(stderr, "  --quantum=N                      Instructions a batch guest runs before it is rescheduled (default: %d)\n", BATCH_DEFAULT_QUANTUM);
+    fprintf(stderr, "  --workers=N                      Batch worker threads (default: one per core)\n");
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <program_binary_file>\n", argv[0]);
+    const char *program_file = NULL;
+    vm_dispatch_mode_t dispatch_mode = VM_DISPATCH_SWITCH;
+    bool use_jit = false;
+    bool verify = false;
+    bool fusion = true;
+    bool fusion_stats = false;
+    bool print_stats = false;
+    bool console_raw = false;
+    uint32_t cpu_count = 1;
+    const char *batch_manifest = NULL;
+    const char *restore_file = NULL;
+    const char *snapshot_file = NULL;
+    const char *profile_file = NULL;
+    const char *symbol_file = NULL;
+    const char *trace_file = NULL;
+    const char *block_file = NULL;
+    uint64_t stop_after = 0;
+    uint64_t page_limit = 0;
+    batch_options_t batch_options;
+    batch_default_options(&batch_options);
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--cpus=", strlen("--cpus=")) == 0) {
+            char *end;
+            unsigned long count = strtoul(argv[i] + strlen("--cpus="), &end, 10);
+            if (*end != '\0' || count == 0 || count > VM_MAX_CPUS) {
+                fprintf(stderr, "Error: --cpus expects a number between 1 and %d\n", VM_MAX_CPUS);
+                return 1;
+            }
+            cpu_count = (uint32_t)count;
+        } else if (strncmp(argv[i], "--dispatch=", strlen("--dispatch=")) == 0) {
+            if (!vm_parse_dispatch_mode(argv[i] + strlen("--dispatch="), &dispatch_mode)) {
+                fprintf(stderr, "Error: Unknown dispatch mode '%s'\n", argv[i] + strlen("--dispatch="));
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--block=", strlen("--block=")) == 0) {
+            block_file = argv[i] + strlen("--block=");
+        } else if (strncmp(argv[i], "--max-pages=", strlen("--max-pages=")) == 0) {
+            char *end;
+            page_limit = strtoull(argv[i] + strlen("--max-pages="), &end, 10);
+            if (*end != '\0' || page_limit == 0) {
+                fprintf(stderr, "Error: --max-pages expects a positive number of pages\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--console=", strlen("--console=")) == 0) {
+            const char *mode = argv[i] + strlen("--console=");
+            if (strcmp(mode, "text") != 0 && strcmp(mode, "raw") != 0) {
+                fprintf(stderr, "Error: Unknown console mode '%s'\n", mode);
+                return 1;
+            }
+            console_raw = strcmp(mode, "raw") == 0;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            use_jit = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (strcmp(argv[i], "--no-fusion") == 0) {
+            fusion = false;
+        } else if (strcmp(argv[i], "--fusion-stats") == 0) {
+            fusion_stats = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = true;
+        } else if (strncmp(argv[i], "--stop-after=", strlen("--stop-after=")) == 0) {
+            char *end;
+            stop_after = strtoull(argv[i] + strlen("--stop-after="), &end, 10);
+            if (*end != '\0' || stop_after == 0) {
+                fprintf(stderr, "Error: --stop-after expects a positive number of instructions\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--profile=", strlen("--profile=")) == 0) {
+            profile_file = argv[i] + strlen("--profile=");
+        } else if (strncmp(argv[i], "--symbols=", strlen("--symbols=")) == 0) {
+            symbol_file = argv[i] + strlen("--symbols=");
+        } else if (strncmp(argv[i], "--trace=", strlen("--trace=")) == 0) {
+            trace_file = argv[i] + strlen("--trace=");
+        } else if (strncmp(argv[i], "--save-snapshot=", strlen("--save-snapshot=")) == 0) {
+            snapshot_file = argv[i] + strlen("--save-snapshot=");
+        } else if (strncmp(argv[i], "--restore=", strlen("--restore=")) == 0) {
+            restore_file = argv[i] + strlen("--restore=");
+        } else if (strncmp(argv[i], "--batch=", strlen("--batch=")) == 0) {
+            batch_manifest = argv[i] + strlen("--batch=");
+        } else if (strncmp(argv[i], "--quantum=", strlen("--quantum=")) == 0) {
+            char *end;
+            batch_options.quantum = strtoull(argv[i] + strlen("--quantum="), &end, 10);
+            if (*end != '\0' || batch_options.quantum == 0) {
+                fprintf(stderr, "Error: --quantum expects a positive number of instructions\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--workers=", strlen("--workers=")) == 0) {
+            char *end;
+            unsigned long workers = strtoul(argv[i] + strlen("--workers="), &end, 10);
+            if (*end != '\0' || workers == 0 || workers > 4096) {
+                fprintf(stderr, "Error: --workers expects a number between 1 and 4096\n");
+                return 1;
+            }
+            batch_options.workers = (uint32_t)workers;
+        } else if (argv[i][0] == '-' || program_file) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            program_file = argv[i];
+        }
+    }
+    if (batch_manifest) {
+        if (program_file || cpu_count != 1) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (use_jit) {
+            fprintf(stderr, "Warning: --jit is ignored in batch mode, guests are interpreted.\n");
+        }
+        if (profile_file || trace_file) {
+            fprintf(stderr, "Warning: --profile and --trace are ignored in batch mode.\n");
+        }
+        if (block_file) {
+            fprintf(stderr, "Warning: --block is ignored in batch mode, guests share no backing file.\n");
+        }
+        batch_options.dispatch_mode = dispatch_mode;
+        batch_options.fusion_enabled = fusion;
+        batch_options.verify = verify;
+        batch_options.console_raw = console_raw;
+        batch_options.page_limit = page_limit;
+        return batch_run_manifest(batch_manifest, &batch_options) ? 0 : 1;
+    }
+    if (!program_file == !restore_file) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (profile_file && trace_file) {
+        fprintf(stderr, "Error: --profile and --trace cannot be combined\n");
         return 1;
     }
+    if ((profile_file || trace_file) && (use_jit || dispatch_mode != VM_DISPATCH_SWITCH)) {
+        fprintf(stderr, "Warning: Profiled and traced harts always use the switch interpreter.\n");
+        use_jit = false;
+    }
 
     vm_state_t vm;
     vm_init(&vm); // Initialize the VM state
+    vm.dispatch_mode = dispatch_mode;
+    vm.fusion_enabled = fusion;
+    vm.console.raw = console_raw;
+    vm.memory.page_limit = page_limit;
+    vm_set_cpu_count(&vm, cpu_count);
+    if (use_jit && !vm_enable_jit(&vm)) {
+        fprintf(stderr, "Warning: JIT is not available on this host, using the interpreter.\n");
+    }
+    if (profile_file) {
+        vm_enable_profile(&vm);
+    }
+    if (block_file && !vm_attach_block_device(&vm, block_file)) {
+        vm_destroy(&vm);
+        return 1;
+    }
+    if (trace_file && !vm_enable_trace(&vm, trace_file)) {
+        vm_destroy(&vm);
+        return 1;
+    }
 
-    if (vm_load_program(&vm, argv[1])) {
+    const char *image_file = restore_file ? restore_file : program_file;
+    bool loaded = restore_file ? vm_restore_snapshot(&vm, restore_file, true) : vm_load_program(&vm, program_file);
+    if (loaded) {
+        if (verify && !vm_verify_program(&vm)) {
+            fprintf(stderr, "Program failed verification: %s\n", image_file);
+            vm_destroy(&vm);
+            return 1;
+        }
+        for (uint32_t h = 0; stop_after && h < vm.num_cpus; h++) {
+            vm.cpus[h].fuel = stop_after;
+        }
         printf("Starting VM execution...\n");
-        vm_run(&vm); // Start the execution cycle
+        struct timespec run_start, run_end;
+        clock_gettime(CLOCK_MONOTONIC, &run_start);
+        vm_exit_reason_t exit_reason = vm_run(&vm); // Start the execution cycle
+        clock_gettime(CLOCK_MONOTONIC, &run_end);
+        if (exit_reason != VM_EXIT_HALT) {
+            printf("VM stopped: %s\n", vm_exit_reason_name(exit_reason));
+        }
+        if (trace_file) {
+            uint64_t records = 0;
+            if (vm_finish_trace(&vm, &records)) {
+                printf("Trace of %llu instructions written to %s\n", (unsigned long long)records, trace_file);
+            }
+        }
 
         printf("\nVM State After Execution:\n");
-        printf("Program Counter: 0x%llX\n", vm.program_counter);
-        for (int i = 0; i < NUM_REGISTERS; i++) {
-            printf("R%d: 0x%llX\n", i, vm.registers[i]);
+        uint64_t fused_formed[SUPER_COUNT] = {0};
+        uint64_t fusion_executed[SUPER_COUNT] = {0};
+        for (uint32_t h = 0; h < vm.num_cpus; h++) {
+            cpu_state_t *cpu = &vm.cpus[h];
+            if (vm.num_cpus > 1) {
+                printf("Hart %u:\n", h);
+            }
+            printf("Program Counter: 0x%llX\n", (unsigned long long)cpu->program_counter);
+            if (cpu->exit_reason == VM_EXIT_FAULT) {
+                printf("Fault: %s at 0x%llX (value 0x%llX)\n", trap_cause_name(cpu->fault.cause),
+                       (unsigned long long)cpu->fault.pc, (unsigned long long)cpu->fault.value);
+            }
+            for (int i = 0; i < NUM_REGISTERS; i++) {
+                printf("R%d: 0x%llX\n", i, (unsigned long long)cpu->registers[i]);
+            }
+            for (int i = 0; i < NUM_VECTOR_REGISTERS; i++) {
+                const uint64_t *lanes = cpu->vector_registers[i].lanes;
+                if (lanes[0] | lanes[1] | lanes[2] | lanes[3]) {
+                    printf("V%d: 0x%llX 0x%llX 0x%llX 0x%llX\n", i, (unsigned long long)lanes[0], (unsigned long long)lanes[1],
+                           (unsigned long long)lanes[2], (unsigned long long)lanes[3]);
+                }
+            }
+            for (int i = 0; i < NUM_FP_REGISTERS; i++) {
+                uint64_t bits;
+                memcpy(&bits, &cpu->fp_registers[i], sizeof(bits));
+                if (bits != 0) {
+                    printf("F%d: %.17g (0x%llX)\n", i, cpu->fp_registers[i], (unsigned long long)bits);
+                }
+            }
+            if (cpu->jit) {
+                jit_print_stats(cpu->jit);
+            }
+            for (int i = 0; i < SUPER_COUNT; i++) {
+                fused_formed[i] += cpu->predecode.fused_formed[i];
+                fusion_executed[i] += cpu->fusion_executed[i];
+            }
+        }
+        printf("Pages touched: %llu\n", (unsigned long long)vm.memory.pages_allocated);
+        if (print_stats) {
+            uint64_t instructions = 0;
+            for (uint32_t h = 0; h < vm.num_cpus; h++) {
+                instructions += vm.cpus[h].instructions_executed;
+            }
+            double seconds = (double)(run_end.tv_sec - run_start.tv_sec) + (run_end.tv_nsec - run_start.tv_nsec) / 1e9;
+            printf("Instructions executed: %llu\n", (unsigned long long)instructions);
+            printf("Execution time: %.9f s\n", seconds);
+        }
+        if (fusion_stats) {
+            print_fusion_stats(fused_formed, fusion_executed);
+        }
+        if (profile_file) {
+            profile_t *profile = profile_create();
+            for (uint32_t h = 0; h < vm.num_cpus; h++) {
+                profile_merge(profile, vm.cpus[h].profile);
+            }
+            profile_symbols_t symbols = { NULL, 0 };
+            bool have_symbols = symbol_file && profile_load_symbols(symbol_file, &symbols);
+            if (profile_write(profile, have_symbols ? &symbols : NULL, profile_file)) {
+                printf("Profile written to %s and %s.folded\n", profile_file, profile_file);
+            }
+            profile_free_symbols(&symbols);
+            profile_destroy(profile);
         }
         // You might want to print some memory contents or other relevant state here
+        if (snapshot_file && !vm_save_snapshot(&vm, snapshot_file)) {
+            vm_destroy(&vm);
+            return 1;
+        }
     } else {
-        fprintf(stderr, "Failed to load program: %s\n", argv[1]);
+        fprintf(stderr, "Failed to load program: %s\n", image_file);
+        vm_destroy(&vm);
         return 1;
     }
 
+    vm_destroy(&vm);
     return 0;
 }
\ No newline at end of file
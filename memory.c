@@ -2,63 +2,695 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "executable_file_format.h"
 
-// Static array to represent the virtual memory
-static uint8_t vm_memory[MEMORY_SIZE];
+// Helper function to allocate zeroed host bookkeeping (guest pages and page table nodes use calloc
+// directly, so running out of them faults the guest instead of ending the process)
+static void *memory_alloc_zeroed(size_t count, size_t size) {
+    void *block = calloc(count, size);
+    if (!block) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return block;
+}
+
+// Helper function to index a page table level (level 0 is the root)
+static size_t memory_level_index(uint64_t page_number, int level) {
+    unsigned shift = (unsigned)(MEMORY_LEVELS - 1 - level) * MEMORY_LEVEL_BITS;
+    if (level == 0) {
+        return (size_t)((page_number >> shift) & (MEMORY_ROOT_ENTRIES - 1));
+    }
+    return (size_t)((page_number >> shift) & (MEMORY_LEVEL_ENTRIES - 1));
+}
+
+void memory_init(vm_memory_t *mem) {
+    memset(mem, 0, sizeof(*mem));
+}
+
+// Helper function to check whether a page lives in a file mapping rather than in its own allocation
+static bool memory_is_mapped(const vm_memory_t *mem, const uint8_t *page) {
+    for (const memory_mapping_t *mapping = mem->mappings; mapping; mapping = mapping->next) {
+        if (page >= mapping->base && page < mapping->base + mapping->length) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Helper function to free a page table subtree; depth is the level of the table itself
+static void memory_free_table(vm_memory_t *mem, void **table, int depth) {
+    for (size_t i = 0; i < MEMORY_LEVEL_ENTRIES; i++) {
+        if (!table[i]) {
+            continue;
+        }
+        if (depth + 1 < MEMORY_LEVELS) {
+            memory_free_table(mem, (void **)table[i], depth + 1);
+        } else if (memory_is_mapped(mem, (uint8_t *)table[i])) {
+            continue; // Released with its mapping below
+        }
+        free(table[i]);
+    }
+}
+
+void memory_free(vm_memory_t *mem) {
+    memory_base_t *base = mem->base;
+    for (size_t i = 0; i < MEMORY_ROOT_ENTRIES; i++) {
+        if (!mem->root[i]) {
+            continue;
+        }
+        if (MEMORY_LEVELS > 1) {
+            memory_free_table(mem, (void **)mem->root[i], 1);
+        } else if (memory_is_mapped(mem, (uint8_t *)mem->root[i])) {
+            continue;
+        }
+        free(mem->root[i]);
+    }
+    memory_mapping_t *mapping = mem->mappings;
+    while (mapping) {
+        memory_mapping_t *next = mapping->next;
+        munmap(mapping->base, mapping->length);
+        free(mapping);
+        mapping = next;
+    }
+    memset(mem, 0, sizeof(*mem));
+    if (base && __atomic_sub_fetch(&base->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        memory_free(&base->memory);
+        free(base);
+    }
+}
+
+void memory_add_device(vm_memory_t *mem, memory_device_t *device) {
+    device->next = mem->devices;
+    mem->devices = device;
+}
+
+// Helper function to find the device mapped at an address (NULL for ordinary memory)
+static memory_device_t *memory_find_device(const vm_memory_t *mem, uint64_t address) {
+    for (memory_device_t *device = mem->devices; device; device = device->next) {
+        if (address - device->start < device->size) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+// Helper function to check whether a page holds part of a device, so it must not be cached in a TLB
+static bool memory_page_has_device(const vm_memory_t *mem, uint64_t page_number) {
+    uint64_t page_start = page_number << MEMORY_PAGE_SHIFT;
+    for (const memory_device_t *device = mem->devices; device; device = device->next) {
+        if (device->start <= page_start + MEMORY_PAGE_MASK && page_start <= device->start + (device->size - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool memory_freeze(vm_memory_t *mem) {
+    if (mem->pages_allocated == 0 && mem->tables_allocated == 0 && !mem->mappings) {
+        return false; // Nothing written since the last freeze
+    }
+    memory_base_t *base = (memory_base_t *)memory_alloc_zeroed(1, sizeof(memory_base_t));
+    memory_device_t *devices = mem->devices;
+    uint64_t page_limit = mem->page_limit;
+    base->memory = *mem; // Takes over the page table, the mappings and the older base
+    base->memory.devices = NULL;
+    base->references = 1;
+    memory_init(mem);
+    mem->base = base;
+    mem->devices = devices;
+    mem->page_limit = page_limit; // Counts the pages written after the freeze
+    return true;
+}
+
+bool memory_share(vm_memory_t *mem, vm_memory_t *clone) {
+    bool frozen = memory_freeze(mem);
+    memory_init(clone);
+    if (mem->base) {
+        __atomic_add_fetch(&mem->base->references, 1, __ATOMIC_RELAXED);
+        clone->base = mem->base;
+    }
+    clone->page_limit = mem->page_limit;
+    return frozen;
+}
+
+// Helper function to install a freshly allocated node in an empty table entry. When another
+// hart installed one first, the new node is released and the winner's node is returned.
+static void *memory_install(void **entry, void *node) {
+    void *expected = NULL;
+    if (__atomic_compare_exchange_n(entry, &expected, node, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return node;
+    }
+    free(node);
+    return expected;
+}
+
+// Helper function to count a new guest page against the page limit (false if the limit is reached)
+static bool memory_reserve_page(vm_memory_t *mem) {
+    uint64_t count = __atomic_load_n(&mem->pages_allocated, __ATOMIC_RELAXED);
+    do {
+        if (mem->page_limit != 0 && count >= mem->page_limit) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&mem->pages_allocated, &count, count + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+// Helper function to find the leaf table entry of a page, creating the tables above it if allocate is set
+// (NULL if they do not exist, or could not be allocated)
+static void **memory_leaf_entry(vm_memory_t *mem, uint64_t page_number, bool allocate) {
+    void **table = mem->root;
+
+    for (int level = 0; level < MEMORY_LEVELS - 1; level++) {
+        size_t index = memory_level_index(page_number, level);
+        void *next = __atomic_load_n(&table[index], __ATOMIC_ACQUIRE);
+        if (!next) {
+            void *node = allocate ? calloc(MEMORY_LEVEL_ENTRIES, sizeof(void *)) : NULL;
+            if (!node) {
+                return NULL;
+            }
+            next = memory_install(&table[index], node);
+            if (next == node) {
+                __atomic_fetch_add(&mem->tables_allocated, 1, __ATOMIC_RELAXED);
+            }
+        }
+        table = (void **)next;
+    }
+    return &table[memory_level_index(page_number, MEMORY_LEVELS - 1)];
+}
+
+uint8_t *memory_get_page(vm_memory_t *mem, uint64_t address, bool allocate) {
+    void **entry = memory_leaf_entry(mem, address >> MEMORY_PAGE_SHIFT, allocate);
+    void *page = entry ? __atomic_load_n(entry, __ATOMIC_ACQUIRE) : NULL;
+    if (page) {
+        return (uint8_t *)page;
+    }
+
+    // Pages not written since the fork still live in the shared base
+    uint8_t *shared = mem->base ? memory_get_page(&mem->base->memory, address, false) : NULL;
+    if (!allocate) {
+        return shared;
+    }
+    if (!entry || !memory_reserve_page(mem)) {
+        return NULL;
+    }
+    uint8_t *copy = (uint8_t *)calloc(1, MEMORY_PAGE_SIZE);
+    if (!copy) {
+        __atomic_fetch_sub(&mem->pages_allocated, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    if (shared) {
+        memcpy(copy, shared, MEMORY_PAGE_SIZE);
+    }
+    page = memory_install(entry, copy);
+    if (page != copy) {
+        __atomic_fetch_sub(&mem->pages_allocated, 1, __ATOMIC_RELAXED); // Another hart allocated it
+    }
+    return (uint8_t *)page;
+}
+
+// Helper function to check whether a page of layer is hidden by a copy in one of the address spaces above it
+static bool memory_is_shadowed(vm_memory_t *top, const vm_memory_t *layer, uint64_t page_number) {
+    for (vm_memory_t *upper = top; upper != layer; upper = &upper->base->memory) {
+        void **entry = memory_leaf_entry(upper, page_number, false);
+        if (entry && __atomic_load_n(entry, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Structure passed down a page table walk
+typedef struct {
+    vm_memory_t *top;          // Address space being walked
+    const vm_memory_t *layer;  // Layer (top or one of its bases) owning the table
+    memory_page_visitor_t visitor;
+    void *context;
+} memory_walk_t;
+
+// Helper function to visit the pages of a page table subtree in address order
+static bool memory_walk_table(void **table, int depth, uint64_t prefix, const memory_walk_t *walk) {
+    size_t entries = depth == 0 ? MEMORY_ROOT_ENTRIES : MEMORY_LEVEL_ENTRIES;
+    for (size_t i = 0; i < entries; i++) {
+        void *next = __atomic_load_n(&table[i], __ATOMIC_ACQUIRE);
+        if (!next) {
+            continue;
+        }
+        uint64_t page_number = (prefix << MEMORY_LEVEL_BITS) | i;
+        if (depth == MEMORY_LEVELS - 1) {
+            if (walk->layer != walk->top && memory_is_shadowed(walk->top, walk->layer, page_number)) {
+                continue;
+            }
+            if (!walk->visitor(page_number, (uint8_t *)next, walk->context)) {
+                return false;
+            }
+        } else if (!memory_walk_table((void **)next, depth + 1, page_number, walk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool memory_for_each_page(vm_memory_t *mem, memory_page_visitor_t visitor, void *context) {
+    for (vm_memory_t *layer = mem; layer; layer = layer->base ? &layer->base->memory : NULL) {
+        memory_walk_t walk = { mem, layer, visitor, context };
+        if (!memory_walk_table(layer->root, 0, 0, &walk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool memory_map_file_pages(vm_memory_t *mem, int fd, uint64_t offset, const uint64_t *page_numbers, uint64_t count) {
+    if (count == 0) {
+        return true;
+    }
+    size_t length = (size_t)(count * MEMORY_PAGE_SIZE);
+    // Private mapping: the kernel copies a page only when the guest first writes to it
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)offset);
+    if (base == MAP_FAILED) {
+        perror("Error mapping file pages");
+        return false;
+    }
+    memory_mapping_t *mapping = (memory_mapping_t *)memory_alloc_zeroed(1, sizeof(memory_mapping_t));
+    mapping->base = (uint8_t *)base;
+    mapping->length = length;
+    mapping->next = mem->mappings;
+    mem->mappings = mapping;
+
+    for (uint64_t i = 0; i < count; i++) {
+        void **entry = memory_leaf_entry(mem, page_numbers[i], true);
+        if (!entry || (!*entry && !memory_reserve_page(mem))) {
+            return false; // The pages mapped so far are released with the address space
+        }
+        void *previous = __atomic_exchange_n(entry, mapping->base + i * MEMORY_PAGE_SIZE, __ATOMIC_ACQ_REL);
+        if (previous && !memory_is_mapped(mem, (uint8_t *)previous)) {
+            free(previous);
+        }
+    }
+    return true;
+}
+
+// Helper function to access an aligned word as one host word, so a concurrent
+// store by another hart can never be observed half written
+static inline uint64_t *memory_host_word(uint8_t *page, uint64_t offset) {
+    return (uint64_t *)(void *)(page + offset);
+}
+
+uint8_t memory_read_byte(vm_memory_t *mem, uint64_t address) {
+    uint8_t *page = memory_get_page(mem, address, false);
+    if (!page) {
+        return 0; // Untouched memory reads as zero
+    }
+    return page[address & MEMORY_PAGE_MASK];
+}
+
+bool memory_write_byte(vm_memory_t *mem, uint64_t address, uint8_t value) {
+    uint8_t *page = memory_get_page(mem, address, true);
+    if (!page) {
+        return false;
+    }
+    page[address & MEMORY_PAGE_MASK] = value;
+    return true;
+}
+
+uint64_t memory_read_word(vm_memory_t *mem, uint64_t address) {
+    uint64_t offset = address & MEMORY_PAGE_MASK;
+    uint64_t value = 0;
+
+    if (offset + sizeof(uint64_t) > MEMORY_PAGE_SIZE) {
+        // The word straddles two pages (or wraps around the address space)
+        for (size_t i = 0; i < sizeof(uint64_t); i++) {
+            value |= ((uint64_t)memory_read_byte(mem, address + i) << (i * 8));
+        }
+        return value;
+    }
+
+    uint8_t *page = memory_get_page(mem, address, false);
+    if (!page) {
+        return 0;
+    }
+    if ((offset & (sizeof(uint64_t) - 1)) == 0) {
+        return memory_swap_to_host(__atomic_load_n(memory_host_word(page, offset), __ATOMIC_RELAXED));
+    }
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        value |= ((uint64_t)page[offset + i] << (i * 8));
+    }
+    return value;
+}
+
+bool memory_write_word(vm_memory_t *mem, uint64_t address, uint64_t value) {
+    uint64_t offset = address & MEMORY_PAGE_MASK;
+
+    if (offset + sizeof(uint64_t) > MEMORY_PAGE_SIZE) {
+        // Allocate both pages first, so a failed store leaves memory unchanged
+        if (!memory_get_page(mem, address, true) || !memory_get_page(mem, address + sizeof(uint64_t) - 1, true)) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(uint64_t); i++) {
+            memory_write_byte(mem, address + i, (uint8_t)(value >> (i * 8)));
+        }
+        return true;
+    }
+
+    uint8_t *page = memory_get_page(mem, address, true);
+    if (!page) {
+        return false;
+    }
+    if ((offset & (sizeof(uint64_t) - 1)) == 0) {
+        __atomic_store_n(memory_host_word(page, offset), memory_swap_to_host(value), __ATOMIC_RELAXED);
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        page[offset + i] = (uint8_t)(value >> (i * 8));
+    }
+    return true;
+}
 
-uint8_t memory_read_byte(uint64_t address) {
-    if (address >= MEMORY_SIZE) {
-        fprintf(stderr, "Error: Memory read out of bounds at address 0x%llX\n", address);
-        exit(EXIT_FAILURE); // Or return an error value
+void memory_tlb_flush(memory_tlb_t *tlb) {
+    for (int i = 0; i < MEMORY_TLB_ENTRIES; i++) {
+        tlb->entries[i].page_number = MEMORY_TLB_INVALID;
+        tlb->entries[i].page = NULL;
     }
-    return vm_memory[address];
 }
 
-void memory_write_byte(uint64_t address, uint8_t value) {
-    if (address >= MEMORY_SIZE) {
-        fprintf(stderr, "Error: Memory write out of bounds at address 0x%llX\n", address);
-        exit(EXIT_FAILURE); // Or handle the error differently
+// Helper function to cache a page of the address space's own page table in a TLB entry
+static void memory_tlb_fill(memory_tlb_t *tlb, const vm_memory_t *mem, uint64_t page_number, uint8_t *page) {
+    if (mem->devices && memory_page_has_device(mem, page_number)) {
+        return; // Device accesses must keep taking the slow path
     }
-    vm_memory[address] = value;
+    memory_tlb_entry_t *entry = &tlb->entries[page_number & (MEMORY_TLB_ENTRIES - 1)];
+    entry->page_number = page_number;
+    entry->page = page;
 }
 
-uint64_t memory_read_word(uint64_t address) {
-    if (address + sizeof(uint64_t) > MEMORY_SIZE) {
-        fprintf(stderr, "Error: Memory word read out of bounds starting at address 0x%llX\n", address);
-        exit(EXIT_FAILURE); // Or return an error value
+uint64_t memory_tlb_read_slow(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address, unsigned size) {
+    memory_device_t *device = mem->devices ? memory_find_device(mem, address) : NULL;
+    if (device) {
+        return device->read(device, address - device->start, size);
+    }
+    uint64_t page_number = address >> MEMORY_PAGE_SHIFT;
+    void **entry = memory_leaf_entry(mem, page_number, false);
+    void *page = entry ? __atomic_load_n(entry, __ATOMIC_ACQUIRE) : NULL;
+    if (page) {
+        memory_tlb_fill(tlb, mem, page_number, (uint8_t *)page);
+    }
+    // Shared or untouched pages are not cached: another hart may replace them with a private copy
+    if (size == sizeof(uint64_t)) {
+        return memory_read_word(mem, address);
     }
     uint64_t value = 0;
-    for (int i = 0; i < sizeof(uint64_t); i++) {
-        value |= ((uint64_t)vm_memory[address + i] << (i * 8));
+    for (unsigned i = 0; i < size; i++) {
+        value |= (uint64_t)memory_read_byte(mem, address + i) << (i * 8);
     }
     return value;
 }
 
-void memory_write_word(uint64_t address, uint64_t value) {
-    if (address + sizeof(uint64_t) > MEMORY_SIZE) {
-        fprintf(stderr, "Error: Memory word write out of bounds starting at address 0x%llX\n", address);
-        exit(EXIT_FAILURE); // Or handle the error differently
+bool memory_tlb_write_slow(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address, unsigned size, uint64_t value) {
+    memory_device_t *device = mem->devices ? memory_find_device(mem, address) : NULL;
+    if (device) {
+        device->write(device, address - device->start, size, value);
+        return true;
+    }
+    // Pages returned for writing are always private to this address space
+    uint8_t *page = memory_get_page(mem, address, true);
+    uint8_t *last = memory_get_page(mem, address + size - 1, true); // An unaligned value may straddle two pages
+    if (!page || !last) {
+        return false;
+    }
+    memory_tlb_fill(tlb, mem, address >> MEMORY_PAGE_SHIFT, page);
+    if (size == sizeof(uint64_t)) {
+        return memory_write_word(mem, address, value);
     }
-    for (int i = 0; i < sizeof(uint64_t); i++) {
-        vm_memory[address + i] = (uint8_t)(value >> (i * 8));
+    for (unsigned i = 0; i < size; i++) {
+        memory_write_byte(mem, address + i, (uint8_t)(value >> (i * 8)));
     }
+    return true;
 }
 
-// Optional: Function to initialize the memory (e.g., clear it)
-void memory_init() {
-    memset(vm_memory, 0, MEMORY_SIZE);
+// Helper function to get the number of bytes from address to the end of its page
+static uint64_t memory_page_room(uint64_t address) {
+    return MEMORY_PAGE_SIZE - (address & MEMORY_PAGE_MASK);
 }
 
-// Optional: Function to load program into memory (can replace the one in vm.c)
-bool memory_load_program(const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        perror("Error opening program file");
+// Helper function to copy a range that lies within one source page and one destination page
+static bool memory_copy_chunk(vm_memory_t *mem, uint64_t destination, uint64_t source, uint64_t length) {
+    uint8_t *to = memory_get_page(mem, destination, false);
+    const uint8_t *from = memory_get_page(mem, source, false);
+    if (!from && !to) {
+        return true; // Zeroes onto untouched memory
+    }
+    to = memory_get_page(mem, destination, true);
+    if (!to) {
         return false;
     }
+    from = memory_get_page(mem, source, false); // May now be the private copy of the same page
+    if (from) {
+        memmove(to + (destination & MEMORY_PAGE_MASK), from + (source & MEMORY_PAGE_MASK), (size_t)length);
+    } else {
+        memset(to + (destination & MEMORY_PAGE_MASK), 0, (size_t)length);
+    }
+    return true;
+}
 
-    size_t bytes_read = fread(vm_memory, 1, MEMORY_SIZE, file);
-    fclose(file);
-    printf("Loaded %zu bytes into VM memory.\n", bytes_read);
+bool memory_copy(vm_memory_t *mem, uint64_t destination, uint64_t source, uint64_t length) {
+    if (length == 0 || destination == source) {
+        return true;
+    }
+    if (destination < source || destination - source >= length) {
+        // Copy forwards, one page-bounded chunk at a time
+        while (length > 0) {
+            uint64_t chunk = length;
+            if (chunk > memory_page_room(source)) {
+                chunk = memory_page_room(source);
+            }
+            if (chunk > memory_page_room(destination)) {
+                chunk = memory_page_room(destination);
+            }
+            if (!memory_copy_chunk(mem, destination, source, chunk)) {
+                return false;
+            }
+            destination += chunk;
+            source += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+    // The destination overlaps the end of the source, copy backwards
+    uint64_t source_end = source + length;
+    uint64_t destination_end = destination + length;
+    while (length > 0) {
+        uint64_t chunk = length;
+        if (chunk > ((source_end - 1) & MEMORY_PAGE_MASK) + 1) {
+            chunk = ((source_end - 1) & MEMORY_PAGE_MASK) + 1;
+        }
+        if (chunk > ((destination_end - 1) & MEMORY_PAGE_MASK) + 1) {
+            chunk = ((destination_end - 1) & MEMORY_PAGE_MASK) + 1;
+        }
+        source_end -= chunk;
+        destination_end -= chunk;
+        if (!memory_copy_chunk(mem, destination_end, source_end, chunk)) {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+bool memory_fill(vm_memory_t *mem, uint64_t destination, uint8_t value, uint64_t length) {
+    while (length > 0) {
+        uint64_t chunk = length;
+        if (chunk > memory_page_room(destination)) {
+            chunk = memory_page_room(destination);
+        }
+        // Filling untouched memory with zeroes leaves it untouched
+        if (value != 0 || memory_get_page(mem, destination, false)) {
+            uint8_t *page = memory_get_page(mem, destination, true);
+            if (!page) {
+                return false;
+            }
+            memset(page + (destination & MEMORY_PAGE_MASK), value, (size_t)chunk);
+        }
+        destination += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+uint64_t memory_load_reserved_word(vm_memory_t *mem, uint64_t address) {
+    uint8_t *page = memory_get_page(mem, address, false);
+    if (!page) {
+        return 0;
+    }
+    return memory_swap_to_host(__atomic_load_n(memory_host_word(page, address & MEMORY_PAGE_MASK), __ATOMIC_ACQUIRE));
+}
+
+bool memory_compare_exchange_word(vm_memory_t *mem, uint64_t address, uint64_t expected, uint64_t desired,
+                                  uint64_t *previous) {
+    uint8_t *page = memory_get_page(mem, address, true);
+    if (!page) {
+        return false;
+    }
+    uint64_t host_expected = memory_swap_to_host(expected);
+    __atomic_compare_exchange_n(memory_host_word(page, address & MEMORY_PAGE_MASK), &host_expected,
+                                memory_swap_to_host(desired), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    *previous = memory_swap_to_host(host_expected);
     return true;
+}
+
+// Helper function to load a little-endian header field
+static uint64_t memory_header_field(const uint8_t *header, int offset, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)header[offset + i] << (i * 8);
+    }
+    return value;
+}
+
+// Helper function to read exactly size bytes at offset
+static bool memory_read_file(int fd, void *buffer, uint64_t size, uint64_t offset) {
+    uint8_t *bytes = (uint8_t *)buffer;
+    while (size > 0) {
+        ssize_t count = pread(fd, bytes, (size_t)size, (off_t)offset);
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= (uint64_t)count;
+        offset += (uint64_t)count;
+    }
+    return true;
+}
+
+// Helper function to load size bytes at file offset into guest memory at address,
+// mapping the whole file pages when both are page-aligned and copying the rest
+static bool memory_load_segment(vm_memory_t *mem, int fd, uint64_t offset, uint64_t address, uint64_t size) {
+    if (size == 0) {
+        return true;
+    }
+    // Only pages lying fully inside the segment are mapped: a partial last page would
+    // show whatever follows the segment in the file, or fault past the end of the file
+    uint64_t page_count = size >> MEMORY_PAGE_SHIFT;
+    long host_page = sysconf(_SC_PAGESIZE);
+    if (page_count > 0 && (offset & MEMORY_PAGE_MASK) == 0 && (address & MEMORY_PAGE_MASK) == 0 &&
+        host_page > 0 && MEMORY_PAGE_SIZE % (uint64_t)host_page == 0) {
+        uint64_t *page_numbers = (uint64_t *)memory_alloc_zeroed(page_count, sizeof(uint64_t));
+        for (uint64_t i = 0; i < page_count; i++) {
+            page_numbers[i] = (address >> MEMORY_PAGE_SHIFT) + i;
+        }
+        bool mapped = memory_map_file_pages(mem, fd, offset, page_numbers, page_count);
+        free(page_numbers);
+        if (mapped) {
+            uint64_t mapped_size = page_count << MEMORY_PAGE_SHIFT;
+            address += mapped_size;
+            offset += mapped_size;
+            size -= mapped_size;
+        }
+    }
+
+    // Unaligned segment, partial last page (or the file cannot be mapped), copy it page by page
+    uint64_t end = address + size;
+    while (address < end) {
+        uint64_t page_offset = address & MEMORY_PAGE_MASK;
+        uint64_t chunk = MEMORY_PAGE_SIZE - page_offset;
+        if (chunk > end - address) {
+            chunk = end - address;
+        }
+        uint8_t *page = memory_get_page(mem, address, true);
+        if (!page || !memory_read_file(fd, page + page_offset, chunk, offset)) {
+            return false;
+        }
+        address += chunk;
+        offset += chunk;
+    }
+    return true;
+}
+
+// Helper function to check that a segment lies inside the file and does not wrap around the address space
+static bool memory_segment_valid(uint64_t offset, uint64_t address, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && size <= file_size - offset && address + size >= address;
+}
+
+// Helper function to load an SDSCKS executable whose header has been read
+static bool memory_load_executable(vm_memory_t *mem, int fd, const uint8_t *header, uint64_t file_size,
+                                   const char *filename, memory_program_t *program) {
+    executable_file_header_t exe;
+    exe.magic = (uint32_t)memory_header_field(header, EXECUTABLE_MAGIC_OFFSET, 4);
+    exe.version = (uint16_t)memory_header_field(header, EXECUTABLE_VERSION_OFFSET, 2);
+    exe.code_address = memory_header_field(header, EXECUTABLE_CODE_ADDRESS_OFFSET, 8);
+    exe.code_size = memory_header_field(header, EXECUTABLE_CODE_SIZE_OFFSET, 8);
+    exe.code_offset = memory_header_field(header, EXECUTABLE_CODE_FILE_OFFSET, 8);
+    exe.data_address = memory_header_field(header, EXECUTABLE_DATA_ADDRESS_OFFSET, 8);
+    exe.data_size = memory_header_field(header, EXECUTABLE_DATA_SIZE_OFFSET, 8);
+    exe.data_offset = memory_header_field(header, EXECUTABLE_DATA_FILE_OFFSET, 8);
+    exe.entry_point = memory_header_field(header, EXECUTABLE_ENTRY_POINT_OFFSET, 8);
+
+    if (exe.version != EXECUTABLE_FILE_VERSION) {
+        fprintf(stderr, "Error: %s has executable format version %u, expected %d\n", filename, exe.version, EXECUTABLE_FILE_VERSION);
+        return false;
+    }
+    if (!memory_segment_valid(exe.code_offset, exe.code_address, exe.code_size, file_size) ||
+        !memory_segment_valid(exe.data_offset, exe.data_address, exe.data_size, file_size)) {
+        fprintf(stderr, "Error: A segment of %s lies outside the file\n", filename);
+        return false;
+    }
+    if (exe.data_size > 0 && exe.data_address < exe.code_address + exe.code_size &&
+        exe.data_address + exe.data_size > exe.code_address) {
+        fprintf(stderr, "Error: The code and data segments of %s overlap\n", filename);
+        return false;
+    }
+    if (exe.entry_point < exe.code_address || exe.entry_point >= exe.code_address + exe.code_size ||
+        (exe.entry_point - exe.code_address) % sizeof(uint64_t) != 0) {
+        fprintf(stderr, "Error: The entry point 0x%llX of %s is not an instruction of its code segment\n",
+                (unsigned long long)exe.entry_point, filename);
+        return false;
+    }
+
+    if (!memory_load_segment(mem, fd, exe.code_offset, exe.code_address, exe.code_size) ||
+        !memory_load_segment(mem, fd, exe.data_offset, exe.data_address, exe.data_size)) {
+        fprintf(stderr, "Error: Could not read the segments of %s\n", filename);
+        return false;
+    }
+    program->code_start = exe.code_address;
+    program->code_size = exe.code_size;
+    program->entry_point = exe.entry_point;
+    return true;
+}
+
+bool memory_load_program(vm_memory_t *mem, const char *filename, memory_program_t *program) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening program file");
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Error reading program file");
+        close(fd);
+        return false;
+    }
+    uint64_t file_size = (uint64_t)info.st_size;
+
+    uint8_t header[EXECUTABLE_HEADER_SIZE];
+    bool ok;
+    if (file_size >= EXECUTABLE_HEADER_SIZE && memory_read_file(fd, header, sizeof(header), 0) &&
+        memory_header_field(header, EXECUTABLE_MAGIC_OFFSET, 4) == SDSCKS_EXECUTABLE_MAGIC) {
+        ok = memory_load_executable(mem, fd, header, file_size, filename, program);
+    } else {
+        // Flat image: the whole file is code, loaded at address 0
+        program->code_start = 0;
+        program->code_size = file_size;
+        program->entry_point = 0;
+        ok = memory_load_segment(mem, fd, 0, 0, file_size);
+        if (!ok) {
+            fprintf(stderr, "Error: Could not read %s\n", filename);
+        }
+    }
+    close(fd); // Mapped segments stay valid after the descriptor is closed
+    return ok;
 }
\ No newline at end of file
@@ -3,20 +3,237 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
-// Define the size of the virtual memory (same as in vm.h)
-#define MEMORY_SIZE (4294967296 * 4294967296)
+// Guest memory is a sparse 64-bit address space. Pages are only allocated when
+// they are first written; reading a page that was never written returns zeroes.
+// A VM instance therefore only costs the pages (and page table nodes) it touches,
+// and page_limit caps them: a store that needs a page beyond the limit, or one the
+// host cannot allocate, fails instead of ending the process.
+// Cloned VMs share a frozen base address space: a clone's own page table only
+// holds the pages it has written, every other page is read from the base and
+// copied into the clone on its first write.
+// All harts of a VM share one address space: pages and table nodes are installed
+// with compare-and-swap, and aligned words are read and written as a whole.
+
+// Size of a guest page (4 KiB by default, define as 16 for 64 KiB pages)
+#ifndef MEMORY_PAGE_SHIFT
+#define MEMORY_PAGE_SHIFT 12
+#endif
+#define MEMORY_PAGE_SIZE ((uint64_t)1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_MASK (MEMORY_PAGE_SIZE - 1)
+
+// The page number is split into a small root index followed by several
+// 512-entry levels, so each page table node is 4 KiB on a 64-bit host.
+#define MEMORY_LEVEL_BITS 9
+#define MEMORY_LEVEL_ENTRIES (1 << MEMORY_LEVEL_BITS)
+#define MEMORY_INDEX_BITS (64 - MEMORY_PAGE_SHIFT)
+#define MEMORY_LEVELS ((MEMORY_INDEX_BITS + MEMORY_LEVEL_BITS - 1) / MEMORY_LEVEL_BITS)
+#define MEMORY_ROOT_BITS (MEMORY_INDEX_BITS - (MEMORY_LEVELS - 1) * MEMORY_LEVEL_BITS)
+#define MEMORY_ROOT_ENTRIES (1 << MEMORY_ROOT_BITS)
+
+// Structure describing where memory_load_program placed a program
+typedef struct {
+    uint64_t code_start;
+    uint64_t code_size;
+    uint64_t entry_point;
+} memory_program_t;
+
+// Structure describing a file mapping whose pages back guest pages (program load or snapshot restore)
+typedef struct memory_mapping_s {
+    uint8_t *base;
+    size_t length;
+    struct memory_mapping_s *next;
+} memory_mapping_t;
+
+struct memory_base_s;
+
+// Structure representing a memory-mapped device: loads and stores whose address falls in
+// [start, start + size) are passed to its callbacks instead of guest memory. Pages holding
+// a device are never cached in a TLB, so only accesses that miss the TLB look for devices.
+// Only loads and stores reach a device; atomics, block and vector instructions do not.
+typedef struct memory_device_s {
+    uint64_t start;
+    uint64_t size;
+    uint64_t (*read)(struct memory_device_s *device, uint64_t offset, unsigned size);
+    void (*write)(struct memory_device_s *device, uint64_t offset, unsigned size, uint64_t value);
+    struct memory_device_s *next;
+} memory_device_t;
+
+// Structure representing the address space of one VM instance
+typedef struct {
+    void *root[MEMORY_ROOT_ENTRIES]; // Radix table, leaves point to page data
+    uint64_t pages_allocated;        // Number of guest pages backed by host memory
+    uint64_t page_limit;             // Most pages pages_allocated may reach (0 for no limit)
+    uint64_t tables_allocated;       // Number of interior page table nodes
+    memory_mapping_t *mappings;      // File mappings owning some of the pages
+    struct memory_base_s *base;      // Frozen pages shared with clones (NULL if not cloned)
+    memory_device_t *devices;        // Memory-mapped devices, owned by the VM (kept by memory_freeze)
+} vm_memory_t;
+
+// Structure representing an address space frozen by a fork; it is never written again
+// and is released when the last address space built on top of it is freed
+typedef struct memory_base_s {
+    vm_memory_t memory;
+    uint64_t references;
+} memory_base_t;
+
+// Number of entries of a hart's software TLB (a power of two)
+#define MEMORY_TLB_ENTRIES 64
+#define MEMORY_TLB_INVALID UINT64_MAX // Never a valid page number
+
+// Structure representing one software TLB entry: a guest page and the host page behind it
+typedef struct {
+    uint64_t page_number;
+    uint8_t *page;
+} memory_tlb_entry_t;
+
+// Structure representing the direct-mapped software TLB of a hart. It only caches
+// pages of the address space's own page table, which stay in place while the harts
+// run, so other harts never have to shoot entries down. Pages still shared with the
+// base, pages never written and unaligned accesses always take the slow path.
+// Loading a program, restoring a snapshot or cloning the VM flushes the TLBs.
+typedef struct {
+    memory_tlb_entry_t entries[MEMORY_TLB_ENTRIES];
+} memory_tlb_t;
+
+// Callback for memory_for_each_page (return false to stop the walk)
+typedef bool (*memory_page_visitor_t)(uint64_t page_number, uint8_t *data, void *context);
+
+// Function to initialize an empty address space
+void memory_init(vm_memory_t *mem);
+
+// Function to release every page and page table node of an address space (devices are detached, not freed)
+void memory_free(vm_memory_t *mem);
+
+// Function to map a device into an address space (attach devices before the harts run)
+void memory_add_device(vm_memory_t *mem, memory_device_t *device);
+
+// Function to get the host page backing a guest address (NULL if not present and allocate is false).
+// With allocate set the page is private to this address space, so it may be written; NULL then
+// means the page limit was reached or the host is out of memory.
+uint8_t *memory_get_page(vm_memory_t *mem, uint64_t address, bool allocate);
+
+// Function to move the pages of an address space into a frozen base, so clones can share them
+// (returns false if there was nothing to move)
+bool memory_freeze(vm_memory_t *mem);
+
+// Function to make clone (an empty address space) share the pages of mem copy-on-write
+// (returns true if the pages of mem moved to a new base, which invalidates its TLBs)
+bool memory_share(vm_memory_t *mem, vm_memory_t *clone);
+
+// Function to call visitor for every page backed by host memory (pages of the base included)
+bool memory_for_each_page(vm_memory_t *mem, memory_page_visitor_t visitor, void *context);
+
+// Function to back the given guest pages with consecutive pages of a file, mapped copy-on-write from offset
+bool memory_map_file_pages(vm_memory_t *mem, int fd, uint64_t offset, const uint64_t *page_numbers, uint64_t count);
 
 // Function to read a byte from the virtual memory
-uint8_t memory_read_byte(uint64_t address);
+uint8_t memory_read_byte(vm_memory_t *mem, uint64_t address);
 
-// Function to write a byte to the virtual memory
-void memory_write_byte(uint64_t address, uint8_t value);
+// Function to write a byte to the virtual memory (false if its page could not be allocated)
+bool memory_write_byte(vm_memory_t *mem, uint64_t address, uint8_t value);
 
 // Function to read a word (64-bit) from the virtual memory
-uint64_t memory_read_word(uint64_t address);
+uint64_t memory_read_word(vm_memory_t *mem, uint64_t address);
+
+// Function to write a word (64-bit) to the virtual memory (false, writing nothing, if a page could not be allocated)
+bool memory_write_word(vm_memory_t *mem, uint64_t address, uint64_t value);
+
+// Function to read an aligned word with acquire ordering (LR)
+uint64_t memory_load_reserved_word(vm_memory_t *mem, uint64_t address);
+
+// Function to replace an aligned word if it holds expected, storing the previous value in previous
+// (CAS, SC). Returns false if the page could not be allocated.
+bool memory_compare_exchange_word(vm_memory_t *mem, uint64_t address, uint64_t expected, uint64_t desired,
+                                  uint64_t *previous);
+
+// Function to drop every entry of a software TLB
+void memory_tlb_flush(memory_tlb_t *tlb);
+
+// Function to read a little-endian value of size bytes (1, 2, 4 or 8) through the TLB after a miss
+uint64_t memory_tlb_read_slow(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address, unsigned size);
+
+// Function to write a little-endian value of size bytes (1, 2, 4 or 8) through the TLB after a miss
+// (false, writing nothing, if a page could not be allocated)
+bool memory_tlb_write_slow(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address, unsigned size, uint64_t value);
+
+// Function to copy length bytes within guest memory (the ranges may overlap, as with memmove).
+// Returns false if a destination page could not be allocated; the copy is then partial.
+bool memory_copy(vm_memory_t *mem, uint64_t destination, uint64_t source, uint64_t length);
+
+// Function to set length bytes of guest memory to value (false, after a partial fill, if a page could not be allocated)
+bool memory_fill(vm_memory_t *mem, uint64_t destination, uint8_t value, uint64_t length);
+
+// Helpers to convert between guest (little-endian) and host byte order
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MEMORY_SWAP16(value) __builtin_bswap16(value)
+#define MEMORY_SWAP32(value) __builtin_bswap32(value)
+#define MEMORY_SWAP64(value) __builtin_bswap64(value)
+#else
+#define MEMORY_SWAP16(value) (value)
+#define MEMORY_SWAP32(value) (value)
+#define MEMORY_SWAP64(value) (value)
+#endif
+
+static inline uint64_t memory_swap_to_host(uint64_t value) {
+    return MEMORY_SWAP64(value);
+}
+
+// Helper function to load an aligned little-endian value of size bytes from a host page as one access
+static inline uint64_t memory_host_load(const uint8_t *host, unsigned size) {
+    switch (size) {
+        case 1: return __atomic_load_n(host, __ATOMIC_RELAXED);
+        case 2: return MEMORY_SWAP16(__atomic_load_n((const uint16_t *)(const void *)host, __ATOMIC_RELAXED));
+        case 4: return MEMORY_SWAP32(__atomic_load_n((const uint32_t *)(const void *)host, __ATOMIC_RELAXED));
+        default: return MEMORY_SWAP64(__atomic_load_n((const uint64_t *)(const void *)host, __ATOMIC_RELAXED));
+    }
+}
+
+// Helper function to store an aligned little-endian value of size bytes to a host page as one access
+static inline void memory_host_store(uint8_t *host, unsigned size, uint64_t value) {
+    switch (size) {
+        case 1: __atomic_store_n(host, (uint8_t)value, __ATOMIC_RELAXED); break;
+        case 2: __atomic_store_n((uint16_t *)(void *)host, MEMORY_SWAP16((uint16_t)value), __ATOMIC_RELAXED); break;
+        case 4: __atomic_store_n((uint32_t *)(void *)host, MEMORY_SWAP32((uint32_t)value), __ATOMIC_RELAXED); break;
+        default: __atomic_store_n((uint64_t *)(void *)host, MEMORY_SWAP64(value), __ATOMIC_RELAXED); break;
+    }
+}
+
+// Helper function to read size bytes (1, 2, 4 or 8) through a hart's TLB: a hit on an aligned value is a single host load
+static inline uint64_t memory_tlb_read(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address, unsigned size) {
+    uint64_t page_number = address >> MEMORY_PAGE_SHIFT;
+    const memory_tlb_entry_t *entry = &tlb->entries[page_number & (MEMORY_TLB_ENTRIES - 1)];
+    if (__builtin_expect(entry->page_number == page_number && (address & (size - 1)) == 0, 1)) {
+        return memory_host_load(entry->page + (address & MEMORY_PAGE_MASK), size);
+    }
+    return memory_tlb_read_slow(tlb, mem, address, size);
+}
+
+// Helper function to write size bytes (1, 2, 4 or 8) through a hart's TLB: a hit on an aligned value is a single host store
+// (false if a page could not be allocated)
+static inline bool memory_tlb_write(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address, unsigned size, uint64_t value) {
+    uint64_t page_number = address >> MEMORY_PAGE_SHIFT;
+    const memory_tlb_entry_t *entry = &tlb->entries[page_number & (MEMORY_TLB_ENTRIES - 1)];
+    if (__builtin_expect(entry->page_number == page_number && (address & (size - 1)) == 0, 1)) {
+        memory_host_store(entry->page + (address & MEMORY_PAGE_MASK), size, value);
+        return true;
+    }
+    return memory_tlb_write_slow(tlb, mem, address, size, value);
+}
+
+// Helper function to read a word through a hart's TLB
+static inline uint64_t memory_tlb_read_word(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address) {
+    return memory_tlb_read(tlb, mem, address, sizeof(uint64_t));
+}
+
+// Helper function to write a word through a hart's TLB (false if a page could not be allocated)
+static inline bool memory_tlb_write_word(memory_tlb_t *tlb, vm_memory_t *mem, uint64_t address, uint64_t value) {
+    return memory_tlb_write(tlb, mem, address, sizeof(uint64_t), value);
+}
 
-// Function to write a word (64-bit) to the virtual memory
-void memory_write_word(uint64_t address, uint64_t value);
+// Function to load a program into memory: the segments of an SDSCKS executable are
+// mapped from the file copy-on-write, any other file is read as a flat image at address 0
+bool memory_load_program(vm_memory_t *mem, const char *filename, memory_program_t *program);
 
 #endif // MEMORY_H
\ No newline at end of file
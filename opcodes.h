@@ -4,6 +4,10 @@
 // Define opcodes for the SDSCKS instruction set
 // Keep them relatively sparse for potential future expansion
 
+// The opcode occupies the top byte of every 64-bit instruction word
+#define OPCODE_SHIFT 56
+#define OPCODE_COUNT 256
+
 // R-Type Instructions (Register-Register)
 #define OP_ADD  0x01 // Add two registers
 #define OP_SUB  0x02 // Subtract two registers
@@ -29,11 +33,100 @@
 #define OP_LOAD 0x21 // Load from memory to register
 #define OP_STORE 0x22 // Store from register to memory
 
+// Sized loads and stores: LB Rd, Offset(Rs1) accesses Rs1 + Offset (16-bit signed).
+// Loads zero-extend the value; stores write the low bytes of Rd.
+#define OP_LB   0x23 // Load byte
+#define OP_LH   0x24 // Load half-word (16 bits)
+#define OP_LW   0x25 // Load word (32 bits)
+#define OP_LD   0x26 // Load double word (64 bits)
+#define OP_SB   0x27 // Store byte
+#define OP_SH   0x28 // Store half-word
+#define OP_SW   0x29 // Store word
+#define OP_SD   0x2A // Store double word
+
+// Block Memory Instructions. One execution handles at most BLOCK_STEP_BYTES and costs one
+// instruction of fuel; the rest is left in the registers and the instruction runs again, so
+// a long block can be interrupted, run out of fuel and resume. Rs2 counts down to 0 and Rd
+// (and Rs1 of MEMCPY) move past the bytes done, except when the destination of a MEMCPY
+// overlaps the end of its source: that copy runs backwards and only counts Rs2 down.
+// Rs2 must differ from the other registers, and so must Rs1 of MEMSET.
+#define OP_MEMCPY 0x2B // Copy Rs2 bytes from address Rs1 to address Rd: MEMCPY Rd, Rs1, Rs2 (ranges may overlap)
+#define OP_MEMSET 0x2C // Set Rs2 bytes at address Rd to the low byte of Rs1: MEMSET Rd, Rs1, Rs2
+#define BLOCK_STEP_BYTES 4096
+
 // Control Flow Instructions
 #define OP_JMP  0x31 // Jump to address (immediate)
 #define OP_JR   0x32 // Jump to address in register
 #define OP_BEQ  0x33 // Branch if equal (to zero or another register)
 #define OP_BNE  0x34 // Branch if not equal
+#define OP_JAL  0x35 // Call: R31 = address of the next instruction, jump to address (immediate)
+#define OP_JALR 0x36 // Call the address in a register: JALR Rs (R31 = address of the next instruction)
+#define OP_RET  0x37 // Return: jump to the address in R31
+
+// Atomic Memory Instructions (shared memory between harts, aligned words only)
+#define OP_LR    0x41 // Load word and reserve its address: LR Rd, (Rs1)
+#define OP_SC    0x42 // Store Rs2 if the reservation still holds: SC Rd, (Rs1), Rs2 (Rd = 0 on success)
+#define OP_CAS   0x43 // Compare-and-swap: CAS Rd, (Rs1), Rs2 (store Rs2 if memory equals Rd, Rd = old value)
+#define OP_FENCE 0x44 // Order memory accesses and pick up code written by other harts
+
+// Vector Instructions (see vector_unit.h). Lane-wise: VADD Vd, Vs1, Vs2 with the
+// registers in the Rd, Rs1 and Rs2 fields; the width bit selects 32-bit lanes.
+#define VECTOR_NARROW_BIT 26
+#define OP_VADD    0x51 // Add lanes
+#define OP_VSUB    0x52 // Subtract lanes
+#define OP_VMUL    0x53 // Multiply lanes (low half of the product)
+#define OP_VAND    0x54 // Bitwise AND
+#define OP_VOR     0x55 // Bitwise OR
+#define OP_VXOR    0x56 // Bitwise XOR
+#define OP_VSLL    0x57 // Shift lanes left by the matching lanes of Vs2
+#define OP_VSRL    0x58 // Shift lanes right logical
+#define OP_VSRA    0x59 // Shift lanes right arithmetic
+#define OP_VCMPEQ  0x5A // Lanes set to all ones where equal
+#define OP_VCMPLT  0x5B // Lanes set to all ones where Vs1 < Vs2 (signed)
+#define OP_VLOAD   0x5C // Load 32 bytes: VLOAD Vd, Offset(Rs1)
+#define OP_VSTORE  0x5D // Store 32 bytes: VSTORE Vd, Offset(Rs1)
+#define OP_VREDSUM 0x5E // Sum of the lanes into a scalar register: VREDSUM Rd, Vs1
+#define OP_VSPLAT  0x5F // Copy a scalar register into every lane: VSPLAT Vd, Rs1
+
+// Floating Point Instructions (IEEE 754 double precision, executed by the host FPU).
+// FADD Fd, Fs1, Fs2 uses the Rd, Rs1 and Rs2 fields for FP registers; FMADD adds Fs3 in bits 26-30.
+#define FP_RS3_SHIFT 26
+#define OP_FADD    0x61 // Add
+#define OP_FSUB    0x62 // Subtract
+#define OP_FMUL    0x63 // Multiply
+#define OP_FDIV    0x64 // Divide
+#define OP_FSQRT   0x65 // Square root: FSQRT Fd, Fs1
+#define OP_FMADD   0x66 // Fused multiply-add, rounded once: FMADD Fd, Fs1, Fs2, Fs3 (Fs1 * Fs2 + Fs3)
+#define OP_FEQ     0x67 // Rd = 1 if Fs1 == Fs2, else 0 (0 if either is NaN): FEQ Rd, Fs1, Fs2
+#define OP_FLT     0x68 // Rd = 1 if Fs1 < Fs2
+#define OP_FLE     0x69 // Rd = 1 if Fs1 <= Fs2
+#define OP_FCVTDL  0x6A // Convert a signed integer to double: FCVTDL Fd, Rs1
+#define OP_FCVTLD  0x6B // Convert a double to a signed integer, rounding toward zero (saturates, NaN gives the maximum): FCVTLD Rd, Fs1
+#define OP_FMVDX   0x6C // Move the bits of an integer register into an FP register: FMVDX Fd, Rs1
+#define OP_FMVXD   0x6D // Move the bits of an FP register into an integer register: FMVXD Rd, Fs1
+#define OP_FLD     0x6E // Load a double: FLD Fd, Offset(Rs1)
+#define OP_FSD     0x6F // Store a double: FSD Fd, Offset(Rs1)
+
+// Trap Instructions (see trap.h). CSRR Rd, Csr has Rd in bits 21-25, CSRW Csr, Rs1 has Rs1 in
+// bits 16-20; the control and status register number is in the low 16 bits.
+#define OP_ECALL 0x71 // Trap to the vector with cause TRAP_CAUSE_ECALL
+#define OP_ERET  0x72 // Return from a trap: PC = EPC, re-enable interrupts if they were enabled on entry
+#define OP_CSRR  0x73 // Read a control and status register: CSRR Rd, Csr
+#define OP_CSRW  0x74 // Write a control and status register: CSRW Csr, Rs1
+#define OP_WFI   0x75 // Wait until an enabled interrupt is pending
+#define OP_EBREAK 0x76 // Return to the host with VM_EXIT_BREAKPOINT; running the hart again resumes after it
+
+// Control and status registers of every hart
+#define CSR_STATUS  0x0 // Bit 0 interrupts enabled, bit 1 their state before the trap, bit 2 inside a trap handler (read-only)
+#define CSR_VECTOR  0x1 // Address of the trap handler, 0 turns traps off (faults stop the hart)
+#define CSR_EPC     0x2 // Address ERET returns to: the trapping instruction, or the next one to run for interrupts
+#define CSR_CAUSE   0x3 // Cause of the last trap (TRAP_CAUSE_* in trap.h)
+#define CSR_TVAL    0x4 // Faulting address or opcode of the last trap
+#define CSR_IE      0x5 // Interrupt lines enabled (bit n for line n)
+#define CSR_IP      0x6 // Interrupt lines pending (read-only, cleared by the device raising them)
+#define CSR_SCRATCH 0x7 // Free for the trap handler
+#define CSR_HARTID  0x8 // Id of the hart (read-only)
+#define CSR_COUNT   9
 
 // System Instructions
 #define OP_HALT 0xFF // Halt execution
@@ -0,0 +1,138 @@
+#include "predecode_cache.h"
+#include "instruction_execution.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Helper function to forget every predicted return (their slots may be about to change)
+static void predecode_ras_clear(predecode_cache_t *cache) {
+    memset(cache->ras, 0, sizeof(cache->ras));
+}
+
+void predecode_init(predecode_cache_t *cache) {
+    memset(cache, 0, sizeof(*cache));
+    cache->fusion_enabled = true;
+}
+
+void predecode_free(predecode_cache_t *cache) {
+    for (int i = 0; i < PREDECODE_CACHE_PAGES; i++) {
+        free(cache->pages[i].entries);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Helper function to decode one instruction word into a cache slot
+static void predecode_slot(predecoded_instruction_t *slot, uint64_t instruction_word, bool verified) {
+    slot->decoded = decode_instruction(instruction_word);
+    if (verified) {
+        slot->handler = get_unchecked_instruction_handler(slot->decoded.opcode);
+        slot->dispatch = (uint16_t)(slot->decoded.opcode | PREDECODE_VERIFIED);
+    } else {
+        slot->handler = get_instruction_handler(slot->decoded.opcode);
+        slot->dispatch = (uint16_t)slot->decoded.opcode;
+    }
+}
+
+// Helper function to check whether an instruction always continues with the next slot of its
+// page (the inline bodies of the threaded loop); anything else ends a basic block
+static bool predecode_falls_through(uint32_t opcode) {
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_AND:
+        case OP_OR: case OP_XOR: case OP_SLL: case OP_SRL: case OP_SRA: case OP_CMP:
+        case OP_ADDI: case OP_SUBI: case OP_ANDI: case OP_ORI: case OP_XORI: case OP_LI:
+        case OP_LOAD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Helper function to fill in the basic block lengths of a decoded page, from its end backwards
+static void predecode_measure_blocks(predecoded_instruction_t *entries) {
+    uint16_t length = 0;
+    for (uint64_t i = PREDECODE_PAGE_ENTRIES; i-- > 0;) {
+        length = predecode_falls_through(entries[i].decoded.opcode) ? (uint16_t)(length + 1) : 1;
+        entries[i].block_length = length;
+    }
+}
+
+// Helper function to turn adjacent instruction pairs of a decoded page into superinstructions
+static void predecode_fuse_page(predecode_cache_t *cache, predecoded_instruction_t *entries) {
+    for (uint64_t i = 0; i + 1 < PREDECODE_PAGE_ENTRIES; i++) {
+        int super = find_superinstruction(entries[i].decoded.opcode, entries[i + 1].decoded.opcode);
+        if (super < 0) {
+            continue;
+        }
+        bool verified = (entries[i].dispatch & PREDECODE_VERIFIED) && (entries[i + 1].dispatch & PREDECODE_VERIFIED);
+        entries[i].dispatch = (uint16_t)(PREDECODE_FUSED + 2 * super + (verified ? 1 : 0));
+        cache->fused_formed[super]++;
+    }
+}
+
+predecoded_instruction_t *predecode_fill(predecode_cache_t *cache, vm_memory_t *mem, uint64_t address) {
+    if ((address & (sizeof(uint64_t) - 1)) != 0) {
+        // Misaligned code is decoded on every fetch and never cached
+        predecode_slot(&cache->scratch, memory_read_word(mem, address), false);
+        cache->scratch.block_length = 1;
+        return &cache->scratch;
+    }
+
+    uint64_t page_number = address >> MEMORY_PAGE_SHIFT;
+    predecode_page_t *page = &cache->pages[page_number % PREDECODE_CACHE_PAGES];
+    if (!page->valid || page->page_number != page_number) {
+        predecode_ras_clear(cache); // Refilling the page overwrites slots the stack may point to
+        if (!page->entries) {
+            page->entries = (predecoded_instruction_t *)malloc(PREDECODE_PAGE_ENTRIES * sizeof(predecoded_instruction_t));
+            if (!page->entries) {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // Decode the whole page at once so following fetches in it are plain array accesses
+        uint8_t *data = memory_get_page(mem, address, false);
+        uint64_t page_address = page_number << MEMORY_PAGE_SHIFT;
+        for (uint64_t i = 0; i < PREDECODE_PAGE_ENTRIES; i++) {
+            uint64_t slot_address = page_address + i * sizeof(uint64_t);
+            uint64_t instruction_word = 0;
+            if (data) {
+                for (size_t b = 0; b < sizeof(uint64_t); b++) {
+                    instruction_word |= ((uint64_t)data[i * sizeof(uint64_t) + b] << (b * 8));
+                }
+            }
+            predecode_slot(&page->entries[i], instruction_word,
+                           slot_address >= cache->verified_start && slot_address < cache->verified_end);
+        }
+        predecode_measure_blocks(page->entries);
+        if (cache->fusion_enabled) {
+            predecode_fuse_page(cache, page->entries);
+        }
+        page->page_number = page_number;
+        page->valid = true;
+        cache->fills++;
+    }
+    return &page->entries[(address & MEMORY_PAGE_MASK) / sizeof(uint64_t)];
+}
+
+void predecode_invalidate(predecode_cache_t *cache, uint64_t address) {
+    uint64_t page_number = address >> MEMORY_PAGE_SHIFT;
+    predecode_page_t *page = &cache->pages[page_number % PREDECODE_CACHE_PAGES];
+    if (page->valid && page->page_number == page_number) {
+        page->valid = false;
+        cache->invalidations++;
+        predecode_ras_clear(cache);
+    }
+}
+
+void predecode_flush(predecode_cache_t *cache) {
+    for (int i = 0; i < PREDECODE_CACHE_PAGES; i++) {
+        cache->pages[i].valid = false;
+    }
+    predecode_ras_clear(cache);
+}
+
+void predecode_set_verified_range(predecode_cache_t *cache, uint64_t start, uint64_t end) {
+    cache->verified_start = start;
+    cache->verified_end = end;
+    predecode_flush(cache);
+}
\ No newline at end of file
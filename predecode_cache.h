@@ -0,0 +1,142 @@
+#ifndef PREDECODE_CACHE_H
+#define PREDECODE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "instruction_decoder.h"
+#include "memory.h"
+#include "superinstructions.h"
+
+// Number of guest code pages kept decoded at the same time (direct-mapped by page number)
+#define PREDECODE_CACHE_PAGES 64
+
+// Number of instruction slots in one guest page
+#define PREDECODE_PAGE_ENTRIES (MEMORY_PAGE_SIZE / sizeof(uint64_t))
+
+// Added to the dispatch index of slots inside the verified code range
+#define PREDECODE_VERIFIED 0x100
+
+// Dispatch index of the first slot of a fused pair: PREDECODE_FUSED + 2 * superinstruction (+ 1 if verified)
+#define PREDECODE_FUSED 0x200
+#define PREDECODE_DISPATCH_COUNT (PREDECODE_FUSED + 2 * SUPER_COUNT)
+
+// Number of entries of the return address stack (a power of two); deeper calls overwrite the oldest
+#define PREDECODE_RAS_SIZE 16
+
+struct cpu_state_s;
+
+// Handler executing one decoded instruction on a hart (see instruction_execution.h)
+typedef void (*instruction_handler_t)(struct cpu_state_s *cpu, const decoded_instruction_t *decoded);
+
+// Structure representing one predecoded instruction slot
+typedef struct {
+    decoded_instruction_t decoded;
+    instruction_handler_t handler; // Unchecked variant inside the verified code range
+    uint16_t dispatch;             // Index into the threaded dispatch table (see PREDECODE_VERIFIED/PREDECODE_FUSED)
+    uint16_t block_length;         // Slots from this one up to the end of its basic block (see predecode_fill)
+} predecoded_instruction_t;
+
+// Structure representing one decoded guest page
+typedef struct {
+    uint64_t page_number;
+    bool valid;
+    predecoded_instruction_t *entries; // PREDECODE_PAGE_ENTRIES slots, allocated on first use
+} predecode_page_t;
+
+// Structure representing a return address stack entry: the slot a call will most likely return to
+typedef struct {
+    uint64_t return_pc;
+    predecoded_instruction_t *slot; // NULL if the return address is not in the caller's decoded page
+} predecode_ras_entry_t;
+
+// Structure representing the predecode cache of a hart
+typedef struct {
+    predecode_page_t pages[PREDECODE_CACHE_PAGES];
+    predecode_ras_entry_t ras[PREDECODE_RAS_SIZE]; // Cleared whenever a decoded page changes
+    uint32_t ras_top;
+    predecoded_instruction_t scratch; // Used for instructions that are not 8-byte aligned
+    uint64_t verified_start;          // Code range proven valid by the verifier (empty if start == end)
+    uint64_t verified_end;
+    bool fusion_enabled;              // Fuse instruction pairs into superinstructions
+    uint64_t fused_formed[SUPER_COUNT];
+    uint64_t fills;
+    uint64_t invalidations;
+} predecode_cache_t;
+
+// Function to initialize an empty predecode cache
+void predecode_init(predecode_cache_t *cache);
+
+// Function to release the memory used by the predecode cache
+void predecode_free(predecode_cache_t *cache);
+
+// Function to decode the page containing address and return its slot for address. Every slot
+// also gets the length of the straight-line run starting at it: the slots up to and including
+// the next one that may leave the run (control flow, stores, handlers, HALT) or the page end.
+// The interpreters charge a whole run against the hart's fuel at once.
+predecoded_instruction_t *predecode_fill(predecode_cache_t *cache, vm_memory_t *mem, uint64_t address);
+
+// Function to drop the decoded copy of the page containing address (after a store to it)
+void predecode_invalidate(predecode_cache_t *cache, uint64_t address);
+
+// Function to drop every decoded page
+void predecode_flush(predecode_cache_t *cache);
+
+// Function to set the code range whose slots use unchecked handlers (flushes the cache)
+void predecode_set_verified_range(predecode_cache_t *cache, uint64_t start, uint64_t end);
+
+// Function to look up the predecoded instruction at address, decoding its page on a miss
+static inline predecoded_instruction_t *predecode_lookup(predecode_cache_t *cache, vm_memory_t *mem, uint64_t address) {
+    uint64_t page_number = address >> MEMORY_PAGE_SHIFT;
+    predecode_page_t *page = &cache->pages[page_number % PREDECODE_CACHE_PAGES];
+    if (page->valid && page->page_number == page_number && (address & (sizeof(uint64_t) - 1)) == 0) {
+        return &page->entries[(address & MEMORY_PAGE_MASK) / sizeof(uint64_t)];
+    }
+    return predecode_fill(cache, mem, address);
+}
+
+// Helper function to remember the slot a call returns to (JAL, JALR)
+static inline void predecode_ras_push(predecode_cache_t *cache, uint64_t return_pc, predecoded_instruction_t *slot) {
+    predecode_ras_entry_t *entry = &cache->ras[cache->ras_top++ & (PREDECODE_RAS_SIZE - 1)];
+    entry->return_pc = return_pc;
+    entry->slot = slot;
+}
+
+// Helper function to predict the slot of a RET to target. Returns NULL when the prediction is
+// wrong (the guest changed its return address or the stack overflowed) and the caller looks up
+// target in the cache instead.
+static inline predecoded_instruction_t *predecode_ras_pop(predecode_cache_t *cache, uint64_t target) {
+    predecode_ras_entry_t *entry = &cache->ras[--cache->ras_top & (PREDECODE_RAS_SIZE - 1)];
+    if (entry->return_pc != target) {
+        return NULL;
+    }
+    return entry->slot;
+}
+
+// Helper function to invalidate the decoded copy of one page if it is cached
+static inline void predecode_note_store_page(predecode_cache_t *cache, uint64_t page_number) {
+    predecode_page_t *page = &cache->pages[page_number % PREDECODE_CACHE_PAGES];
+    if (page->valid && page->page_number == page_number) {
+        predecode_invalidate(cache, page_number << MEMORY_PAGE_SHIFT);
+    }
+}
+
+// Function to invalidate the decoded pages touched by a store (a block store may cover many pages)
+static inline void predecode_note_store(predecode_cache_t *cache, uint64_t address, uint64_t size) {
+    uint64_t first = address >> MEMORY_PAGE_SHIFT;
+    uint64_t last = (address + size - 1) >> MEMORY_PAGE_SHIFT;
+    if (last - first < PREDECODE_CACHE_PAGES) {
+        for (uint64_t page_number = first; page_number != last + 1; page_number++) {
+            predecode_note_store_page(cache, page_number);
+        }
+        return;
+    }
+    // The range covers more pages than the cache holds, check the cached pages instead
+    for (uint64_t i = 0; i < PREDECODE_CACHE_PAGES; i++) {
+        predecode_page_t *page = &cache->pages[i];
+        if (page->valid && page->page_number >= first && page->page_number <= last) {
+            predecode_invalidate(cache, page->page_number << MEMORY_PAGE_SHIFT);
+        }
+    }
+}
+
+#endif // PREDECODE_CACHE_H
\ No newline at end of file
@@ -0,0 +1,399 @@
+#include "profiler.h"
+#include "vector_unit.h"
+#include "trap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_INITIAL_SITES 1024 // Power of two
+
+// Helper function to hash a PC into the site table
+static inline size_t profile_hash(uint64_t pc, size_t capacity) {
+    return (size_t)(((pc >> 3) * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+// Helper function to double the site table and rehash its entries
+static void profile_grow(profile_t *profile) {
+    size_t capacity = profile->site_capacity ? profile->site_capacity * 2 : PROFILE_INITIAL_SITES;
+    profile_site_t *sites = (profile_site_t *)calloc(capacity, sizeof(profile_site_t));
+    if (!sites) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < profile->site_capacity; i++) {
+        const profile_site_t *site = &profile->sites[i];
+        if (site->key == 0) {
+            continue;
+        }
+        size_t index = profile_hash(site->key - 1, capacity);
+        while (sites[index].key != 0) {
+            index = (index + 1) & (capacity - 1);
+        }
+        sites[index] = *site;
+    }
+    free(profile->sites);
+    profile->sites = sites;
+    profile->site_capacity = capacity;
+}
+
+// Helper function to find the counters of a PC, adding them on first use
+static profile_site_t *profile_site(profile_t *profile, uint64_t pc) {
+    if ((profile->site_count + 1) * 2 > profile->site_capacity) {
+        profile_grow(profile);
+    }
+    size_t index = profile_hash(pc, profile->site_capacity);
+    for (;;) {
+        profile_site_t *site = &profile->sites[index];
+        if (site->key == pc + 1) {
+            return site;
+        }
+        if (site->key == 0) {
+            site->key = pc + 1;
+            profile->site_count++;
+            return site;
+        }
+        index = (index + 1) & (profile->site_capacity - 1);
+    }
+}
+
+// Helper function to pick the distance to the next PC sample (uniform in [interval / 2, interval * 3 / 2))
+static uint64_t profile_next_sample_distance(profile_t *profile) {
+    uint64_t x = profile->sample_random; // xorshift64
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    profile->sample_random = x;
+    return PROFILE_SAMPLE_INTERVAL / 2 + x % PROFILE_SAMPLE_INTERVAL;
+}
+
+profile_t *profile_create(void) {
+    profile_t *profile = (profile_t *)calloc(1, sizeof(profile_t));
+    if (!profile) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    profile->sample_random = 0x9E3779B97F4A7C15ULL;
+    profile->until_sample = profile_next_sample_distance(profile);
+    profile_grow(profile);
+    return profile;
+}
+
+void profile_destroy(profile_t *profile) {
+    if (!profile) {
+        return;
+    }
+    free(profile->sites);
+    free(profile);
+}
+
+void profile_merge(profile_t *total, const profile_t *profile) {
+    for (int i = 0; i < OPCODE_COUNT; i++) {
+        total->opcode_counts[i] += profile->opcode_counts[i];
+    }
+    total->instructions += profile->instructions;
+    total->memory_reads += profile->memory_reads;
+    total->memory_writes += profile->memory_writes;
+    total->bytes_read += profile->bytes_read;
+    total->bytes_written += profile->bytes_written;
+    for (size_t i = 0; i < profile->site_capacity; i++) {
+        const profile_site_t *from = &profile->sites[i];
+        if (from->key == 0) {
+            continue;
+        }
+        profile_site_t *site = profile_site(total, from->key - 1);
+        site->samples += from->samples;
+        site->taken += from->taken;
+        site->not_taken += from->not_taken;
+    }
+}
+
+// Helper function to count the guest memory an instruction is about to access. Conditional
+// writes (SC, CAS) count as writes whether or not they succeed.
+static void profile_count_memory(profile_t *profile, const cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t read = 0;
+    uint64_t written = 0;
+    switch (decoded->opcode) {
+        case OP_LB: read = 1; break;
+        case OP_LH: read = 2; break;
+        case OP_LW: read = 4; break;
+        case OP_LOAD: case OP_LD: case OP_FLD: case OP_LR: read = 8; break;
+        case OP_VLOAD: read = VECTOR_BYTES; break;
+        case OP_SB: written = 1; break;
+        case OP_SH: written = 2; break;
+        case OP_SW: written = 4; break;
+        case OP_STORE: case OP_SD: case OP_FSD: case OP_SC: written = 8; break;
+        case OP_VSTORE: written = VECTOR_BYTES; break;
+        case OP_CAS: read = 8; written = 8; break;
+        case OP_MEMCPY: // One step of the block (see opcodes.h)
+            read = cpu->registers[decoded->rs2];
+            read = read < BLOCK_STEP_BYTES ? read : BLOCK_STEP_BYTES;
+            written = read;
+            break;
+        case OP_MEMSET:
+            written = cpu->registers[decoded->rs2];
+            written = written < BLOCK_STEP_BYTES ? written : BLOCK_STEP_BYTES;
+            break;
+        default: return;
+    }
+    if (read) {
+        profile->memory_reads++;
+        profile->bytes_read += read;
+    }
+    if (written) {
+        profile->memory_writes++;
+        profile->bytes_written += written;
+    }
+}
+
+void cpu_run_profiled(cpu_state_t *cpu) {
+    profile_t *profile = cpu->profile;
+    uint64_t fuel = cpu->fuel;
+    uint64_t executed = 0;
+    cpu->running = true;
+    while (cpu->running && executed < fuel) {
+        cpu_poll_interrupts(cpu);
+        uint64_t pc = cpu->program_counter;
+        const decoded_instruction_t *decoded = &predecode_lookup(&cpu->predecode, cpu->memory, pc)->decoded;
+        profile_count_memory(profile, cpu, decoded);
+        cpu->program_counter = pc + sizeof(uint64_t);
+        cpu_execute_decoded(cpu, decoded);
+        executed++;
+
+        profile->opcode_counts[decoded->opcode]++;
+        if (decoded->opcode == OP_BEQ || decoded->opcode == OP_BNE) {
+            profile_site_t *site = profile_site(profile, pc);
+            if (cpu->program_counter != pc + sizeof(uint64_t)) {
+                site->taken++;
+            } else {
+                site->not_taken++;
+            }
+        }
+        if (--profile->until_sample == 0) {
+            profile->until_sample = profile_next_sample_distance(profile);
+            profile_site(profile, pc)->samples++;
+        }
+    }
+    profile->instructions += executed;
+    cpu->fuel = fuel - executed;
+}
+
+// Helper function to order symbols by address
+static int compare_symbols(const void *a, const void *b) {
+    uint64_t x = ((const profile_symbol_t *)a)->address;
+    uint64_t y = ((const profile_symbol_t *)b)->address;
+    return x < y ? -1 : x > y;
+}
+
+bool profile_load_symbols(const char *path, profile_symbols_t *symbols) {
+    symbols->symbols = NULL;
+    symbols->count = 0;
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Error opening symbol file");
+        return false;
+    }
+    size_t capacity = 0;
+    char line[512];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char name[256];
+        unsigned long long address;
+        if (line[0] == '\n' || line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%llx %255s", &address, name) != 2) {
+            fprintf(stderr, "Error: Malformed symbol on line %d of %s\n", line_number, path);
+            fclose(file);
+            profile_free_symbols(symbols);
+            return false;
+        }
+        if (symbols->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            profile_symbol_t *grown = (profile_symbol_t *)realloc(symbols->symbols, capacity * sizeof(profile_symbol_t));
+            if (!grown) {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            symbols->symbols = grown;
+        }
+        symbols->symbols[symbols->count].address = address;
+        symbols->symbols[symbols->count].name = strdup(name);
+        symbols->count++;
+    }
+    fclose(file);
+    qsort(symbols->symbols, symbols->count, sizeof(profile_symbol_t), compare_symbols);
+    return true;
+}
+
+void profile_free_symbols(profile_symbols_t *symbols) {
+    for (size_t i = 0; i < symbols->count; i++) {
+        free(symbols->symbols[i].name);
+    }
+    free(symbols->symbols);
+    symbols->symbols = NULL;
+    symbols->count = 0;
+}
+
+// Helper function to find the symbol a PC belongs to (the closest one at or below it)
+static const profile_symbol_t *profile_find_symbol(const profile_symbols_t *symbols, uint64_t pc) {
+    if (!symbols || symbols->count == 0 || pc < symbols->symbols[0].address) {
+        return NULL;
+    }
+    size_t low = 0;
+    size_t high = symbols->count; // The answer is in [low, high)
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (symbols->symbols[middle].address <= pc) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return &symbols->symbols[low];
+}
+
+// Helper function to format a PC as "symbol+0xOFFSET" (or the plain address without a symbol)
+static void profile_format_location(const profile_symbols_t *symbols, uint64_t pc, char *buffer, size_t size) {
+    const profile_symbol_t *symbol = profile_find_symbol(symbols, pc);
+    if (!symbol) {
+        snprintf(buffer, size, "0x%llX", (unsigned long long)pc);
+    } else if (symbol->address == pc) {
+        snprintf(buffer, size, "%s", symbol->name);
+    } else {
+        snprintf(buffer, size, "%s+0x%llX", symbol->name, (unsigned long long)(pc - symbol->address));
+    }
+}
+
+// Helper function to order sites by descending sample count, then by PC
+static int compare_sites_by_samples(const void *a, const void *b) {
+    const profile_site_t *x = *(const profile_site_t *const *)a;
+    const profile_site_t *y = *(const profile_site_t *const *)b;
+    if (x->samples != y->samples) {
+        return x->samples > y->samples ? -1 : 1;
+    }
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Helper function to order sites by PC
+static int compare_sites_by_pc(const void *a, const void *b) {
+    const profile_site_t *x = *(const profile_site_t *const *)a;
+    const profile_site_t *y = *(const profile_site_t *const *)b;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Structure pairing an opcode with its retired count (for sorting)
+typedef struct {
+    uint32_t opcode;
+    uint64_t count;
+} profile_opcode_count_t;
+
+// Helper function to order opcodes by descending retired count
+static int compare_opcode_counts(const void *a, const void *b) {
+    const profile_opcode_count_t *x = (const profile_opcode_count_t *)a;
+    const profile_opcode_count_t *y = (const profile_opcode_count_t *)b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->opcode < y->opcode ? -1 : x->opcode > y->opcode;
+}
+
+bool profile_write(const profile_t *profile, const profile_symbols_t *symbols, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Error opening profile file");
+        return false;
+    }
+    double total = profile->instructions ? (double)profile->instructions : 1.0;
+
+    uint64_t sample_count = 0;
+    size_t site_count = 0;
+    const profile_site_t **sites = (const profile_site_t **)malloc((profile->site_count + 1) * sizeof(profile_site_t *));
+    if (!sites) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < profile->site_capacity; i++) {
+        if (profile->sites[i].key != 0) {
+            sites[site_count++] = &profile->sites[i];
+            sample_count += profile->sites[i].samples;
+        }
+    }
+
+    fprintf(file, "Flat profile: %llu instructions retired, %llu PC samples (one every %d instructions on average)\n",
+            (unsigned long long)profile->instructions, (unsigned long long)sample_count, PROFILE_SAMPLE_INTERVAL);
+    fprintf(file, "Memory accesses: %llu reads (%llu bytes), %llu writes (%llu bytes)\n",
+            (unsigned long long)profile->memory_reads, (unsigned long long)profile->bytes_read,
+            (unsigned long long)profile->memory_writes, (unsigned long long)profile->bytes_written);
+
+    profile_opcode_count_t opcodes[OPCODE_COUNT];
+    for (int i = 0; i < OPCODE_COUNT; i++) {
+        opcodes[i].opcode = (uint32_t)i;
+        opcodes[i].count = profile->opcode_counts[i];
+    }
+    qsort(opcodes, OPCODE_COUNT, sizeof(profile_opcode_count_t), compare_opcode_counts);
+    fprintf(file, "\nRetired instructions by opcode:\n");
+    fprintf(file, "  %-10s %16s %8s\n", "Opcode", "Count", "Share");
+    for (int i = 0; i < OPCODE_COUNT && opcodes[i].count; i++) {
+        fprintf(file, "  %-10s %16llu %7.2f%%\n", get_opcode_mnemonic(opcodes[i].opcode),
+                (unsigned long long)opcodes[i].count, 100.0 * (double)opcodes[i].count / total);
+    }
+
+    char location[320];
+    qsort(sites, site_count, sizeof(profile_site_t *), compare_sites_by_samples);
+    fprintf(file, "\nSampled PCs:\n");
+    fprintf(file, "  %12s %8s  %-18s %s\n", "Samples", "Share", "PC", "Location");
+    for (size_t i = 0; i < site_count && sites[i]->samples; i++) {
+        uint64_t pc = sites[i]->key - 1;
+        profile_format_location(symbols, pc, location, sizeof(location));
+        fprintf(file, "  %12llu %7.2f%%  0x%016llX %s\n", (unsigned long long)sites[i]->samples,
+                100.0 * (double)sites[i]->samples / (double)(sample_count ? sample_count : 1), (unsigned long long)pc, location);
+    }
+
+    qsort(sites, site_count, sizeof(profile_site_t *), compare_sites_by_pc);
+    fprintf(file, "\nBranches:\n");
+    fprintf(file, "  %-18s %14s %14s %8s  %s\n", "PC", "Taken", "Not taken", "Taken", "Location");
+    for (size_t i = 0; i < site_count; i++) {
+        uint64_t executions = sites[i]->taken + sites[i]->not_taken;
+        if (executions == 0) {
+            continue;
+        }
+        uint64_t pc = sites[i]->key - 1;
+        profile_format_location(symbols, pc, location, sizeof(location));
+        fprintf(file, "  0x%016llX %14llu %14llu %7.2f%%  %s\n", (unsigned long long)pc,
+                (unsigned long long)sites[i]->taken, (unsigned long long)sites[i]->not_taken,
+                100.0 * (double)sites[i]->taken / (double)executions, location);
+    }
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+
+    // Collapsed stacks: the enclosing symbol is the frame, the sampled instruction its leaf
+    char folded_path[4096];
+    snprintf(folded_path, sizeof(folded_path), "%s.folded", path);
+    FILE *folded = ok ? fopen(folded_path, "w") : NULL;
+    if (ok && !folded) {
+        perror("Error opening collapsed stack file");
+        ok = false;
+    }
+    for (size_t i = 0; folded && i < site_count; i++) {
+        if (sites[i]->samples == 0) {
+            continue;
+        }
+        uint64_t pc = sites[i]->key - 1;
+        const profile_symbol_t *symbol = profile_find_symbol(symbols, pc);
+        if (symbol) {
+            fprintf(folded, "%s;0x%llX %llu\n", symbol->name, (unsigned long long)pc, (unsigned long long)sites[i]->samples);
+        } else {
+            fprintf(folded, "0x%llX %llu\n", (unsigned long long)pc, (unsigned long long)sites[i]->samples);
+        }
+    }
+    if (folded) {
+        ok = !ferror(folded);
+        ok = fclose(folded) == 0 && ok;
+    }
+    free(sites);
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write the profile to %s\n", path);
+    }
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm.h"
+
+// The instruction-level profiler (--profile) counts every retired instruction per
+// opcode, every BEQ/BNE per branch site and every guest memory access, and samples the
+// PC on average once every PROFILE_SAMPLE_INTERVAL instructions. The distance between
+// samples is randomized so that loops whose length divides the interval are not always
+// sampled at the same PC. Profiled harts run in their own switch loop, so the counters
+// cost a few increments per instruction.
+
+// Average number of retired instructions between two samples of the program counter
+#define PROFILE_SAMPLE_INTERVAL 64
+
+// Counters of one PC
+typedef struct {
+    uint64_t key;       // PC + 1, 0 for a free slot
+    uint64_t samples;   // Times the PC was sampled
+    uint64_t taken;     // Executions of a branch at this PC that branched
+    uint64_t not_taken; // Executions of a branch at this PC that fell through
+} profile_site_t;
+
+// Structure holding the profile of one hart (or the merged profile of a VM)
+typedef struct profile_s {
+    uint64_t opcode_counts[OPCODE_COUNT]; // Retired instructions per opcode
+    uint64_t instructions;
+    uint64_t memory_reads;  // Instructions that read guest memory
+    uint64_t memory_writes; // Instructions that wrote guest memory
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t until_sample;  // Instructions left before the next PC sample
+    uint64_t sample_random; // State of the generator of sampling distances
+    profile_site_t *sites;  // Open addressing table of the sampled PCs and branch sites
+    size_t site_capacity;
+    size_t site_count;
+} profile_t;
+
+// Structure representing one entry of a symbol file written by the assembler
+typedef struct {
+    uint64_t address;
+    char *name;
+} profile_symbol_t;
+
+// Structure holding the symbols of a program, sorted by address
+typedef struct {
+    profile_symbol_t *symbols;
+    size_t count;
+} profile_symbols_t;
+
+// Function to allocate an empty profile
+profile_t *profile_create(void);
+
+// Function to release a profile
+void profile_destroy(profile_t *profile);
+
+// Function to add the counters of profile to total
+void profile_merge(profile_t *total, const profile_t *profile);
+
+// Function to run a hart with the switch loop, counting into cpu->profile
+void cpu_run_profiled(cpu_state_t *cpu);
+
+// Function to read a symbol file ("<address> <name>" per line, see the assembler's --symbols)
+bool profile_load_symbols(const char *path, profile_symbols_t *symbols);
+
+// Function to release the symbols read by profile_load_symbols
+void profile_free_symbols(profile_symbols_t *symbols);
+
+// Function to write the flat profile to path and the sampled PCs as collapsed stacks
+// (one "frame;frame count" line per PC, the input of flamegraph.pl) to path.folded.
+// symbols may be NULL, PCs are then reported as plain addresses.
+bool profile_write(const profile_t *profile, const profile_symbols_t *symbols, const char *path);
+
+#endif // PROFILER_H
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "program_verifier.h"
+#include "instruction_decoder.h"
+#include "instruction_execution.h"
+#include "opcodes.h"
+#include <stdio.h>
+
+#define OPCODE_BITS ((uint64_t)0xFF << OPCODE_SHIFT)
+#define RD_RS1_RS2_BITS (((uint64_t)0x1F << 11) | ((uint64_t)0x1F << 16) | ((uint64_t)0x1F << 21))
+#define LOW_26_BITS ((uint64_t)0x3FFFFFF)
+
+// Helper function to get the mask of the instruction word bits used by an opcode's encoding (0 for unknown opcodes)
+static uint64_t verify_encoding_mask(uint32_t opcode) {
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_AND: case OP_OR:
+        case OP_XOR: case OP_SLL: case OP_SRL: case OP_SRA: case OP_CMP:
+        case OP_SC: case OP_CAS:
+        case OP_MEMCPY: case OP_MEMSET:
+            return OPCODE_BITS | RD_RS1_RS2_BITS;
+        case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR: case OP_VXOR:
+        case OP_VSLL: case OP_VSRL: case OP_VSRA: case OP_VCMPEQ: case OP_VCMPLT:
+            return OPCODE_BITS | RD_RS1_RS2_BITS | ((uint64_t)1 << VECTOR_NARROW_BIT);
+        case OP_VREDSUM: case OP_VSPLAT:
+            return OPCODE_BITS | ((uint64_t)0x1F << 11) | ((uint64_t)0x1F << 16) | ((uint64_t)1 << VECTOR_NARROW_BIT);
+        case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV:
+        case OP_FEQ: case OP_FLT: case OP_FLE:
+            return OPCODE_BITS | RD_RS1_RS2_BITS;
+        case OP_FMADD:
+            return OPCODE_BITS | RD_RS1_RS2_BITS | ((uint64_t)0x1F << FP_RS3_SHIFT);
+        case OP_FSQRT: case OP_FCVTDL: case OP_FCVTLD: case OP_FMVDX: case OP_FMVXD:
+        case OP_LR:
+            return OPCODE_BITS | ((uint64_t)0x1F << 11) | ((uint64_t)0x1F << 16);
+        case OP_ADDI: case OP_SUBI: case OP_ANDI: case OP_ORI: case OP_XORI:
+        case OP_LI:
+        case OP_LOAD: case OP_STORE:
+        case OP_LB: case OP_LH: case OP_LW: case OP_LD:
+        case OP_SB: case OP_SH: case OP_SW: case OP_SD:
+        case OP_VLOAD: case OP_VSTORE:
+        case OP_FLD: case OP_FSD:
+        case OP_JMP: case OP_JAL:
+        case OP_BEQ: case OP_BNE:
+            return OPCODE_BITS | LOW_26_BITS;
+        case OP_JR: case OP_JALR:
+            return OPCODE_BITS | ((uint64_t)0x1F << 21);
+        case OP_CSRR:
+            return OPCODE_BITS | ((uint64_t)0x1F << 21) | 0xFFFF;
+        case OP_CSRW:
+            return OPCODE_BITS | ((uint64_t)0x1F << 16) | 0xFFFF;
+        case OP_ECALL: case OP_ERET: case OP_WFI: case OP_EBREAK:
+        case OP_RET:
+        case OP_FENCE:
+        case OP_HALT:
+            return OPCODE_BITS;
+        default:
+            return 0;
+    }
+}
+
+// Helper function to check that a control transfer lands on an instruction inside the code
+static bool verify_target(uint64_t target, uint64_t code_start, uint64_t code_end) {
+    return target >= code_start && target < code_end && ((target - code_start) % sizeof(uint64_t)) == 0;
+}
+
+bool verify_program(vm_memory_t *mem, uint64_t code_start, uint64_t code_size) {
+    uint64_t code_end = code_start + code_size;
+    uint64_t error_count = 0;
+
+    if (code_size == 0 || code_size % sizeof(uint64_t) != 0) {
+        fprintf(stderr, "Verifier error: code size %llu is not a positive multiple of the instruction size\n",
+                (unsigned long long)code_size);
+        return false;
+    }
+
+    for (uint64_t pc = code_start; pc < code_end; pc += sizeof(uint64_t)) {
+        uint64_t instruction_word = memory_read_word(mem, pc);
+        decoded_instruction_t decoded = decode_instruction(instruction_word);
+        uint64_t next_pc = pc + sizeof(uint64_t);
+        uint64_t mask = verify_encoding_mask(decoded.opcode);
+
+        if (mask == 0 || !get_instruction_handler(decoded.opcode)) {
+            fprintf(stderr, "Verifier error at 0x%llX: unknown opcode 0x%02X\n", (unsigned long long)pc, decoded.opcode);
+            error_count++;
+            continue;
+        }
+        if ((instruction_word & ~mask) != 0) {
+            fprintf(stderr, "Verifier error at 0x%llX: reserved bits set in instruction 0x%016llX\n",
+                    (unsigned long long)pc, (unsigned long long)instruction_word);
+            error_count++;
+        }
+        if (decoded.rd >= NUM_REGISTERS || decoded.rs1 >= NUM_REGISTERS || decoded.rs2 >= NUM_REGISTERS) {
+            fprintf(stderr, "Verifier error at 0x%llX: register index out of range\n", (unsigned long long)pc);
+            error_count++;
+        }
+
+        switch (decoded.opcode) {
+            case OP_JMP:
+            case OP_JAL:
+                if (!verify_target(decoded.address, code_start, code_end)) {
+                    fprintf(stderr, "Verifier error at 0x%llX: jump target 0x%llX is outside the code\n",
+                            (unsigned long long)pc, (unsigned long long)decoded.address);
+                    error_count++;
+                }
+                break;
+            case OP_BEQ:
+            case OP_BNE:
+                if (!verify_target(next_pc + decoded.immediate, code_start, code_end)) {
+                    fprintf(stderr, "Verifier error at 0x%llX: branch target 0x%llX is outside the code\n",
+                            (unsigned long long)pc, (unsigned long long)(next_pc + decoded.immediate));
+                    error_count++;
+                }
+                break;
+            case OP_CSRR:
+            case OP_CSRW:
+                if (decoded.immediate >= CSR_COUNT) {
+                    fprintf(stderr, "Verifier error at 0x%llX: unknown control register %lld\n",
+                            (unsigned long long)pc, (long long)decoded.immediate);
+                    error_count++;
+                }
+                break;
+            default:
+                break;
+        }
+
+        // The last instruction must not fall through past the end of the code
+        if (next_pc == code_end && decoded.opcode != OP_HALT && decoded.opcode != OP_JMP && decoded.opcode != OP_JR &&
+            decoded.opcode != OP_RET && decoded.opcode != OP_ERET) {
+            fprintf(stderr, "Verifier error at 0x%llX: execution can fall off the end of the code\n", (unsigned long long)pc);
+            error_count++;
+        }
+    }
+
+    return error_count == 0;
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef PROGRAM_VERIFIER_H
+#define PROGRAM_VERIFIER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+
+// Load-time verifier for SDSCKS code. A range that passes is known to contain
+// only known opcodes with every operand field in range and no reserved bits set,
+// and every BEQ/BNE/JMP target (and the fall-through of the last instruction)
+// lands on an instruction inside the range. The interpreter then executes it with
+// the unchecked handler variants.
+
+// Function to verify the instructions in [code_start, code_start + code_size), printing every problem found
+bool verify_program(vm_memory_t *mem, uint64_t code_start, uint64_t code_size);
+
+#endif // PROGRAM_VERIFIER_H
\ No newline at end of file
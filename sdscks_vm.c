@@ -0,0 +1,171 @@
+#include "sdscks_vm.h"
+#include "snapshot.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+// Structure representing one embedded VM instance
+struct sdscks_vm_s {
+    vm_state_t state;
+    bool verify; // Verify every program loaded into this instance
+};
+
+// Helper function to get a hart of the instance (NULL for an invalid hart id)
+static cpu_state_t *sdscks_vm_cpu(const sdscks_vm_t *vm, uint32_t hart) {
+    if (hart >= vm->state.num_cpus) {
+        return NULL;
+    }
+    return &vm->state.cpus[hart];
+}
+
+// Helper function to verify a freshly loaded image if the instance asks for it
+static bool sdscks_vm_prepare(sdscks_vm_t *vm, const char *path) {
+    if (vm->verify && !vm_verify_program(&vm->state)) {
+        if (!vm->state.quiet) {
+            fprintf(stderr, "Error: Program failed verification: %s\n", path);
+        }
+        return false;
+    }
+    return true;
+}
+
+void sdscks_vm_default_options(sdscks_vm_options_t *options) {
+    options->cpus = 1;
+    options->dispatch_mode = VM_DISPATCH_SWITCH;
+    options->jit = false;
+    options->fusion = true;
+    options->verify = false;
+    options->console_raw = false;
+    options->console_output = stdout;
+    options->console_input_fd = STDIN_FILENO;
+    options->block_file = NULL;
+    options->page_limit = 0;
+    options->quiet = true;
+}
+
+sdscks_vm_t *sdscks_vm_create(const sdscks_vm_options_t *options) {
+    sdscks_vm_options_t defaults;
+    if (!options) {
+        sdscks_vm_default_options(&defaults);
+        options = &defaults;
+    }
+    sdscks_vm_t *vm = (sdscks_vm_t *)malloc(sizeof(sdscks_vm_t));
+    if (!vm) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    vm_init(&vm->state);
+    vm->verify = options->verify;
+    vm->state.dispatch_mode = options->dispatch_mode;
+    vm->state.fusion_enabled = options->fusion;
+    vm->state.quiet = options->quiet;
+    vm->state.memory.page_limit = options->page_limit;
+    vm->state.console.raw = options->console_raw;
+    vm->state.console.output_file = options->console_output ? options->console_output : stdout;
+    vm->state.console.input_fd = options->console_input_fd;
+    if (!vm_set_cpu_count(&vm->state, options->cpus)) {
+        sdscks_vm_destroy(vm);
+        return NULL;
+    }
+    if (options->jit && !vm_enable_jit(&vm->state) && !options->quiet) {
+        fprintf(stderr, "Warning: JIT is not available on this host, using the interpreter.\n");
+    }
+    if (options->block_file && !vm_attach_block_device(&vm->state, options->block_file)) {
+        sdscks_vm_destroy(vm);
+        return NULL;
+    }
+    return vm;
+}
+
+void sdscks_vm_destroy(sdscks_vm_t *vm) {
+    if (!vm) {
+        return;
+    }
+    vm_destroy(&vm->state);
+    free(vm);
+}
+
+bool sdscks_vm_load(sdscks_vm_t *vm, const char *path) {
+    return vm_load_program(&vm->state, path) && sdscks_vm_prepare(vm, path);
+}
+
+bool sdscks_vm_restore(sdscks_vm_t *vm, const char *path) {
+    return vm_restore_snapshot(&vm->state, path, true) && sdscks_vm_prepare(vm, path);
+}
+
+bool sdscks_vm_save(sdscks_vm_t *vm, const char *path) {
+    return vm_save_snapshot(&vm->state, path);
+}
+
+vm_exit_reason_t sdscks_vm_run(sdscks_vm_t *vm, uint64_t fuel) {
+    for (uint32_t h = 0; h < vm->state.num_cpus; h++) {
+        vm->state.cpus[h].fuel = fuel ? fuel : UINT64_MAX; // Stopped harts are not started again
+    }
+    return vm_run(&vm->state);
+}
+
+vm_exit_reason_t sdscks_vm_step(sdscks_vm_t *vm) {
+    return sdscks_vm_run(vm, 1);
+}
+
+uint32_t sdscks_vm_cpu_count(const sdscks_vm_t *vm) {
+    return vm->state.num_cpus;
+}
+
+uint64_t sdscks_vm_program_counter(const sdscks_vm_t *vm, uint32_t hart) {
+    const cpu_state_t *cpu = sdscks_vm_cpu(vm, hart);
+    return cpu ? cpu->program_counter : 0;
+}
+
+uint64_t sdscks_vm_get_register(const sdscks_vm_t *vm, uint32_t hart, uint32_t index) {
+    const cpu_state_t *cpu = sdscks_vm_cpu(vm, hart);
+    if (!cpu || index >= NUM_REGISTERS) {
+        return 0;
+    }
+    return cpu->registers[index];
+}
+
+bool sdscks_vm_set_register(sdscks_vm_t *vm, uint32_t hart, uint32_t index, uint64_t value) {
+    cpu_state_t *cpu = sdscks_vm_cpu(vm, hart);
+    if (!cpu || index >= NUM_REGISTERS) {
+        return false;
+    }
+    cpu->registers[index] = value;
+    return true;
+}
+
+vm_exit_reason_t sdscks_vm_exit_reason(const sdscks_vm_t *vm, uint32_t hart) {
+    const cpu_state_t *cpu = sdscks_vm_cpu(vm, hart);
+    return cpu ? cpu->exit_reason : VM_EXIT_NONE;
+}
+
+const vm_fault_t *sdscks_vm_fault(const sdscks_vm_t *vm, uint32_t hart) {
+    const cpu_state_t *cpu = sdscks_vm_cpu(vm, hart);
+    if (!cpu || cpu->exit_reason != VM_EXIT_FAULT) {
+        return NULL;
+    }
+    return &cpu->fault;
+}
+
+uint64_t sdscks_vm_read_word(sdscks_vm_t *vm, uint64_t address) {
+    return memory_read_word(&vm->state.memory, address);
+}
+
+bool sdscks_vm_write_word(sdscks_vm_t *vm, uint64_t address, uint64_t value) {
+    if (!memory_write_word(&vm->state.memory, address, value)) {
+        return false;
+    }
+    for (uint32_t h = 0; h < vm->state.num_cpus; h++) {
+        cpu_state_t *cpu = &vm->state.cpus[h];
+        memory_tlb_flush(&cpu->tlb); // The store may have replaced a shared page the TLB still points to
+        cpu_note_code_write(cpu, address, sizeof(uint64_t)); // The host may patch code
+    }
+    return true;
+}
+
+void sdscks_vm_get_stats(const sdscks_vm_t *vm, sdscks_vm_stats_t *stats) {
+    stats->instructions_executed = 0;
+    for (uint32_t h = 0; h < vm->state.num_cpus; h++) {
+        stats->instructions_executed += vm->state.cpus[h].instructions_executed;
+    }
+    stats->pages_touched = vm->state.memory.pages_allocated;
+}
\ No newline at end of file
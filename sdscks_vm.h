@@ -0,0 +1,102 @@
+#ifndef SDSCKS_VM_H
+#define SDSCKS_VM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "vm.h"
+
+// Embedding interface of the VM. Every sdscks_vm_t owns its guest memory, harts, devices and
+// counters, and the runtime keeps no global mutable state, so a host process can create many
+// instances and run each of them on its own thread. A single instance is not thread-safe:
+// one host thread at a time may call into it.
+//
+// A typical host loads a program, then calls sdscks_vm_run with a fuel budget until it
+// returns something other than VM_EXIT_OUT_OF_FUEL, inspecting the guest in between:
+//
+//   sdscks_vm_t *vm = sdscks_vm_create(NULL);
+//   if (vm && sdscks_vm_load(vm, "guest.bin")) {
+//       while (sdscks_vm_run(vm, 1000000) == VM_EXIT_OUT_OF_FUEL) { ... }
+//   }
+//   sdscks_vm_destroy(vm);
+
+// Opaque handle of one VM instance
+typedef struct sdscks_vm_s sdscks_vm_t;
+
+// Structure representing the configuration of a new instance
+typedef struct {
+    uint32_t cpus;                    // Number of harts (1 to VM_MAX_CPUS)
+    vm_dispatch_mode_t dispatch_mode; // Interpreter loop
+    bool jit;                         // Compile hot blocks (falls back to the interpreter if unavailable)
+    bool fusion;                      // Fuse instruction pairs into superinstructions
+    bool verify;                      // Verify loaded programs and run them unchecked
+    bool console_raw;                 // Console copies bytes instead of formatting numbers
+    FILE *console_output;             // Where the guest's console output goes
+    int console_input_fd;             // Where the guest's console input comes from
+    const char *block_file;           // Host file backing the block device (NULL for none)
+    uint64_t page_limit;              // Most guest pages the instance may allocate (0 for no limit)
+    bool quiet;                       // Do not print load and halt messages
+} sdscks_vm_options_t;
+
+// Structure representing the counters of an instance
+typedef struct {
+    uint64_t instructions_executed; // Summed over every hart
+    uint64_t pages_touched;         // Guest pages allocated so far
+} sdscks_vm_stats_t;
+
+// Function to fill in the default options: one hart, switch dispatch, fusion on, standard
+// input and output, no block device, no page limit and no messages
+void sdscks_vm_default_options(sdscks_vm_options_t *options);
+
+// Function to create an instance (NULL options selects the defaults). Returns NULL if the
+// options are invalid or a device could not be set up.
+sdscks_vm_t *sdscks_vm_create(const sdscks_vm_options_t *options);
+
+// Function to release an instance and everything it owns (NULL is allowed)
+void sdscks_vm_destroy(sdscks_vm_t *vm);
+
+// Function to load a program image and reset every hart to its entry point
+bool sdscks_vm_load(sdscks_vm_t *vm, const char *path);
+
+// Function to replace the state of the instance with a snapshot (see snapshot.h)
+bool sdscks_vm_restore(sdscks_vm_t *vm, const char *path);
+
+// Function to save the state of the instance to a snapshot file
+bool sdscks_vm_save(sdscks_vm_t *vm, const char *path);
+
+// Function to run the harts that have not stopped, each for at most fuel instructions
+// (0: until they stop). Returns the most severe exit reason of the harts (see vm_run).
+vm_exit_reason_t sdscks_vm_run(sdscks_vm_t *vm, uint64_t fuel);
+
+// Function to execute one instruction on every hart that has not stopped
+vm_exit_reason_t sdscks_vm_step(sdscks_vm_t *vm);
+
+// Function to get the number of harts of the instance
+uint32_t sdscks_vm_cpu_count(const sdscks_vm_t *vm);
+
+// Function to get the program counter of a hart
+uint64_t sdscks_vm_program_counter(const sdscks_vm_t *vm, uint32_t hart);
+
+// Function to get a general purpose register of a hart (0 for an invalid hart or register)
+uint64_t sdscks_vm_get_register(const sdscks_vm_t *vm, uint32_t hart, uint32_t index);
+
+// Function to set a general purpose register of a stopped hart (returns false if out of range)
+bool sdscks_vm_set_register(sdscks_vm_t *vm, uint32_t hart, uint32_t index, uint64_t value);
+
+// Function to get why a hart last stopped
+vm_exit_reason_t sdscks_vm_exit_reason(const sdscks_vm_t *vm, uint32_t hart);
+
+// Function to get the fault that stopped a hart (NULL unless its exit reason is VM_EXIT_FAULT)
+const vm_fault_t *sdscks_vm_fault(const sdscks_vm_t *vm, uint32_t hart);
+
+// Function to read a 64-bit word of guest memory
+uint64_t sdscks_vm_read_word(sdscks_vm_t *vm, uint64_t address);
+
+// Function to write a 64-bit word of guest memory while the harts are stopped (returns false if
+// the page limit leaves no room for it)
+bool sdscks_vm_write_word(sdscks_vm_t *vm, uint64_t address, uint64_t value);
+
+// Function to get the counters of the instance
+void sdscks_vm_get_stats(const sdscks_vm_t *vm, sdscks_vm_stats_t *stats);
+
+#endif // SDSCKS_VM_H
\ No newline at end of file
@@ -0,0 +1,391 @@
+#include "snapshot.h"
+#include "timer_device.h"
+#include "block_device.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_HEADER_SIZE 64
+#define SNAPSHOT_SCALAR_SIZE ((NUM_REGISTERS + 3) * sizeof(uint64_t))
+#define SNAPSHOT_FP_OFFSET (SNAPSHOT_SCALAR_SIZE + NUM_VECTOR_REGISTERS * VECTOR_BYTES)
+#define SNAPSHOT_TRAP_OFFSET (SNAPSHOT_FP_OFFSET + NUM_FP_REGISTERS * sizeof(uint64_t))
+#define SNAPSHOT_TRAP_WORDS 7 // STATUS, VECTOR, EPC, CAUSE, TVAL, SCRATCH, IE
+#define SNAPSHOT_EXIT_OFFSET (SNAPSHOT_TRAP_OFFSET + SNAPSHOT_TRAP_WORDS * sizeof(uint64_t))
+#define SNAPSHOT_EXIT_WORDS 4 // Exit reason, fault cause, fault PC, fault value
+#define SNAPSHOT_HART_SIZE (SNAPSHOT_EXIT_OFFSET + SNAPSHOT_EXIT_WORDS * sizeof(uint64_t))
+#define SNAPSHOT_HART_SIZE_V1 SNAPSHOT_SCALAR_SIZE
+#define SNAPSHOT_HART_SIZE_V2 SNAPSHOT_FP_OFFSET
+#define SNAPSHOT_HART_SIZE_V3 SNAPSHOT_TRAP_OFFSET
+#define SNAPSHOT_HART_SIZE_V4 SNAPSHOT_EXIT_OFFSET
+#define SNAPSHOT_BLOCK_WORDS 4 // RING_ADDRESS, RING_SIZE, NOTIFY, COMPLETED
+
+// Bits of the flags word of a hart record
+#define SNAPSHOT_FLAG_ZERO     0x01
+#define SNAPSHOT_FLAG_NEGATIVE 0x02
+#define SNAPSHOT_FLAG_CARRY    0x04
+#define SNAPSHOT_FLAG_OVERFLOW 0x08
+#define SNAPSHOT_FLAG_HALTED   0x10
+#define SNAPSHOT_FLAG_STOPPED  0x20 // Halted or stopped by an error, not resumed after a restore
+
+// Structure collecting the pages to save
+typedef struct {
+    uint64_t *page_numbers;
+    uint64_t count;
+    uint64_t capacity;
+} snapshot_page_list_t;
+
+// Helper function to store a little-endian integer
+static void put_le(uint8_t *buffer, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+// Helper function to load a little-endian integer
+static uint64_t get_le(const uint8_t *buffer, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)buffer[i] << (i * 8);
+    }
+    return value;
+}
+
+// Helper function to get the alignment of the page data (a guest page, or a host page if larger)
+static uint64_t snapshot_data_alignment(void) {
+    long host_page = sysconf(_SC_PAGESIZE);
+    if (host_page > 0 && (uint64_t)host_page > MEMORY_PAGE_SIZE) {
+        return (uint64_t)host_page;
+    }
+    return MEMORY_PAGE_SIZE;
+}
+
+// Helper function to add every page holding a non-zero byte to the page list
+static bool snapshot_collect_page(uint64_t page_number, uint8_t *data, void *context) {
+    snapshot_page_list_t *list = (snapshot_page_list_t *)context;
+    const uint64_t *words = (const uint64_t *)(const void *)data;
+    bool zero = true;
+    for (uint64_t i = 0; i < MEMORY_PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (words[i] != 0) {
+            zero = false;
+            break;
+        }
+    }
+    if (zero) {
+        return true;
+    }
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        uint64_t *grown = (uint64_t *)realloc(list->page_numbers, list->capacity * sizeof(uint64_t));
+        if (!grown) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        list->page_numbers = grown;
+    }
+    list->page_numbers[list->count++] = page_number;
+    return true;
+}
+
+// Helper function to write a whole buffer
+static bool snapshot_write(FILE *file, const void *data, size_t size) {
+    return fwrite(data, 1, size, file) == size;
+}
+
+bool vm_save_snapshot(vm_state_t *vm, const char *path) {
+    snapshot_page_list_t pages = { NULL, 0, 0 };
+    memory_for_each_page(&vm->memory, snapshot_collect_page, &pages);
+
+    // The block device finishes its requests first: the snapshot holds their data and status, none in flight
+    block_device_state_t block_state;
+    if (vm->block) {
+        block_device_get_state(vm->block, &block_state);
+    }
+
+    uint64_t alignment = snapshot_data_alignment();
+    uint64_t device_state_size = (1 + vm->num_cpus) * sizeof(uint64_t); // The timer: TIME and every TIMECMP
+    if (vm->block) {
+        device_state_size += SNAPSHOT_BLOCK_WORDS * sizeof(uint64_t);
+    }
+    uint64_t list_offset = SNAPSHOT_HEADER_SIZE + vm->num_cpus * SNAPSHOT_HART_SIZE + device_state_size;
+    uint64_t data_offset = list_offset + pages.count * sizeof(uint64_t);
+    data_offset = (data_offset + alignment - 1) / alignment * alignment;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror("Error creating snapshot file");
+        free(pages.page_numbers);
+        return false;
+    }
+
+    uint8_t header[SNAPSHOT_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, SNAPSHOT_MAGIC, 8);
+    put_le(header + 8, SNAPSHOT_VERSION, 4);
+    put_le(header + 12, MEMORY_PAGE_SHIFT, 4);
+    put_le(header + 16, vm->num_cpus, 4);
+    put_le(header + 20, device_state_size, 4);
+    put_le(header + 24, vm->code_start, 8);
+    put_le(header + 32, vm->code_size, 8);
+    put_le(header + 40, pages.count, 8);
+    put_le(header + 48, data_offset, 8);
+    put_le(header + 56, vm->entry_point, 8);
+    bool ok = snapshot_write(file, header, sizeof(header));
+
+    for (uint32_t h = 0; ok && h < vm->num_cpus; h++) {
+        const cpu_state_t *cpu = &vm->cpus[h];
+        uint8_t record[SNAPSHOT_HART_SIZE];
+        for (int i = 0; i < NUM_REGISTERS; i++) {
+            put_le(record + i * 8, cpu->registers[i], 8);
+        }
+        uint64_t flags = (cpu->zero_flag ? SNAPSHOT_FLAG_ZERO : 0) | (cpu->negative_flag ? SNAPSHOT_FLAG_NEGATIVE : 0) |
+                         (cpu->carry_flag ? SNAPSHOT_FLAG_CARRY : 0) | (cpu->overflow_flag ? SNAPSHOT_FLAG_OVERFLOW : 0) |
+                         (cpu->halted ? SNAPSHOT_FLAG_HALTED : 0) | (cpu->running ? 0 : SNAPSHOT_FLAG_STOPPED);
+        put_le(record + NUM_REGISTERS * 8, cpu->program_counter, 8);
+        put_le(record + NUM_REGISTERS * 8 + 8, cpu->instructions_executed, 8);
+        put_le(record + NUM_REGISTERS * 8 + 16, flags, 8);
+        for (int v = 0; v < NUM_VECTOR_REGISTERS; v++) {
+            for (int lane = 0; lane < VECTOR_LANES; lane++) {
+                put_le(record + SNAPSHOT_SCALAR_SIZE + (v * VECTOR_LANES + lane) * 8, cpu->vector_registers[v].lanes[lane], 8);
+            }
+        }
+        for (int i = 0; i < NUM_FP_REGISTERS; i++) {
+            uint64_t bits;
+            memcpy(&bits, &cpu->fp_registers[i], sizeof(bits));
+            put_le(record + SNAPSHOT_FP_OFFSET + i * 8, bits, 8);
+        }
+        uint64_t trap_state[SNAPSHOT_TRAP_WORDS] = { cpu->trap_status, cpu->trap_vector, cpu->trap_epc, cpu->trap_cause,
+                                                     cpu->trap_value, cpu->trap_scratch, cpu->interrupt_enable };
+        for (int i = 0; i < SNAPSHOT_TRAP_WORDS; i++) {
+            put_le(record + SNAPSHOT_TRAP_OFFSET + i * 8, trap_state[i], 8);
+        }
+        uint64_t exit_state[SNAPSHOT_EXIT_WORDS] = { (uint64_t)cpu->exit_reason, cpu->fault.cause, cpu->fault.pc,
+                                                     cpu->fault.value };
+        for (int i = 0; i < SNAPSHOT_EXIT_WORDS; i++) {
+            put_le(record + SNAPSHOT_EXIT_OFFSET + i * 8, exit_state[i], 8);
+        }
+        ok = snapshot_write(file, record, sizeof(record));
+    }
+
+    for (uint32_t h = 0; ok && h <= vm->num_cpus; h++) {
+        uint8_t entry[8];
+        put_le(entry, h == 0 ? timer_device_time(vm->timer) : vm->timer->compare[h - 1], 8);
+        ok = snapshot_write(file, entry, sizeof(entry));
+    }
+    if (vm->block) {
+        uint64_t registers[SNAPSHOT_BLOCK_WORDS] = { block_state.ring_address, block_state.ring_size,
+                                                     block_state.submitted, block_state.completed };
+        for (int i = 0; ok && i < SNAPSHOT_BLOCK_WORDS; i++) {
+            uint8_t entry[8];
+            put_le(entry, registers[i], 8);
+            ok = snapshot_write(file, entry, sizeof(entry));
+        }
+    }
+
+    for (uint64_t i = 0; ok && i < pages.count; i++) {
+        uint8_t entry[8];
+        put_le(entry, pages.page_numbers[i], 8);
+        ok = snapshot_write(file, entry, sizeof(entry));
+    }
+    if (ok) {
+        ok = fseek(file, (long)data_offset, SEEK_SET) == 0;
+    }
+    for (uint64_t i = 0; ok && i < pages.count; i++) {
+        const uint8_t *data = memory_get_page(&vm->memory, pages.page_numbers[i] << MEMORY_PAGE_SHIFT, false);
+        ok = snapshot_write(file, data, MEMORY_PAGE_SIZE);
+    }
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write snapshot %s\n", path);
+    } else if (!vm->quiet) {
+        printf("Saved snapshot %s: %u harts, %llu pages\n", path, vm->num_cpus, (unsigned long long)pages.count);
+    }
+    free(pages.page_numbers);
+    return ok;
+}
+
+// Helper function to read exactly size bytes at offset
+static bool snapshot_read_at(int fd, void *buffer, size_t size, uint64_t offset) {
+    uint8_t *bytes = (uint8_t *)buffer;
+    while (size > 0) {
+        ssize_t count = pread(fd, bytes, size, (off_t)offset);
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= (size_t)count;
+        offset += (uint64_t)count;
+    }
+    return true;
+}
+
+bool vm_restore_snapshot(vm_state_t *vm, const char *path, bool copy_on_write) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening snapshot file");
+        return false;
+    }
+
+    uint8_t header[SNAPSHOT_HEADER_SIZE];
+    if (!snapshot_read_at(fd, header, sizeof(header), 0) || memcmp(header, SNAPSHOT_MAGIC, 8) != 0) {
+        fprintf(stderr, "Error: %s is not an SDSCKS snapshot\n", path);
+        close(fd);
+        return false;
+    }
+    uint32_t version = (uint32_t)get_le(header + 8, 4);
+    uint32_t page_shift = (uint32_t)get_le(header + 12, 4);
+    uint32_t cpu_count = (uint32_t)get_le(header + 16, 4);
+    uint64_t device_state_size = get_le(header + 20, 4);
+    uint64_t page_count = get_le(header + 40, 8);
+    uint64_t data_offset = get_le(header + 48, 8);
+    if (version < 1 || version > SNAPSHOT_VERSION || page_shift != MEMORY_PAGE_SHIFT) {
+        fprintf(stderr, "Error: Snapshot %s has version %u and page shift %u, expected at most %d and %d\n",
+                path, version, page_shift, SNAPSHOT_VERSION, MEMORY_PAGE_SHIFT);
+        close(fd);
+        return false;
+    }
+    uint64_t hart_size = version == 1 ? SNAPSHOT_HART_SIZE_V1 : version == 2 ? SNAPSHOT_HART_SIZE_V2 :
+                         version == 3 ? SNAPSHOT_HART_SIZE_V3 : version == 4 ? SNAPSHOT_HART_SIZE_V4 :
+                         SNAPSHOT_HART_SIZE;
+    uint64_t list_offset = SNAPSHOT_HEADER_SIZE + (uint64_t)cpu_count * hart_size + device_state_size;
+    // The page list and the page data must lie inside the file, which also bounds the allocations below
+    struct stat info;
+    uint64_t file_size = fstat(fd, &info) == 0 ? (uint64_t)info.st_size : 0;
+    if (list_offset > file_size || page_count > (file_size - list_offset) / sizeof(uint64_t) ||
+        data_offset > file_size || page_count > (file_size - data_offset) / MEMORY_PAGE_SIZE) {
+        fprintf(stderr, "Error: Snapshot %s is truncated or corrupt\n", path);
+        close(fd);
+        return false;
+    }
+    if (!vm_set_cpu_count(vm, cpu_count)) {
+        close(fd);
+        return false;
+    }
+
+    uint64_t *page_numbers = (uint64_t *)malloc(page_count ? page_count * sizeof(uint64_t) : 1);
+    uint8_t *list = (uint8_t *)malloc(page_count ? page_count * 8 : 1);
+    if (!page_numbers || !list) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    bool ok = snapshot_read_at(fd, list, page_count * 8, list_offset);
+    for (uint64_t i = 0; ok && i < page_count; i++) {
+        page_numbers[i] = get_le(list + i * 8, 8);
+    }
+    free(list);
+
+    for (uint32_t h = 0; ok && h < cpu_count; h++) {
+        cpu_state_t *cpu = &vm->cpus[h];
+        uint8_t record[SNAPSHOT_HART_SIZE];
+        memset(record, 0, sizeof(record)); // Registers older versions did not save read as zero
+        ok = snapshot_read_at(fd, record, hart_size, SNAPSHOT_HEADER_SIZE + h * hart_size);
+        if (!ok) {
+            break;
+        }
+        for (int i = 0; i < NUM_REGISTERS; i++) {
+            cpu->registers[i] = get_le(record + i * 8, 8);
+        }
+        cpu->program_counter = get_le(record + NUM_REGISTERS * 8, 8);
+        cpu->instructions_executed = get_le(record + NUM_REGISTERS * 8 + 8, 8);
+        uint64_t flags = get_le(record + NUM_REGISTERS * 8 + 16, 8);
+        cpu->zero_flag = (flags & SNAPSHOT_FLAG_ZERO) != 0;
+        cpu->negative_flag = (flags & SNAPSHOT_FLAG_NEGATIVE) != 0;
+        cpu->carry_flag = (flags & SNAPSHOT_FLAG_CARRY) != 0;
+        cpu->overflow_flag = (flags & SNAPSHOT_FLAG_OVERFLOW) != 0;
+        cpu->halted = (flags & SNAPSHOT_FLAG_HALTED) != 0;
+        cpu->running = (flags & SNAPSHOT_FLAG_STOPPED) == 0;
+        for (int v = 0; v < NUM_VECTOR_REGISTERS; v++) {
+            for (int lane = 0; lane < VECTOR_LANES; lane++) {
+                cpu->vector_registers[v].lanes[lane] = get_le(record + SNAPSHOT_SCALAR_SIZE + (v * VECTOR_LANES + lane) * 8, 8);
+            }
+        }
+        for (int i = 0; i < NUM_FP_REGISTERS; i++) {
+            uint64_t bits = get_le(record + SNAPSHOT_FP_OFFSET + i * 8, 8);
+            memcpy(&cpu->fp_registers[i], &bits, sizeof(bits));
+        }
+        cpu->trap_status = get_le(record + SNAPSHOT_TRAP_OFFSET, 8);
+        cpu->trap_vector = get_le(record + SNAPSHOT_TRAP_OFFSET + 8, 8);
+        cpu->trap_epc = get_le(record + SNAPSHOT_TRAP_OFFSET + 16, 8);
+        cpu->trap_cause = get_le(record + SNAPSHOT_TRAP_OFFSET + 24, 8);
+        cpu->trap_value = get_le(record + SNAPSHOT_TRAP_OFFSET + 32, 8);
+        cpu->trap_scratch = get_le(record + SNAPSHOT_TRAP_OFFSET + 40, 8);
+        cpu->interrupt_enable = get_le(record + SNAPSHOT_TRAP_OFFSET + 48, 8);
+        uint64_t exit_reason = get_le(record + SNAPSHOT_EXIT_OFFSET, 8);
+        cpu->exit_reason = exit_reason <= VM_EXIT_FAULT ? (vm_exit_reason_t)exit_reason : VM_EXIT_NONE;
+        cpu->fault.cause = get_le(record + SNAPSHOT_EXIT_OFFSET + 8, 8);
+        cpu->fault.pc = get_le(record + SNAPSHOT_EXIT_OFFSET + 16, 8);
+        cpu->fault.value = get_le(record + SNAPSHOT_EXIT_OFFSET + 24, 8);
+    }
+
+    // Timer state: TIME carries on from the saved value, older snapshots leave every deadline off
+    if (ok && version >= 4 && device_state_size >= (1 + cpu_count) * sizeof(uint64_t)) {
+        uint8_t entry[8];
+        uint64_t offset = SNAPSHOT_HEADER_SIZE + cpu_count * hart_size;
+        ok = snapshot_read_at(fd, entry, sizeof(entry), offset);
+        if (ok) {
+            timer_device_set_time(vm->timer, get_le(entry, 8));
+        }
+        for (uint32_t h = 0; ok && h < cpu_count; h++) {
+            ok = snapshot_read_at(fd, entry, sizeof(entry), offset + (1 + h) * sizeof(uint64_t));
+            if (ok) {
+                timer_device_set_compare(vm->timer, h, get_le(entry, 8));
+            }
+        }
+    }
+
+    // Block device registers follow the timer; a snapshot without them had no ring set up
+    if (ok && vm->block) {
+        uint64_t registers[SNAPSHOT_BLOCK_WORDS] = { 0, 0, 0, 0 };
+        uint64_t offset = SNAPSHOT_HEADER_SIZE + cpu_count * hart_size + (1 + cpu_count) * sizeof(uint64_t);
+        if (version >= 4 && device_state_size >= (1 + cpu_count + SNAPSHOT_BLOCK_WORDS) * sizeof(uint64_t)) {
+            for (int i = 0; ok && i < SNAPSHOT_BLOCK_WORDS; i++) {
+                uint8_t entry[8];
+                ok = snapshot_read_at(fd, entry, sizeof(entry), offset + i * sizeof(uint64_t));
+                registers[i] = get_le(entry, 8);
+            }
+        }
+        block_device_state_t block_state = { registers[0], registers[1], registers[2], registers[3] };
+        ok = ok && block_device_set_state(vm->block, &block_state);
+    }
+
+    if (ok) {
+        memory_device_t *devices = vm->memory.devices;
+        uint64_t page_limit = vm->memory.page_limit;
+        memory_free(&vm->memory);
+        memory_init(&vm->memory);
+        vm->memory.devices = devices;
+        vm->memory.page_limit = page_limit;
+        vm->code_start = get_le(header + 24, 8);
+        vm->code_size = get_le(header + 32, 8);
+        vm->entry_point = get_le(header + 56, 8);
+        vm->verified = false;
+
+        long host_page = sysconf(_SC_PAGESIZE);
+        if (copy_on_write && host_page > 0 && data_offset % (uint64_t)host_page == 0 &&
+            MEMORY_PAGE_SIZE % (uint64_t)host_page == 0) {
+            ok = memory_map_file_pages(&vm->memory, fd, data_offset, page_numbers, page_count);
+        } else {
+            // The page data cannot be mapped on this host, read it instead
+            for (uint64_t i = 0; ok && i < page_count; i++) {
+                uint8_t *page = memory_get_page(&vm->memory, page_numbers[i] << MEMORY_PAGE_SHIFT, true);
+                ok = page && snapshot_read_at(fd, page, MEMORY_PAGE_SIZE, data_offset + i * MEMORY_PAGE_SIZE);
+            }
+        }
+    }
+    free(page_numbers);
+    close(fd); // The mapping stays valid after the descriptor is closed
+
+    if (!ok) {
+        fprintf(stderr, "Error: Could not read snapshot %s\n", path);
+        return false;
+    }
+    if (!vm->quiet) {
+        printf("Restored snapshot %s: %u harts, %llu pages\n", path, cpu_count, (unsigned long long)page_count);
+    }
+    return true;
+}
\ No newline at end of file
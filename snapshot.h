@@ -0,0 +1,32 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vm.h"
+
+// Snapshot file layout (all integers little-endian):
+//   header      magic "SDSCKSNP", version, page shift, hart count, device state size,
+//               code start, code size, page count, offset of the page data, entry point
+//   harts       registers, PC, executed instruction count, flags, vector and FP registers, trap
+//               registers, exit reason and fault record of every hart
+//   devices     device state (device_state_size bytes): the timer's TIME and the TIMECMP of every hart,
+//               then RING_ADDRESS, RING_SIZE, NOTIFY and COMPLETED of the block device if one is attached
+//               (its requests are finished first; the backing file itself is not saved)
+//   page list   guest page number of every saved page
+//   page data   the saved pages back to back, starting at a page-aligned offset
+// Only pages holding a non-zero byte are saved. Because the page data is aligned,
+// a restore can map it copy-on-write instead of reading it.
+
+#define SNAPSHOT_MAGIC "SDSCKSNP"
+#define SNAPSHOT_VERSION 5 // Version 1 had no vector registers, version 2 no FP registers, version 3 no trap
+                           // state, version 4 no exit reason
+
+// Function to write the state of a VM whose harts are stopped to a snapshot file
+bool vm_save_snapshot(vm_state_t *vm, const char *path);
+
+// Function to replace the state of an initialized VM with a snapshot
+// (copy_on_write maps the saved pages instead of reading them into fresh memory)
+bool vm_restore_snapshot(vm_state_t *vm, const char *path, bool copy_on_write);
+
+#endif // SNAPSHOT_H
\ No newline at end of file
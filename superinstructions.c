@@ -0,0 +1,49 @@
+#include "superinstructions.h"
+#include "opcodes.h"
+#include <stdio.h>
+
+// Structure describing one entry of the fusion table
+typedef struct {
+    uint32_t first_opcode;
+    uint32_t second_opcode;
+    const char *name;
+} superinstruction_info_t;
+
+// The fusion table, indexed by superinstruction_t
+static const superinstruction_info_t superinstruction_table[SUPER_COUNT] = {
+    [SUPER_LI_ADD] = { OP_LI, OP_ADD, "LI+ADD" },
+    [SUPER_CMP_BEQ] = { OP_CMP, OP_BEQ, "CMP+BEQ" },
+    [SUPER_ADDI_BNE] = { OP_ADDI, OP_BNE, "ADDI+BNE" },
+    [SUPER_LOAD_ADD] = { OP_LOAD, OP_ADD, "LOAD+ADD" },
+};
+
+int find_superinstruction(uint32_t first_opcode, uint32_t second_opcode) {
+    for (int i = 0; i < SUPER_COUNT; i++) {
+        if (superinstruction_table[i].first_opcode == first_opcode &&
+            superinstruction_table[i].second_opcode == second_opcode) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *get_superinstruction_name(int superinstruction) {
+    if (superinstruction < 0 || superinstruction >= SUPER_COUNT) {
+        return "(unknown)";
+    }
+    return superinstruction_table[superinstruction].name;
+}
+
+void print_fusion_stats(const uint64_t formed[SUPER_COUNT], const uint64_t executed[SUPER_COUNT]) {
+    uint64_t total = 0;
+    for (int i = 0; i < SUPER_COUNT; i++) {
+        total += executed[i];
+    }
+    printf("\nSuperinstruction statistics:\n");
+    printf("  %-10s %12s %16s %8s\n", "Pair", "Fused slots", "Executions", "Share");
+    for (int i = 0; i < SUPER_COUNT; i++) {
+        double share = total ? 100.0 * (double)executed[i] / (double)total : 0.0;
+        printf("  %-10s %12llu %16llu %7.2f%%\n", superinstruction_table[i].name,
+               (unsigned long long)formed[i], (unsigned long long)executed[i], share);
+    }
+}
\ No newline at end of file
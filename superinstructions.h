@@ -0,0 +1,26 @@
+#ifndef SUPERINSTRUCTIONS_H
+#define SUPERINSTRUCTIONS_H
+
+#include <stdint.h>
+
+// Instruction pairs the predecoder fuses into a single dispatch of the threaded
+// interpreter. The first slot of a fused pair carries the superinstruction, the
+// second slot keeps its own dispatch so it can still be a branch target.
+typedef enum {
+    SUPER_LI_ADD,   // LI Rd, Imm      + ADD Rd, Rs1, Rs2 (constant operand setup)
+    SUPER_CMP_BEQ,  // CMP Rs1, Rs2    + BEQ Rs1, Rs2, Offset
+    SUPER_ADDI_BNE, // ADDI Rd, Rs, Imm + BNE Rs1, Rs2, Offset (loop counters)
+    SUPER_LOAD_ADD, // LOAD Rd, Addr   + ADD Rd, Rs1, Rs2 (accumulate from memory)
+    SUPER_COUNT
+} superinstruction_t;
+
+// Function to find the superinstruction fusing two opcodes (-1 if the pair is not fused)
+int find_superinstruction(uint32_t first_opcode, uint32_t second_opcode);
+
+// Function to get the name of a superinstruction (e.g. "LI+ADD")
+const char *get_superinstruction_name(int superinstruction);
+
+// Function to print how often each pair was fused by the predecoder and executed
+void print_fusion_stats(const uint64_t formed[SUPER_COUNT], const uint64_t executed[SUPER_COUNT]);
+
+#endif // SUPERINSTRUCTIONS_H
\ No newline at end of file
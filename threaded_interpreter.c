@@ -0,0 +1,450 @@
+#include "threaded_interpreter.h"
+#include "instruction_execution.h"
+#include "memory.h"
+#include "trap.h"
+
+// A block is the run of predecoded slots from the current PC to the end of its
+// page. Inside a block each handler jumps straight to the next one; only control
+// flow, stores (which may invalidate the page) and the page end go back to fetch,
+// which is also where pending interrupts are taken. Each hart runs its own loop over
+// its own predecode cache. RET skips the fetch when the return address stack of the
+// cache predicts it, resuming directly at the slot after the matching call.
+//
+// Fuel is charged once per basic block (block_length of its first slot), so the
+// handlers themselves do not count instructions. When the hart has less fuel left than
+// the next basic block needs, only the part it can pay for is run.
+
+// Helper function to get the number of slots from ip that fit into the remaining fuel. A fused
+// pair must not be split, so a cut that would fall between its two slots stops before it.
+static uint64_t threaded_charge(const predecoded_instruction_t *ip, uint64_t fuel) {
+    uint64_t length = ip->block_length;
+    if (length <= fuel) {
+        return length;
+    }
+    if (ip[fuel - 1].dispatch >= PREDECODE_FUSED) {
+        fuel--;
+    }
+    return fuel;
+}
+
+// Helper function to get the slot one past the last slot of the current block
+static predecoded_instruction_t *threaded_block_end(cpu_state_t *cpu, predecoded_instruction_t *ip) {
+    if (ip == &cpu->predecode.scratch) {
+        return ip + 1;
+    }
+    return ip + (PREDECODE_PAGE_ENTRIES - (cpu->program_counter & MEMORY_PAGE_MASK) / sizeof(uint64_t));
+}
+
+void cpu_run_threaded(cpu_state_t *cpu) {
+#if defined(__GNUC__)
+    // Filled on every entry: the labels only exist inside this function, and a table of its own
+    // needs no synchronization between the host threads of the harts
+    void *dispatch_table[PREDECODE_DISPATCH_COUNT];
+    for (size_t i = 0; i < PREDECODE_DISPATCH_COUNT; i++) {
+        dispatch_table[i] = &&op_handler;
+    }
+    dispatch_table[OP_ADD] = &&op_add;
+    dispatch_table[OP_SUB] = &&op_sub;
+    dispatch_table[OP_MUL] = &&op_mul;
+    dispatch_table[OP_DIV] = &&op_div;
+    dispatch_table[OP_AND] = &&op_and;
+    dispatch_table[OP_OR] = &&op_or;
+    dispatch_table[OP_XOR] = &&op_xor;
+    dispatch_table[OP_SLL] = &&op_sll;
+    dispatch_table[OP_SRL] = &&op_srl;
+    dispatch_table[OP_SRA] = &&op_sra;
+    dispatch_table[OP_CMP] = &&op_cmp;
+    dispatch_table[OP_ADDI] = &&op_addi;
+    dispatch_table[OP_SUBI] = &&op_subi;
+    dispatch_table[OP_ANDI] = &&op_andi;
+    dispatch_table[OP_ORI] = &&op_ori;
+    dispatch_table[OP_XORI] = &&op_xori;
+    dispatch_table[OP_LI] = &&op_li;
+    dispatch_table[OP_LOAD] = &&op_load;
+    dispatch_table[OP_STORE] = &&op_store;
+    dispatch_table[OP_JMP] = &&op_jmp;
+    dispatch_table[OP_JR] = &&op_jr;
+    dispatch_table[OP_JAL] = &&op_jal;
+    dispatch_table[OP_JALR] = &&op_jalr;
+    dispatch_table[OP_RET] = &&op_ret;
+    dispatch_table[OP_BEQ] = &&op_beq;
+    dispatch_table[OP_BNE] = &&op_bne;
+    dispatch_table[OP_HALT] = &&op_halt;
+    // Slots inside the verified code range skip the register checks
+    dispatch_table[OP_ADD + PREDECODE_VERIFIED] = &&op_add_fast;
+    dispatch_table[OP_SUB + PREDECODE_VERIFIED] = &&op_sub_fast;
+    dispatch_table[OP_MUL + PREDECODE_VERIFIED] = &&op_mul_fast;
+    dispatch_table[OP_DIV + PREDECODE_VERIFIED] = &&op_div_fast;
+    dispatch_table[OP_AND + PREDECODE_VERIFIED] = &&op_and_fast;
+    dispatch_table[OP_OR + PREDECODE_VERIFIED] = &&op_or_fast;
+    dispatch_table[OP_XOR + PREDECODE_VERIFIED] = &&op_xor_fast;
+    dispatch_table[OP_SLL + PREDECODE_VERIFIED] = &&op_sll_fast;
+    dispatch_table[OP_SRL + PREDECODE_VERIFIED] = &&op_srl_fast;
+    dispatch_table[OP_SRA + PREDECODE_VERIFIED] = &&op_sra_fast;
+    dispatch_table[OP_CMP + PREDECODE_VERIFIED] = &&op_cmp_fast;
+    dispatch_table[OP_ADDI + PREDECODE_VERIFIED] = &&op_addi_fast;
+    dispatch_table[OP_SUBI + PREDECODE_VERIFIED] = &&op_subi_fast;
+    dispatch_table[OP_ANDI + PREDECODE_VERIFIED] = &&op_andi_fast;
+    dispatch_table[OP_ORI + PREDECODE_VERIFIED] = &&op_ori_fast;
+    dispatch_table[OP_XORI + PREDECODE_VERIFIED] = &&op_xori_fast;
+    dispatch_table[OP_LI + PREDECODE_VERIFIED] = &&op_li_fast;
+    dispatch_table[OP_LOAD + PREDECODE_VERIFIED] = &&op_load_fast;
+    dispatch_table[OP_STORE + PREDECODE_VERIFIED] = &&op_store_fast;
+    dispatch_table[OP_JR + PREDECODE_VERIFIED] = &&op_jr_fast;
+    dispatch_table[OP_JALR + PREDECODE_VERIFIED] = &&op_jalr_fast;
+    dispatch_table[OP_BEQ + PREDECODE_VERIFIED] = &&op_beq_fast;
+    dispatch_table[OP_BNE + PREDECODE_VERIFIED] = &&op_bne_fast;
+    dispatch_table[OP_JMP + PREDECODE_VERIFIED] = &&op_jmp;
+    dispatch_table[OP_JAL + PREDECODE_VERIFIED] = &&op_jal;
+    dispatch_table[OP_RET + PREDECODE_VERIFIED] = &&op_ret;
+    dispatch_table[OP_HALT + PREDECODE_VERIFIED] = &&op_halt;
+    // First slots of fused pairs
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_LI_ADD] = &&super_li_add;
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_LI_ADD + 1] = &&super_li_add_fast;
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_CMP_BEQ] = &&super_cmp_beq;
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_CMP_BEQ + 1] = &&super_cmp_beq_fast;
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_ADDI_BNE] = &&super_addi_bne;
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_ADDI_BNE + 1] = &&super_addi_bne_fast;
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_LOAD_ADD] = &&super_load_add;
+    dispatch_table[PREDECODE_FUSED + 2 * SUPER_LOAD_ADD + 1] = &&super_load_add_fast;
+    reg_t *regs = cpu->registers;
+    predecoded_instruction_t *ip = NULL;
+    predecoded_instruction_t *page_end;       // End of the slots decoded for the current page
+    predecoded_instruction_t *block_end = NULL; // End of the slots already paid for
+    const decoded_instruction_t *d;
+    const decoded_instruction_t *d2; // Second instruction of a fused pair
+    predecoded_instruction_t *predicted; // Slot a RET returns to according to the return address stack
+    uint64_t target;
+    uint64_t fuel = cpu->fuel;
+    uint64_t charged;
+
+#define THREADED_DISPATCH() do { \
+        d = &ip->decoded; \
+        cpu->program_counter += sizeof(uint64_t); \
+        goto *dispatch_table[ip->dispatch]; \
+    } while (0)
+#define THREADED_NEXT() do { \
+        if (++ip < block_end) { \
+            THREADED_DISPATCH(); \
+        } \
+        goto next_block; \
+    } while (0)
+#define THREADED_CHECK(condition) do { \
+        if (!(condition)) { \
+            fault_invalid_register(cpu, d); \
+            goto leave_block; \
+        } \
+    } while (0)
+#define THREADED_CHECK_RRR() THREADED_CHECK(d->rd < NUM_REGISTERS && d->rs1 < NUM_REGISTERS && d->rs2 < NUM_REGISTERS)
+#define THREADED_CHECK_RR() THREADED_CHECK(d->rd < NUM_REGISTERS && d->rs1 < NUM_REGISTERS)
+#define THREADED_CHECK_PAIR() THREADED_CHECK(d->rd < NUM_REGISTERS && d->rs1 < NUM_REGISTERS && d->rs2 < NUM_REGISTERS && \
+        ip[1].decoded.rd < NUM_REGISTERS && ip[1].decoded.rs1 < NUM_REGISTERS && ip[1].decoded.rs2 < NUM_REGISTERS)
+#define THREADED_SKIP_SECOND() do { \
+        ip++; \
+        cpu->program_counter += sizeof(uint64_t); \
+    } while (0)
+
+    cpu->running = true;
+
+fetch:
+    if (!cpu->running) {
+        goto stop;
+    }
+    cpu_poll_interrupts(cpu);
+    ip = predecode_lookup(&cpu->predecode, cpu->memory, cpu->program_counter);
+    page_end = threaded_block_end(cpu, ip);
+charge:
+    if (fuel == 0) {
+        block_end = ip; // Nothing to refund
+        goto stop;
+    }
+    charged = threaded_charge(ip, fuel);
+    if (charged == 0) {
+        // One instruction of fuel left and it starts a fused pair: run it on its own
+        d = &ip->decoded;
+        cpu->program_counter += sizeof(uint64_t);
+        fuel--;
+        block_end = ip + 1;
+        ip->handler(cpu, d);
+        goto fetch;
+    }
+    fuel -= charged;
+    block_end = ip + charged;
+    THREADED_DISPATCH();
+next_block:
+    // Straight-line code continues on the same page without another lookup
+    if (ip < page_end) {
+        goto charge;
+    }
+    goto fetch;
+leave_block:
+    fuel += (uint64_t)(block_end - ip) - 1; // Refund the slots of the block that will not run
+    block_end = ip + 1;
+    goto fetch;
+
+op_add:
+    THREADED_CHECK_RRR();
+op_add_fast:
+    regs[d->rd] = regs[d->rs1] + regs[d->rs2];
+    THREADED_NEXT();
+op_sub:
+    THREADED_CHECK_RRR();
+op_sub_fast:
+    regs[d->rd] = regs[d->rs1] - regs[d->rs2];
+    THREADED_NEXT();
+op_mul:
+    THREADED_CHECK_RRR();
+op_mul_fast:
+    regs[d->rd] = regs[d->rs1] * regs[d->rs2];
+    THREADED_NEXT();
+op_div:
+    THREADED_CHECK_RRR();
+op_div_fast:
+    if (regs[d->rs2] == 0) {
+        cpu_fault(cpu, TRAP_CAUSE_DIVIDE_BY_ZERO, 0);
+        goto leave_block;
+    }
+    regs[d->rd] = regs[d->rs1] / regs[d->rs2];
+    THREADED_NEXT();
+op_and:
+    THREADED_CHECK_RRR();
+op_and_fast:
+    regs[d->rd] = regs[d->rs1] & regs[d->rs2];
+    THREADED_NEXT();
+op_or:
+    THREADED_CHECK_RRR();
+op_or_fast:
+    regs[d->rd] = regs[d->rs1] | regs[d->rs2];
+    THREADED_NEXT();
+op_xor:
+    THREADED_CHECK_RRR();
+op_xor_fast:
+    regs[d->rd] = regs[d->rs1] ^ regs[d->rs2];
+    THREADED_NEXT();
+op_sll:
+    THREADED_CHECK_RRR();
+op_sll_fast:
+    regs[d->rd] = regs[d->rs1] << regs[d->rs2];
+    THREADED_NEXT();
+op_srl:
+    THREADED_CHECK_RRR();
+op_srl_fast:
+    regs[d->rd] = regs[d->rs1] >> regs[d->rs2];
+    THREADED_NEXT();
+op_sra:
+    THREADED_CHECK_RRR();
+op_sra_fast:
+    regs[d->rd] = (int64_t)regs[d->rs1] >> regs[d->rs2];
+    THREADED_NEXT();
+op_cmp:
+    THREADED_CHECK(d->rs1 < NUM_REGISTERS && d->rs2 < NUM_REGISTERS);
+op_cmp_fast:
+    cpu->zero_flag = regs[d->rs1] == regs[d->rs2];
+    cpu->negative_flag = (int64_t)regs[d->rs1] < (int64_t)regs[d->rs2];
+    THREADED_NEXT();
+op_addi:
+    THREADED_CHECK_RR();
+op_addi_fast:
+    regs[d->rd] = regs[d->rs1] + d->immediate;
+    THREADED_NEXT();
+op_subi:
+    THREADED_CHECK_RR();
+op_subi_fast:
+    regs[d->rd] = regs[d->rs1] - d->immediate;
+    THREADED_NEXT();
+op_andi:
+    THREADED_CHECK_RR();
+op_andi_fast:
+    regs[d->rd] = regs[d->rs1] & d->immediate;
+    THREADED_NEXT();
+op_ori:
+    THREADED_CHECK_RR();
+op_ori_fast:
+    regs[d->rd] = regs[d->rs1] | d->immediate;
+    THREADED_NEXT();
+op_xori:
+    THREADED_CHECK_RR();
+op_xori_fast:
+    regs[d->rd] = regs[d->rs1] ^ d->immediate;
+    THREADED_NEXT();
+op_li:
+    THREADED_CHECK(d->rd < NUM_REGISTERS);
+op_li_fast:
+    regs[d->rd] = d->immediate;
+    THREADED_NEXT();
+op_load:
+    THREADED_CHECK(d->rd < NUM_REGISTERS);
+op_load_fast:
+    regs[d->rd] = memory_tlb_read_word(&cpu->tlb, cpu->memory, d->address);
+    THREADED_NEXT();
+op_store:
+    THREADED_CHECK(d->rd < NUM_REGISTERS);
+op_store_fast:
+    if (!memory_tlb_write_word(&cpu->tlb, cpu->memory, d->address, regs[d->rd])) {
+        fault_out_of_memory(cpu, d->address);
+        goto leave_block;
+    }
+    cpu_note_code_write(cpu, d->address, sizeof(reg_t));
+    goto fetch; // The store may have invalidated the current block
+op_jmp:
+    cpu->program_counter = d->address;
+    goto fetch;
+op_jr:
+    THREADED_CHECK(d->rs1 < NUM_REGISTERS);
+op_jr_fast:
+    cpu->program_counter = regs[d->rs1];
+    goto fetch;
+op_jal:
+    // Calls push the slot after them, which is still decoded when the callee returns unless
+    // its page changed in the meantime (that clears the stack)
+    regs[LINK_REGISTER] = cpu->program_counter;
+    predecode_ras_push(&cpu->predecode, cpu->program_counter, ip + 1 < page_end ? ip + 1 : NULL);
+    cpu->program_counter = d->address;
+    goto fetch;
+op_jalr:
+    THREADED_CHECK(d->rs1 < NUM_REGISTERS);
+op_jalr_fast:
+    target = regs[d->rs1];
+    regs[LINK_REGISTER] = cpu->program_counter;
+    predecode_ras_push(&cpu->predecode, cpu->program_counter, ip + 1 < page_end ? ip + 1 : NULL);
+    cpu->program_counter = target;
+    goto fetch;
+op_ret:
+    cpu->program_counter = regs[LINK_REGISTER];
+    cpu_poll_interrupts(cpu); // Taking an interrupt moves PC away from the predicted return
+    predicted = predecode_ras_pop(&cpu->predecode, cpu->program_counter);
+    if (!predicted) {
+        goto fetch;
+    }
+    // Predicted: continue in the caller's block without looking the return address up
+    ip = predicted;
+    page_end = threaded_block_end(cpu, ip);
+    goto charge;
+op_beq:
+    THREADED_CHECK(d->rs1 < NUM_REGISTERS && d->rs2 < NUM_REGISTERS);
+op_beq_fast:
+    if (regs[d->rs1] == regs[d->rs2]) {
+        cpu->program_counter += d->immediate;
+        goto fetch;
+    }
+    THREADED_NEXT();
+op_bne:
+    THREADED_CHECK(d->rs1 < NUM_REGISTERS && d->rs2 < NUM_REGISTERS);
+op_bne_fast:
+    if (regs[d->rs1] != regs[d->rs2]) {
+        cpu->program_counter += d->immediate;
+        goto fetch;
+    }
+    THREADED_NEXT();
+
+// Superinstructions: d is the first instruction of the pair, d2 the second
+super_li_add:
+    THREADED_CHECK_PAIR();
+super_li_add_fast:
+    d2 = &ip[1].decoded;
+    cpu->fusion_executed[SUPER_LI_ADD]++;
+    regs[d->rd] = d->immediate;
+    regs[d2->rd] = regs[d2->rs1] + regs[d2->rs2];
+    THREADED_SKIP_SECOND();
+    THREADED_NEXT();
+super_cmp_beq:
+    THREADED_CHECK_PAIR();
+super_cmp_beq_fast:
+    d2 = &ip[1].decoded;
+    cpu->fusion_executed[SUPER_CMP_BEQ]++;
+    cpu->zero_flag = regs[d->rs1] == regs[d->rs2];
+    cpu->negative_flag = (int64_t)regs[d->rs1] < (int64_t)regs[d->rs2];
+    THREADED_SKIP_SECOND();
+    if (regs[d2->rs1] == regs[d2->rs2]) {
+        cpu->program_counter += d2->immediate;
+        goto fetch;
+    }
+    THREADED_NEXT();
+super_addi_bne:
+    THREADED_CHECK_PAIR();
+super_addi_bne_fast:
+    d2 = &ip[1].decoded;
+    cpu->fusion_executed[SUPER_ADDI_BNE]++;
+    regs[d->rd] = regs[d->rs1] + d->immediate;
+    THREADED_SKIP_SECOND();
+    if (regs[d2->rs1] != regs[d2->rs2]) {
+        cpu->program_counter += d2->immediate;
+        goto fetch;
+    }
+    THREADED_NEXT();
+super_load_add:
+    THREADED_CHECK_PAIR();
+super_load_add_fast:
+    d2 = &ip[1].decoded;
+    cpu->fusion_executed[SUPER_LOAD_ADD]++;
+    regs[d->rd] = memory_tlb_read_word(&cpu->tlb, cpu->memory, d->address);
+    regs[d2->rd] = regs[d2->rs1] + regs[d2->rs2];
+    THREADED_SKIP_SECOND();
+    THREADED_NEXT();
+
+op_halt:
+    cpu_halt(cpu);
+    goto stop;
+op_handler:
+    // Instructions without an inline body (atomics, FENCE) run their execute_* handler
+    if (!ip->handler) {
+        goto op_unknown;
+    }
+    ip->handler(cpu, d);
+    goto fetch; // The handler may have written memory or flushed the decoded pages
+op_unknown:
+    cpu_fault(cpu, TRAP_CAUSE_ILLEGAL_INSTRUCTION, d->opcode);
+    goto fetch;
+stop:
+    if (ip < block_end) {
+        fuel += (uint64_t)(block_end - ip) - 1;
+    }
+    cpu->fuel = fuel;
+    return;
+
+#undef THREADED_SKIP_SECOND
+#undef THREADED_CHECK_PAIR
+#undef THREADED_CHECK_RR
+#undef THREADED_CHECK_RRR
+#undef THREADED_CHECK
+#undef THREADED_NEXT
+#undef THREADED_DISPATCH
+#else
+    cpu_run_call_threaded(cpu);
+#endif
+}
+
+void cpu_run_call_threaded(cpu_state_t *cpu) {
+    uint64_t fuel = cpu->fuel;
+    cpu->running = true;
+    while (cpu->running && fuel > 0) {
+        cpu_poll_interrupts(cpu);
+        predecoded_instruction_t *ip = predecode_lookup(&cpu->predecode, cpu->memory, cpu->program_counter);
+        predecoded_instruction_t *page_end = threaded_block_end(cpu, ip);
+
+        // Charge one basic block at a time while the code runs straight through the page
+        while (ip < page_end && fuel > 0) {
+            uint64_t charged = ip->block_length < fuel ? ip->block_length : fuel;
+            predecoded_instruction_t *block_end = ip + charged;
+            fuel -= charged;
+            for (; ip < block_end; ip++) {
+                uint64_t next_pc = cpu->program_counter + sizeof(uint64_t);
+                cpu->program_counter = next_pc;
+                if (!ip->handler) {
+                    cpu_fault(cpu, TRAP_CAUSE_ILLEGAL_INSTRUCTION, ip->decoded.opcode);
+                    break;
+                }
+                ip->handler(cpu, &ip->decoded);
+                // Leave the block on control flow, stores (the page may be stale now) and stops
+                if (!cpu->running || cpu->program_counter != next_pc || instruction_ends_block(ip->decoded.opcode)) {
+                    break;
+                }
+            }
+            if (ip < block_end) {
+                fuel += (uint64_t)(block_end - ip) - 1; // Refund the slots that did not run
+                break;
+            }
+        }
+    }
+    cpu->fuel = fuel;
+}
\ No newline at end of file
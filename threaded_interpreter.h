@@ -0,0 +1,13 @@
+#ifndef THREADED_INTERPRETER_H
+#define THREADED_INTERPRETER_H
+
+#include "vm.h"
+
+// Function to run a hart with direct-threaded dispatch (computed goto when the
+// compiler supports it, otherwise the call-threaded loop below)
+void cpu_run_threaded(cpu_state_t *cpu);
+
+// Function to run a hart by calling the execute_* handler stored in each predecoded slot
+void cpu_run_call_threaded(cpu_state_t *cpu);
+
+#endif // THREADED_INTERPRETER_H
\ No newline at end of file
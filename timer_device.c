@@ -0,0 +1,186 @@
+#include "timer_device.h"
+#include "trap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Helper function to read the host's monotonic clock in nanoseconds
+static uint64_t timer_host_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Helper function run by the timer thread: raises the interrupts of the harts whose deadline has
+// passed and sleeps until the next deadline or until one changes
+static void *timer_thread_main(void *arg) {
+    timer_device_t *timer = (timer_device_t *)arg;
+    pthread_mutex_lock(&timer->lock);
+    while (!timer->stop) {
+        uint64_t now = timer_device_time(timer);
+        uint64_t next = UINT64_MAX;
+        bool raised = false;
+        for (uint32_t h = 0; h < timer->vm->num_cpus; h++) {
+            if (timer->fired[h] || timer->compare[h] == UINT64_MAX) {
+                continue;
+            }
+            if (timer->compare[h] <= now) {
+                timer->fired[h] = true;
+                cpu_raise_interrupt(&timer->vm->cpus[h], IRQ_TIMER);
+                raised = true;
+            } else if (timer->compare[h] < next) {
+                next = timer->compare[h];
+            }
+        }
+        if (raised) {
+            pthread_cond_broadcast(&timer->interrupt);
+        }
+        if (next == UINT64_MAX || next > UINT64_MAX - timer->start_time) {
+            pthread_cond_wait(&timer->changed, &timer->lock);
+        } else {
+            uint64_t deadline = timer->start_time + next;
+            struct timespec until = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) };
+            pthread_cond_timedwait(&timer->changed, &timer->lock, &until);
+        }
+    }
+    pthread_mutex_unlock(&timer->lock);
+    return NULL;
+}
+
+// Helper function to start the timer thread; the caller holds the lock
+static void timer_start_thread(timer_device_t *timer) {
+    if (timer->thread_running) {
+        return;
+    }
+    timer->stop = false;
+    if (pthread_create(&timer->thread, NULL, timer_thread_main, timer) != 0) {
+        fprintf(stderr, "Error: Could not start the timer thread\n");
+        return;
+    }
+    timer->thread_running = true;
+}
+
+// Helper function called for guest loads from the device registers
+static uint64_t timer_device_read(memory_device_t *device, uint64_t offset, unsigned size) {
+    timer_device_t *timer = (timer_device_t *)device;
+    (void)size;
+    offset &= ~(uint64_t)7;
+    if (offset == TIMER_REG_TIME) {
+        return timer_device_time(timer);
+    }
+    pthread_mutex_lock(&timer->lock);
+    uint64_t value = timer->compare[(offset - TIMER_REG_TIMECMP) / 8];
+    pthread_mutex_unlock(&timer->lock);
+    return value;
+}
+
+// Helper function called for guest stores to the device registers
+static void timer_device_write(memory_device_t *device, uint64_t offset, unsigned size, uint64_t value) {
+    timer_device_t *timer = (timer_device_t *)device;
+    (void)size;
+    offset &= ~(uint64_t)7;
+    if (offset == TIMER_REG_TIME) {
+        return; // Read-only register
+    }
+    uint32_t hart_id = (uint32_t)((offset - TIMER_REG_TIMECMP) / 8);
+    if (hart_id >= timer->vm->num_cpus) {
+        return;
+    }
+    timer_device_set_compare(timer, hart_id, value);
+    if (value != UINT64_MAX) {
+        pthread_mutex_lock(&timer->lock);
+        timer_start_thread(timer); // Only started once a guest uses the timer
+        pthread_mutex_unlock(&timer->lock);
+    }
+}
+
+timer_device_t *timer_device_create(vm_state_t *vm) {
+    timer_device_t *timer = (timer_device_t *)calloc(1, sizeof(timer_device_t));
+    if (!timer) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    timer->device.start = TIMER_DEVICE_ADDRESS;
+    timer->device.size = TIMER_DEVICE_SIZE;
+    timer->device.read = timer_device_read;
+    timer->device.write = timer_device_write;
+    timer->vm = vm;
+    timer->start_time = timer_host_now();
+    for (uint32_t h = 0; h < VM_MAX_CPUS; h++) {
+        timer->compare[h] = UINT64_MAX;
+    }
+    pthread_mutex_init(&timer->lock, NULL);
+    // Deadlines are on the monotonic clock, so the thread sleeps on it too
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->changed, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_cond_init(&timer->interrupt, NULL);
+    return timer;
+}
+
+void timer_device_destroy(timer_device_t *timer) {
+    timer_device_stop(timer);
+    pthread_cond_destroy(&timer->interrupt);
+    pthread_cond_destroy(&timer->changed);
+    pthread_mutex_destroy(&timer->lock);
+    free(timer);
+}
+
+uint64_t timer_device_time(const timer_device_t *timer) {
+    return timer_host_now() - __atomic_load_n(&timer->start_time, __ATOMIC_RELAXED);
+}
+
+void timer_device_set_time(timer_device_t *timer, uint64_t time) {
+    pthread_mutex_lock(&timer->lock);
+    __atomic_store_n(&timer->start_time, timer_host_now() - time, __ATOMIC_RELAXED);
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+}
+
+void timer_device_set_compare(timer_device_t *timer, uint32_t hart_id, uint64_t deadline) {
+    pthread_mutex_lock(&timer->lock);
+    timer->compare[hart_id] = deadline;
+    timer->fired[hart_id] = false;
+    cpu_clear_interrupt(&timer->vm->cpus[hart_id], IRQ_TIMER); // The store acknowledges the interrupt
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+}
+
+void timer_device_start(timer_device_t *timer) {
+    pthread_mutex_lock(&timer->lock);
+    for (uint32_t h = 0; h < timer->vm->num_cpus; h++) {
+        if (timer->compare[h] != UINT64_MAX) {
+            timer_start_thread(timer);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&timer->lock);
+}
+
+void timer_device_stop(timer_device_t *timer) {
+    pthread_mutex_lock(&timer->lock);
+    if (!timer->thread_running) {
+        pthread_mutex_unlock(&timer->lock);
+        return;
+    }
+    timer->stop = true;
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    pthread_join(timer->thread, NULL);
+    timer->thread_running = false;
+}
+
+void timer_device_wait(timer_device_t *timer, cpu_state_t *cpu) {
+    uint64_t timer_line = (uint64_t)1 << IRQ_TIMER;
+    pthread_mutex_lock(&timer->lock);
+    while ((__atomic_load_n(&cpu->interrupt_pending, __ATOMIC_RELAXED) & cpu->interrupt_enable) == 0) {
+        if (!(cpu->interrupt_enable & timer_line) || timer->compare[cpu->hart_id] == UINT64_MAX ||
+            !timer->thread_running) {
+            break; // Nothing could wake the hart
+        }
+        pthread_cond_wait(&timer->interrupt, &timer->lock);
+    }
+    pthread_mutex_unlock(&timer->lock);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef TIMER_DEVICE_H
+#define TIMER_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "memory.h"
+#include "vm.h"
+
+// The timer device gives every hart a programmable interrupt. TIME counts nanoseconds
+// since the VM started; when it reaches the TIMECMP register of a hart, the device raises
+// IRQ_TIMER on that hart (see trap.h) and keeps it raised until TIMECMP is written again.
+// A host thread sleeps until the earliest deadline, so an idle guest does not spin: it
+// can program TIMECMP and run WFI.
+//
+// Registers (64-bit, at TIMER_DEVICE_ADDRESS + offset):
+//   TIME        load: nanoseconds since the VM started
+//   TIMECMP[h]  load/store: deadline of hart h, UINT64_MAX (the initial value) turns it
+//               off. A store acknowledges the hart's pending timer interrupt.
+
+#define TIMER_DEVICE_ADDRESS 0xFFFFD000
+#define TIMER_DEVICE_SIZE (TIMER_REG_TIMECMP + VM_MAX_CPUS * 8)
+
+// Register offsets
+#define TIMER_REG_TIME 0x00
+#define TIMER_REG_TIMECMP 0x08 // TIMECMP of hart h at TIMER_REG_TIMECMP + 8 * h
+
+// Structure representing the timer device of a VM
+typedef struct timer_device_s {
+    memory_device_t device;          // Registered in the VM's address space
+    vm_state_t *vm;                  // Machine whose harts get the interrupts
+    uint64_t start_time;             // CLOCK_MONOTONIC nanoseconds at TIME 0
+    uint64_t compare[VM_MAX_CPUS];   // TIMECMP of every hart
+    bool fired[VM_MAX_CPUS];         // IRQ_TIMER raised since TIMECMP was last written
+    pthread_mutex_t lock;
+    pthread_cond_t changed;          // Wakes the timer thread when a deadline changes
+    pthread_cond_t interrupt;        // Wakes harts waiting in WFI
+    pthread_t thread;
+    bool thread_running;
+    bool stop;
+} timer_device_t;
+
+// Function to create the timer of a VM with every deadline off
+timer_device_t *timer_device_create(vm_state_t *vm);
+
+// Function to stop the timer thread and release the device
+void timer_device_destroy(timer_device_t *timer);
+
+// Function to get the current value of TIME
+uint64_t timer_device_time(const timer_device_t *timer);
+
+// Function to set TIME (used by clones and snapshots to carry the guest's clock over)
+void timer_device_set_time(timer_device_t *timer, uint64_t time);
+
+// Function to set the TIMECMP register of a hart
+void timer_device_set_compare(timer_device_t *timer, uint32_t hart_id, uint64_t deadline);
+
+// Function to start the timer thread if a deadline is set (called when the harts start)
+void timer_device_start(timer_device_t *timer);
+
+// Function to stop the timer thread (called once every hart has stopped)
+void timer_device_stop(timer_device_t *timer);
+
+// Function to block a hart until one of its enabled interrupt lines is pending (WFI). It returns
+// at once if no enabled line can become pending.
+void timer_device_wait(timer_device_t *timer, cpu_state_t *cpu);
+
+#endif // TIMER_DEVICE_H
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "trace.h"
+#include "trap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+// Records the writer converts and writes with one fwrite
+#define TRACE_WRITE_CHUNK 4096
+
+// Time the writer sleeps when every ring is empty
+#define TRACE_WRITER_IDLE_NANOSECONDS 200000
+
+// Helper function to store a little-endian integer
+static void trace_put_le(uint8_t *buffer, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+// Helper function to write the records between the tail and head of a ring (returns the number written)
+static uint64_t trace_drain(trace_t *trace, uint32_t hart_id, trace_ring_t *ring) {
+    uint8_t *buffer = trace->buffer;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = ring->tail;
+    uint64_t drained = 0;
+    while (tail != head) {
+        uint64_t count = head - tail;
+        if (count > TRACE_WRITE_CHUNK) {
+            count = TRACE_WRITE_CHUNK;
+        }
+        trace_put_le(buffer, hart_id, 4);
+        trace_put_le(buffer + 4, count, 4);
+        for (uint64_t i = 0; i < count; i++) {
+            const trace_record_t *record = &ring->records[(tail + i) & (TRACE_RING_RECORDS - 1)];
+            uint8_t *out = buffer + TRACE_BLOCK_HEADER_SIZE + i * TRACE_RECORD_SIZE;
+            trace_put_le(out, record->pc, 8);
+            trace_put_le(out + 8, record->instruction_word, 8);
+            trace_put_le(out + 16, record->value, 8);
+        }
+        tail += count;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE); // The slots are free again
+        size_t size = TRACE_BLOCK_HEADER_SIZE + count * TRACE_RECORD_SIZE;
+        if (!trace->write_failed && fwrite(buffer, 1, size, trace->file) != size) {
+            trace->write_failed = true;
+        }
+        drained += count;
+    }
+    trace->records_written += drained;
+    return drained;
+}
+
+// Helper function run by the writer thread
+static void *trace_writer_main(void *arg) {
+    trace_t *trace = (trace_t *)arg;
+    for (;;) {
+        // Read the stop flag first: once it is set, an empty pass means every record is written
+        bool stopping = __atomic_load_n(&trace->stop, __ATOMIC_ACQUIRE);
+        uint64_t drained = 0;
+        for (uint32_t h = 0; h < VM_MAX_CPUS; h++) {
+            trace_ring_t *ring = __atomic_load_n(&trace->rings[h], __ATOMIC_ACQUIRE);
+            if (ring) {
+                drained += trace_drain(trace, h, ring);
+            }
+        }
+        if (drained == 0) {
+            if (stopping) {
+                break;
+            }
+            struct timespec idle = { 0, TRACE_WRITER_IDLE_NANOSECONDS };
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+trace_t *trace_open(const char *path) {
+    trace_t *trace = (trace_t *)calloc(1, sizeof(trace_t));
+    if (!trace) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    trace->buffer = (uint8_t *)malloc(TRACE_BLOCK_HEADER_SIZE + TRACE_WRITE_CHUNK * TRACE_RECORD_SIZE);
+    if (!trace->buffer) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    trace->file = fopen(path, "wb");
+    if (!trace->file) {
+        perror("Error opening trace file");
+        free(trace->buffer);
+        free(trace);
+        return NULL;
+    }
+    uint8_t header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, 8);
+    trace_put_le(header + 8, TRACE_VERSION, 4);
+    trace_put_le(header + 12, TRACE_RECORD_SIZE, 4);
+    if (fwrite(header, sizeof(header), 1, trace->file) != 1) {
+        perror("Error writing trace file");
+        fclose(trace->file);
+        free(trace->buffer);
+        free(trace);
+        return NULL;
+    }
+    if (pthread_create(&trace->writer, NULL, trace_writer_main, trace) != 0) {
+        fprintf(stderr, "Error: Could not start the trace writer thread\n");
+        fclose(trace->file);
+        free(trace->buffer);
+        free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+trace_ring_t *trace_get_ring(trace_t *trace, uint32_t hart_id) {
+    if (!trace->rings[hart_id]) {
+        void *ring = NULL;
+        if (posix_memalign(&ring, 64, sizeof(trace_ring_t)) != 0) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        memset(ring, 0, sizeof(trace_ring_t));
+        __atomic_store_n(&trace->rings[hart_id], (trace_ring_t *)ring, __ATOMIC_RELEASE);
+    }
+    return trace->rings[hart_id];
+}
+
+bool trace_close(trace_t *trace, uint64_t *records_written) {
+    __atomic_store_n(&trace->stop, true, __ATOMIC_RELEASE);
+    pthread_join(trace->writer, NULL);
+    bool ok = !trace->write_failed;
+    ok = fclose(trace->file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write the complete trace\n");
+    }
+    if (records_written) {
+        *records_written = trace->records_written;
+    }
+    for (uint32_t h = 0; h < VM_MAX_CPUS; h++) {
+        free(trace->rings[h]);
+    }
+    free(trace->buffer);
+    free(trace);
+    return ok;
+}
+
+void trace_ring_wait(trace_ring_t *ring) {
+    do {
+        sched_yield(); // Lets the writer run when it shares the core
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    } while (ring->head - ring->cached_tail >= TRACE_RING_RECORDS);
+}
+
+// Helper function to read the register an instruction wrote (see trace_file_format.h)
+static uint64_t trace_destination_value(const cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    uint64_t bits;
+    switch (decoded->opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_AND: case OP_OR: case OP_XOR:
+        case OP_SLL: case OP_SRL: case OP_SRA:
+        case OP_ADDI: case OP_SUBI: case OP_ANDI: case OP_ORI: case OP_XORI: case OP_LI:
+        case OP_LOAD: case OP_LB: case OP_LH: case OP_LW: case OP_LD:
+        case OP_LR: case OP_SC: case OP_CAS:
+        case OP_CSRR:
+        case OP_JAL: case OP_JALR:
+        case OP_VREDSUM:
+        case OP_FEQ: case OP_FLT: case OP_FLE: case OP_FCVTLD: case OP_FMVXD:
+            return cpu->registers[decoded->rd];
+        case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV: case OP_FSQRT: case OP_FMADD:
+        case OP_FCVTDL: case OP_FMVDX: case OP_FLD:
+            memcpy(&bits, &cpu->fp_registers[decoded->rd], sizeof(bits));
+            return bits;
+        case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR: case OP_VXOR:
+        case OP_VSLL: case OP_VSRL: case OP_VSRA: case OP_VCMPEQ: case OP_VCMPLT:
+        case OP_VLOAD: case OP_VSPLAT:
+            return cpu->vector_registers[decoded->rd].lanes[0];
+        default:
+            return 0;
+    }
+}
+
+void cpu_run_traced(cpu_state_t *cpu) {
+    trace_ring_t *ring = cpu->trace_ring;
+    uint64_t fuel = cpu->fuel;
+    cpu->running = true;
+    while (cpu->running && fuel > 0) {
+        cpu_poll_interrupts(cpu);
+        uint64_t pc = cpu->program_counter;
+        uint64_t instruction_word = memory_tlb_read_word(&cpu->tlb, cpu->memory, pc);
+        const decoded_instruction_t *decoded = &predecode_lookup(&cpu->predecode, cpu->memory, pc)->decoded;
+        cpu->program_counter = pc + sizeof(uint64_t);
+        cpu_execute_decoded(cpu, decoded);
+        fuel--;
+        trace_ring_push(ring, pc, instruction_word, trace_destination_value(cpu, decoded));
+    }
+    cpu->fuel = fuel;
+}
\ No newline at end of file
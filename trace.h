@@ -0,0 +1,80 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "vm.h"
+#include "trace_file_format.h"
+
+// Execution tracing (--trace) records every retired instruction of every hart into a
+// per-hart single-producer ring buffer. A background writer thread drains the rings
+// into the trace file, so the hart only pays for filling one record per instruction.
+// When a ring is full the hart waits for the writer rather than dropping records.
+// The file layout is described in trace_file_format.h.
+
+// Records per ring (power of two)
+#define TRACE_RING_RECORDS 65536
+
+// Structure representing one traced instruction
+typedef struct {
+    uint64_t pc;
+    uint64_t instruction_word;
+    uint64_t value;
+} trace_record_t;
+
+// Structure representing the ring buffer of one hart. The hart only advances head and
+// the writer only advances tail; the padding keeps the two on separate cache lines.
+typedef struct trace_ring_s {
+    trace_record_t records[TRACE_RING_RECORDS];
+    uint64_t head;        // Records pushed by the hart
+    uint64_t cached_tail; // The hart's last view of tail, so it rarely reads the writer's line
+    uint8_t padding[48];
+    uint64_t tail;        // Records written to the file
+} trace_ring_t;
+
+// Structure representing an open trace file and its writer thread
+typedef struct trace_s {
+    FILE *file;
+    pthread_t writer;
+    bool stop;                         // Set by trace_close, the writer drains the rings and exits
+    bool write_failed;
+    uint8_t *buffer;                   // Records being converted by the writer
+    trace_ring_t *rings[VM_MAX_CPUS];  // Ring of each hart id, NULL until the hart is created
+    uint64_t records_written;
+} trace_t;
+
+// Function to create a trace file and start its writer thread (NULL on failure)
+trace_t *trace_open(const char *path);
+
+// Function to get the ring of a hart, creating it on first use (call before the hart runs)
+trace_ring_t *trace_get_ring(trace_t *trace, uint32_t hart_id);
+
+// Function to write the remaining records, stop the writer and close the file once all
+// harts have stopped. Returns false if the file could not be written completely.
+bool trace_close(trace_t *trace, uint64_t *records_written);
+
+// Function to run a hart with the switch loop, recording every instruction into cpu->trace_ring
+void cpu_run_traced(cpu_state_t *cpu);
+
+// Helper function to wait until the writer has made room in a full ring
+void trace_ring_wait(trace_ring_t *ring);
+
+// Helper function to append a record to a hart's ring
+static inline void trace_ring_push(trace_ring_t *ring, uint64_t pc, uint64_t instruction_word, uint64_t value) {
+    uint64_t head = ring->head;
+    if (head - ring->cached_tail >= TRACE_RING_RECORDS) {
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head - ring->cached_tail >= TRACE_RING_RECORDS) {
+            trace_ring_wait(ring);
+        }
+    }
+    trace_record_t *record = &ring->records[head & (TRACE_RING_RECORDS - 1)];
+    record->pc = pc;
+    record->instruction_word = instruction_word;
+    record->value = value;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE); // Publishes the record to the writer
+}
+
+#endif // TRACE_H
\ No newline at end of file
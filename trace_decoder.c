@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "instruction_set.h"
+#include "instruction_decoder.h"
+#include "opcodes.h"
+#include "trace_file_format.h"
+
+// Trace decoder: prints the records of a trace file written by the VM's --trace option
+// as one disassembled instruction per line.
+// Build: cc -o trace_decoder trace_decoder.c instruction_decoder.c
+
+// Helper function to read a little-endian integer
+static uint64_t get_le(const uint8_t *buffer, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)buffer[i] << (i * 8);
+    }
+    return value;
+}
+
+// Helper function to format the operands of a decoded instruction in assembler syntax
+static void format_operands(const decoded_instruction_t *d, char *buffer, size_t size) {
+    long long imm = (long long)d->immediate;
+    switch (d->opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_AND: case OP_OR: case OP_XOR:
+        case OP_SLL: case OP_SRL: case OP_SRA: case OP_MEMCPY: case OP_MEMSET:
+            snprintf(buffer, size, "R%u, R%u, R%u", d->rd, d->rs1, d->rs2);
+            break;
+        case OP_CMP:
+            snprintf(buffer, size, "R%u, R%u", d->rs1, d->rs2);
+            break;
+        case OP_ADDI: case OP_SUBI: case OP_ANDI: case OP_ORI: case OP_XORI:
+            snprintf(buffer, size, "R%u, R%u, %lld", d->rd, d->rs1, imm);
+            break;
+        case OP_LI:
+            snprintf(buffer, size, "R%u, %lld", d->rd, imm);
+            break;
+        case OP_LOAD: case OP_STORE:
+            snprintf(buffer, size, "R%u, 0x%llX", d->rd, (unsigned long long)d->address);
+            break;
+        case OP_LB: case OP_LH: case OP_LW: case OP_LD: case OP_SB: case OP_SH: case OP_SW: case OP_SD:
+            snprintf(buffer, size, "R%u, %lld(R%u)", d->rd, imm, d->rs1);
+            break;
+        case OP_JMP: case OP_JAL:
+            snprintf(buffer, size, "0x%llX", (unsigned long long)d->address);
+            break;
+        case OP_JR: case OP_JALR:
+            snprintf(buffer, size, "R%u", d->rs1);
+            break;
+        case OP_BEQ: case OP_BNE:
+            snprintf(buffer, size, "R%u, R%u, %+lld", d->rs1, d->rs2, imm);
+            break;
+        case OP_LR:
+            snprintf(buffer, size, "R%u, (R%u)", d->rd, d->rs1);
+            break;
+        case OP_SC: case OP_CAS:
+            snprintf(buffer, size, "R%u, (R%u), R%u", d->rd, d->rs1, d->rs2);
+            break;
+        case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR: case OP_VXOR:
+        case OP_VSLL: case OP_VSRL: case OP_VSRA: case OP_VCMPEQ: case OP_VCMPLT:
+            snprintf(buffer, size, "V%u, V%u, V%u", d->rd, d->rs1, d->rs2);
+            break;
+        case OP_VLOAD: case OP_VSTORE:
+            snprintf(buffer, size, "V%u, %lld(R%u)", d->rd, imm, d->rs1);
+            break;
+        case OP_VREDSUM:
+            snprintf(buffer, size, "R%u, V%u", d->rd, d->rs1);
+            break;
+        case OP_VSPLAT:
+            snprintf(buffer, size, "V%u, R%u", d->rd, d->rs1);
+            break;
+        case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV:
+            snprintf(buffer, size, "F%u, F%u, F%u", d->rd, d->rs1, d->rs2);
+            break;
+        case OP_FSQRT:
+            snprintf(buffer, size, "F%u, F%u", d->rd, d->rs1);
+            break;
+        case OP_FMADD:
+            snprintf(buffer, size, "F%u, F%u, F%u, F%u", d->rd, d->rs1, d->rs2, d->rs3);
+            break;
+        case OP_FEQ: case OP_FLT: case OP_FLE:
+            snprintf(buffer, size, "R%u, F%u, F%u", d->rd, d->rs1, d->rs2);
+            break;
+        case OP_FCVTDL: case OP_FMVDX:
+            snprintf(buffer, size, "F%u, R%u", d->rd, d->rs1);
+            break;
+        case OP_FCVTLD: case OP_FMVXD:
+            snprintf(buffer, size, "R%u, F%u", d->rd, d->rs1);
+            break;
+        case OP_FLD: case OP_FSD:
+            snprintf(buffer, size, "F%u, %lld(R%u)", d->rd, imm, d->rs1);
+            break;
+        case OP_CSRR:
+            snprintf(buffer, size, "R%u, %lld", d->rd, imm);
+            break;
+        case OP_CSRW:
+            snprintf(buffer, size, "%lld, R%u", imm, d->rs1);
+            break;
+        default:
+            buffer[0] = '\0';
+            break;
+    }
+}
+
+// Helper function to check whether a vector instruction uses 32-bit lanes
+static bool is_narrow_vector(uint64_t instruction_word, uint32_t opcode) {
+    return opcode >= OP_VADD && opcode <= OP_VSPLAT && opcode != OP_VLOAD && opcode != OP_VSTORE &&
+           ((instruction_word >> VECTOR_NARROW_BIT) & 1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    long hart_filter = -1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--hart=", strlen("--hart=")) == 0) {
+            char *end;
+            hart_filter = strtol(argv[i] + strlen("--hart="), &end, 10);
+            if (*end != '\0' || hart_filter < 0) {
+                fprintf(stderr, "Error: --hart expects a hart id\n");
+                return 1;
+            }
+        } else if (argv[i][0] == '-' || path) {
+            path = NULL;
+            break;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s [--hart=N] <trace_file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror("Error opening trace file");
+        return 1;
+    }
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, file) != 1 || memcmp(header, TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "Error: %s is not an SDSCKS trace file\n", path);
+        fclose(file);
+        return 1;
+    }
+    uint32_t version = (uint32_t)get_le(header + 8, 4);
+    uint32_t record_size = (uint32_t)get_le(header + 12, 4);
+    if (version != TRACE_VERSION || record_size != TRACE_RECORD_SIZE) {
+        fprintf(stderr, "Error: %s has trace version %u and record size %u, expected %d and %d\n",
+                path, version, record_size, TRACE_VERSION, TRACE_RECORD_SIZE);
+        fclose(file);
+        return 1;
+    }
+
+    uint64_t records = 0;
+    uint8_t block[TRACE_BLOCK_HEADER_SIZE];
+    uint8_t record[TRACE_RECORD_SIZE];
+    char operands[64];
+    bool truncated = false;
+    while (fread(block, sizeof(block), 1, file) == 1) {
+        uint32_t hart_id = (uint32_t)get_le(block, 4);
+        uint32_t count = (uint32_t)get_le(block + 4, 4);
+        for (uint32_t i = 0; i < count; i++) {
+            if (fread(record, sizeof(record), 1, file) != 1) {
+                truncated = true;
+                break;
+            }
+            if (hart_filter >= 0 && hart_id != (uint32_t)hart_filter) {
+                continue;
+            }
+            uint64_t pc = get_le(record, 8);
+            uint64_t instruction_word = get_le(record + 8, 8);
+            uint64_t value = get_le(record + 16, 8);
+            decoded_instruction_t decoded = decode_instruction(instruction_word);
+            format_operands(&decoded, operands, sizeof(operands));
+            char mnemonic[16];
+            snprintf(mnemonic, sizeof(mnemonic), "%s%s", get_opcode_mnemonic(decoded.opcode),
+                     is_narrow_vector(instruction_word, decoded.opcode) ? ".W" : "");
+            printf("%3u  %016llX  %016llX  %-8s %-24s -> 0x%llX\n", hart_id, (unsigned long long)pc,
+                   (unsigned long long)instruction_word, mnemonic, operands, (unsigned long long)value);
+            records++;
+        }
+        if (truncated) {
+            break;
+        }
+    }
+    fclose(file);
+    if (truncated) {
+        fprintf(stderr, "Warning: %s ends in the middle of a block\n", path);
+    }
+    fprintf(stderr, "%llu records\n", (unsigned long long)records);
+    return 0;
+}
\ No newline at end of file
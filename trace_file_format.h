@@ -0,0 +1,26 @@
+#ifndef TRACE_FILE_FORMAT_H
+#define TRACE_FILE_FORMAT_H
+
+#include <stdint.h>
+
+// Trace file layout (all integers little-endian):
+//   header   magic "SDSTRACE", version (4 bytes), record size (4 bytes)
+//   blocks   hart id (4 bytes), record count (4 bytes), then that many records
+//   record   PC, instruction word, value of the destination register after the instruction
+// Records of one hart appear in execution order; blocks of different harts interleave.
+// The destination is the integer register Rd, the FP register Fd (its bits) or lane 0 of
+// the vector register Vd, depending on the instruction; the value is 0 for instructions
+// that write no register (stores, branches, FENCE, HALT).
+
+// Magic bytes at the start of a trace file
+#define TRACE_MAGIC "SDSTRACE"
+
+// Version of the trace file format
+#define TRACE_VERSION 1
+
+// Sizes of the parts of a trace file on disk
+#define TRACE_HEADER_SIZE 16
+#define TRACE_BLOCK_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 24
+
+#endif // TRACE_FILE_FORMAT_H
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "trap.h"
+#include "vm.h"
+
+// Helper function to enter the trap handler with the given cause, resuming at epc afterwards
+static void cpu_enter_trap(cpu_state_t *cpu, uint64_t cause, uint64_t value, uint64_t epc) {
+    cpu->trap_epc = epc;
+    cpu->trap_cause = cause;
+    cpu->trap_value = value;
+    uint64_t status = cpu->trap_status & ~(uint64_t)(TRAP_STATUS_IE | TRAP_STATUS_PIE);
+    if (cpu->trap_status & TRAP_STATUS_IE) {
+        status |= TRAP_STATUS_PIE;
+    }
+    cpu->trap_status = status | TRAP_STATUS_HANDLER;
+    cpu->reservation_valid = false;
+    cpu->program_counter = cpu->trap_vector;
+}
+
+// Helper function to stop the hart with a fault for the host to inspect
+static void cpu_stop_fault(cpu_state_t *cpu, uint64_t cause, uint64_t value, uint64_t pc) {
+    cpu->fault.cause = cause;
+    cpu->fault.pc = pc;
+    cpu->fault.value = value;
+    cpu->running = false;
+}
+
+bool cpu_trap(cpu_state_t *cpu, uint64_t cause, uint64_t value) {
+    // A fault inside the handler does not trap again: that would lose EPC and likely loop forever
+    if (cpu->trap_vector == 0 || (cpu->trap_status & TRAP_STATUS_HANDLER)) {
+        return false;
+    }
+    cpu_enter_trap(cpu, cause, value, cpu->program_counter - sizeof(uint64_t));
+    return true;
+}
+
+void cpu_fault(cpu_state_t *cpu, uint64_t cause, uint64_t value) {
+    if (!cpu_trap(cpu, cause, value)) {
+        cpu_stop_fault(cpu, cause, value, cpu->program_counter - sizeof(uint64_t));
+    }
+}
+
+const char *trap_cause_name(uint64_t cause) {
+    if (cause & TRAP_CAUSE_INTERRUPT) {
+        return "interrupt";
+    }
+    switch (cause) {
+        case TRAP_CAUSE_ILLEGAL_INSTRUCTION:
+            return "illegal instruction";
+        case TRAP_CAUSE_DIVIDE_BY_ZERO:
+            return "division by zero";
+        case TRAP_CAUSE_MISALIGNED:
+            return "misaligned access";
+        case TRAP_CAUSE_ACCESS_FAULT:
+            return "access fault";
+        case TRAP_CAUSE_ECALL:
+            return "environment call";
+        default:
+            return "unknown";
+    }
+}
+
+void cpu_check_interrupts(cpu_state_t *cpu) {
+    // Clear the hint before reading the lines: a line raised after the read sets it again
+    __atomic_store_n(&cpu->interrupt_signal, 0, __ATOMIC_SEQ_CST);
+    uint64_t deliverable = __atomic_load_n(&cpu->interrupt_pending, __ATOMIC_SEQ_CST) & cpu->interrupt_enable;
+    if (deliverable == 0 || !(cpu->trap_status & TRAP_STATUS_IE) || cpu->trap_vector == 0 || !cpu->running) {
+        return;
+    }
+    uint32_t line = (uint32_t)__builtin_ctzll(deliverable); // The lowest line has the highest priority
+    cpu_enter_trap(cpu, TRAP_CAUSE_INTERRUPT | line, 0, cpu->program_counter);
+}
+
+void cpu_raise_interrupt(cpu_state_t *cpu, uint32_t line) {
+    __atomic_or_fetch(&cpu->interrupt_pending, (uint64_t)1 << line, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&cpu->interrupt_signal, 1, __ATOMIC_SEQ_CST);
+}
+
+void cpu_clear_interrupt(cpu_state_t *cpu, uint32_t line) {
+    __atomic_and_fetch(&cpu->interrupt_pending, ~((uint64_t)1 << line), __ATOMIC_SEQ_CST);
+}
+
+void cpu_reset_traps(cpu_state_t *cpu) {
+    cpu->trap_status = 0;
+    cpu->trap_vector = 0;
+    cpu->trap_epc = 0;
+    cpu->trap_cause = 0;
+    cpu->trap_value = 0;
+    cpu->trap_scratch = 0;
+    cpu->interrupt_enable = 0;
+    __atomic_store_n(&cpu->interrupt_pending, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cpu->interrupt_signal, 0, __ATOMIC_RELAXED);
+}
\ No newline at end of file
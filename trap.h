@@ -0,0 +1,76 @@
+#ifndef TRAP_H
+#define TRAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu_state.h"
+
+// Traps and interrupts. A hart traps by saving the address to resume at in EPC, the
+// cause in CAUSE and the faulting address or opcode in TVAL, turning interrupts off
+// and jumping to VECTOR. ERET returns to EPC and restores the interrupt enable bit.
+// The control and status registers are listed in opcodes.h.
+//
+// Faults (division by zero, unknown opcodes, misaligned atomics, ...) trap only once the
+// guest has written VECTOR, and never from inside the handler. Otherwise a fault stops only
+// the faulting hart: cpu_run returns VM_EXIT_FAULT with the cause, PC and TVAL in
+// cpu->fault, and the host process and the other guests it runs carry on.
+// Interrupts are level-triggered: a device sets its line in IP and keeps it set until
+// the guest acknowledges it at the device. A pending line is taken when it is enabled in
+// IE and STATUS.IE is set, at the next block boundary of the interpreter loop or at the
+// entry of a compiled block, so straight-line code pays nothing for them.
+
+// Bits of CSR_STATUS
+#define TRAP_STATUS_IE      0x1 // Interrupts enabled
+#define TRAP_STATUS_PIE     0x2 // IE before the last trap, restored by ERET
+#define TRAP_STATUS_HANDLER 0x4 // Inside a trap handler (a fault there stops the hart)
+#define TRAP_STATUS_WRITABLE (TRAP_STATUS_IE | TRAP_STATUS_PIE)
+
+// Causes; interrupts set the top bit and the line number
+#define TRAP_CAUSE_INTERRUPT ((uint64_t)1 << 63)
+#define TRAP_CAUSE_ILLEGAL_INSTRUCTION 1 // TVAL holds the opcode
+#define TRAP_CAUSE_DIVIDE_BY_ZERO 2
+#define TRAP_CAUSE_MISALIGNED 3          // TVAL holds the address
+#define TRAP_CAUSE_ACCESS_FAULT 4        // TVAL holds the address
+#define TRAP_CAUSE_ECALL 8
+
+// Interrupt lines
+#define IRQ_TIMER 0 // Raised by the timer device (see timer_device.h)
+
+// Function to trap at the instruction that was just fetched (PC has already moved past it).
+// Returns false, leaving the hart untouched, if the guest has not installed a trap handler or
+// the instruction is inside the handler.
+bool cpu_trap(cpu_state_t *cpu, uint64_t cause, uint64_t value);
+
+// Function to raise a fault at the instruction that was just fetched. It goes to the guest's
+// trap handler if there is one; otherwise the hart stops with the fault recorded in cpu->fault,
+// where the host reads what went wrong (the VM itself prints nothing).
+void cpu_fault(cpu_state_t *cpu, uint64_t cause, uint64_t value);
+
+// Function to get a printable name of a trap cause
+const char *trap_cause_name(uint64_t cause);
+
+// Function to take the highest priority pending interrupt if the hart accepts it
+void cpu_check_interrupts(cpu_state_t *cpu);
+
+// Function to set an interrupt line of a hart (callable from any thread)
+void cpu_raise_interrupt(cpu_state_t *cpu, uint32_t line);
+
+// Function to clear an interrupt line of a hart (callable from any thread)
+void cpu_clear_interrupt(cpu_state_t *cpu, uint32_t line);
+
+// Function to clear the trap state of a hart (interrupts off, no handler)
+void cpu_reset_traps(cpu_state_t *cpu);
+
+// Helper function to have the hart check its interrupts at the next block boundary
+static inline void cpu_request_interrupt_check(cpu_state_t *cpu) {
+    __atomic_store_n(&cpu->interrupt_signal, 1, __ATOMIC_RELAXED);
+}
+
+// Helper function run at block boundaries: one load unless an interrupt may have become deliverable
+static inline void cpu_poll_interrupts(cpu_state_t *cpu) {
+    if (__builtin_expect(__atomic_load_n(&cpu->interrupt_signal, __ATOMIC_RELAXED) != 0, 0)) {
+        cpu_check_interrupts(cpu);
+    }
+}
+
+#endif // TRAP_H
\ No newline at end of file
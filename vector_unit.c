@@ -0,0 +1,190 @@
+#include "vector_unit.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VECTOR_UNIT_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VECTOR_UNIT_SSE2 1
+#endif
+
+#define LANES32 (VECTOR_LANES * 2)
+
+// Helper function to read lane i of the 32-bit view of a register
+static inline uint32_t vector_lane32(const vector_reg_t *reg, int i) {
+    return (uint32_t)(reg->lanes[i / 2] >> ((i % 2) * 32));
+}
+
+// Helper function to write lane i of the 32-bit view of a register
+static inline void vector_set_lane32(vector_reg_t *reg, int i, uint32_t value) {
+    unsigned shift = (unsigned)(i % 2) * 32;
+    reg->lanes[i / 2] = (reg->lanes[i / 2] & ~((uint64_t)0xFFFFFFFF << shift)) | ((uint64_t)value << shift);
+}
+
+// Helper function to apply an operation to one 64-bit lane
+static uint64_t vector_op64(vector_op_t op, uint64_t a, uint64_t b) {
+    switch (op) {
+        case VECTOR_ADD: return a + b;
+        case VECTOR_SUB: return a - b;
+        case VECTOR_MUL: return a * b;
+        case VECTOR_AND: return a & b;
+        case VECTOR_OR: return a | b;
+        case VECTOR_XOR: return a ^ b;
+        case VECTOR_SLL: return a << (b & 63);
+        case VECTOR_SRL: return a >> (b & 63);
+        case VECTOR_SRA: return (uint64_t)((int64_t)a >> (b & 63));
+        case VECTOR_CMPEQ: return a == b ? UINT64_MAX : 0;
+        case VECTOR_CMPLT: return (int64_t)a < (int64_t)b ? UINT64_MAX : 0;
+    }
+    return 0;
+}
+
+// Helper function to apply an operation to one 32-bit lane
+static uint32_t vector_op32(vector_op_t op, uint32_t a, uint32_t b) {
+    switch (op) {
+        case VECTOR_ADD: return a + b;
+        case VECTOR_SUB: return a - b;
+        case VECTOR_MUL: return a * b;
+        case VECTOR_AND: return a & b;
+        case VECTOR_OR: return a | b;
+        case VECTOR_XOR: return a ^ b;
+        case VECTOR_SLL: return a << (b & 31);
+        case VECTOR_SRL: return a >> (b & 31);
+        case VECTOR_SRA: return (uint32_t)((int32_t)a >> (b & 31));
+        case VECTOR_CMPEQ: return a == b ? UINT32_MAX : 0;
+        case VECTOR_CMPLT: return (int32_t)a < (int32_t)b ? UINT32_MAX : 0;
+    }
+    return 0;
+}
+
+// Helper function to apply a lane-wise operation in plain C
+static void vector_execute_scalar(vector_op_t op, bool narrow, vector_reg_t *destination, const vector_reg_t *a, const vector_reg_t *b) {
+    vector_reg_t result; // The destination may also be an operand
+    if (narrow) {
+        for (int i = 0; i < LANES32; i++) {
+            vector_set_lane32(&result, i, vector_op32(op, vector_lane32(a, i), vector_lane32(b, i)));
+        }
+    } else {
+        for (int i = 0; i < VECTOR_LANES; i++) {
+            result.lanes[i] = vector_op64(op, a->lanes[i], b->lanes[i]);
+        }
+    }
+    *destination = result;
+}
+
+#if VECTOR_UNIT_AVX2
+// Helper function to apply a lane-wise operation with AVX2 (returns false if AVX2 has no instruction for it)
+static bool vector_execute_host(vector_op_t op, bool narrow, vector_reg_t *destination, const vector_reg_t *a, const vector_reg_t *b) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(const void *)a->lanes);
+    __m256i y = _mm256_loadu_si256((const __m256i *)(const void *)b->lanes);
+    __m256i count = narrow ? _mm256_and_si256(y, _mm256_set1_epi32(31)) : _mm256_and_si256(y, _mm256_set1_epi64x(63));
+    __m256i result;
+    switch (op) {
+        case VECTOR_ADD: result = narrow ? _mm256_add_epi32(x, y) : _mm256_add_epi64(x, y); break;
+        case VECTOR_SUB: result = narrow ? _mm256_sub_epi32(x, y) : _mm256_sub_epi64(x, y); break;
+        case VECTOR_MUL:
+            if (!narrow) {
+                return false; // No 64-bit multiply before AVX-512
+            }
+            result = _mm256_mullo_epi32(x, y);
+            break;
+        case VECTOR_AND: result = _mm256_and_si256(x, y); break;
+        case VECTOR_OR: result = _mm256_or_si256(x, y); break;
+        case VECTOR_XOR: result = _mm256_xor_si256(x, y); break;
+        case VECTOR_SLL: result = narrow ? _mm256_sllv_epi32(x, count) : _mm256_sllv_epi64(x, count); break;
+        case VECTOR_SRL: result = narrow ? _mm256_srlv_epi32(x, count) : _mm256_srlv_epi64(x, count); break;
+        case VECTOR_SRA:
+            if (!narrow) {
+                return false; // No 64-bit arithmetic shift before AVX-512
+            }
+            result = _mm256_srav_epi32(x, count);
+            break;
+        case VECTOR_CMPEQ: result = narrow ? _mm256_cmpeq_epi32(x, y) : _mm256_cmpeq_epi64(x, y); break;
+        case VECTOR_CMPLT: result = narrow ? _mm256_cmpgt_epi32(y, x) : _mm256_cmpgt_epi64(y, x); break;
+        default: return false;
+    }
+    _mm256_storeu_si256((__m256i *)(void *)destination->lanes, result);
+    return true;
+}
+#elif VECTOR_UNIT_SSE2
+// Helper function to apply a lane-wise operation with SSE2, one 128-bit half at a time
+// (returns false if SSE2 has no instruction for it)
+static bool vector_execute_host(vector_op_t op, bool narrow, vector_reg_t *destination, const vector_reg_t *a, const vector_reg_t *b) {
+    switch (op) {
+        case VECTOR_ADD: case VECTOR_SUB: case VECTOR_AND: case VECTOR_OR: case VECTOR_XOR:
+            break;
+        case VECTOR_CMPEQ: case VECTOR_CMPLT:
+            if (!narrow) {
+                return false; // 64-bit compares need SSE4
+            }
+            break;
+        default:
+            return false; // Multiplies and per-lane shift counts need SSE4 or AVX2
+    }
+    for (int half = 0; half < 2; half++) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(const void *)&a->lanes[half * 2]);
+        __m128i y = _mm_loadu_si128((const __m128i *)(const void *)&b->lanes[half * 2]);
+        __m128i result;
+        switch (op) {
+            case VECTOR_ADD: result = narrow ? _mm_add_epi32(x, y) : _mm_add_epi64(x, y); break;
+            case VECTOR_SUB: result = narrow ? _mm_sub_epi32(x, y) : _mm_sub_epi64(x, y); break;
+            case VECTOR_AND: result = _mm_and_si128(x, y); break;
+            case VECTOR_OR: result = _mm_or_si128(x, y); break;
+            case VECTOR_XOR: result = _mm_xor_si128(x, y); break;
+            case VECTOR_CMPEQ: result = _mm_cmpeq_epi32(x, y); break;
+            default: result = _mm_cmpgt_epi32(y, x); break; // VECTOR_CMPLT
+        }
+        _mm_storeu_si128((__m128i *)(void *)&destination->lanes[half * 2], result);
+    }
+    return true;
+}
+#else
+// Helper function for hosts without SIMD support in the vector unit
+static bool vector_execute_host(vector_op_t op, bool narrow, vector_reg_t *destination, const vector_reg_t *a, const vector_reg_t *b) {
+    (void)op;
+    (void)narrow;
+    (void)destination;
+    (void)a;
+    (void)b;
+    return false;
+}
+#endif
+
+void vector_execute(vector_op_t op, bool narrow, vector_reg_t *destination, const vector_reg_t *a, const vector_reg_t *b) {
+    if (!vector_execute_host(op, narrow, destination, a, b)) {
+        vector_execute_scalar(op, narrow, destination, a, b);
+    }
+}
+
+uint64_t vector_reduce_sum(const vector_reg_t *source, bool narrow) {
+    uint64_t sum = 0;
+    if (narrow) {
+        for (int i = 0; i < LANES32; i++) {
+            sum += vector_lane32(source, i);
+        }
+    } else {
+        for (int i = 0; i < VECTOR_LANES; i++) {
+            sum += source->lanes[i];
+        }
+    }
+    return sum;
+}
+
+void vector_splat(vector_reg_t *destination, uint64_t value, bool narrow) {
+    if (narrow) {
+        value = (value & 0xFFFFFFFF) | (value << 32);
+    }
+    for (int i = 0; i < VECTOR_LANES; i++) {
+        destination->lanes[i] = value;
+    }
+}
+
+const char *vector_unit_name(void) {
+#if VECTOR_UNIT_AVX2
+    return "AVX2";
+#elif VECTOR_UNIT_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef VECTOR_UNIT_H
+#define VECTOR_UNIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The vector extension adds 32 registers of 256 bits. Every vector instruction works
+// on 4 lanes of 64 bits, or on 8 lanes of 32 bits when its width bit is set. Lane i
+// of a 32-bit view is bits (i % 2) * 32 of 64-bit lane i / 2, so the lanes keep the
+// order they have in (little-endian) guest memory.
+// The operations use AVX2 when the VM is built with it (e.g. -mavx2), SSE2 otherwise
+// on x86-64, and plain C for the lane widths and hosts those do not cover.
+
+#define NUM_VECTOR_REGISTERS 32
+#define VECTOR_LANES 4 // 64-bit lanes per register
+#define VECTOR_BYTES (VECTOR_LANES * sizeof(uint64_t))
+
+// Structure representing one vector register
+typedef struct {
+    uint64_t lanes[VECTOR_LANES];
+} vector_reg_t;
+
+// Lane-wise operations of the vector unit
+typedef enum {
+    VECTOR_ADD,
+    VECTOR_SUB,
+    VECTOR_MUL,
+    VECTOR_AND,
+    VECTOR_OR,
+    VECTOR_XOR,
+    VECTOR_SLL,    // Shift counts come from the lanes of the second operand (modulo the lane width)
+    VECTOR_SRL,
+    VECTOR_SRA,
+    VECTOR_CMPEQ,  // All ones in lanes that are equal, zero elsewhere
+    VECTOR_CMPLT   // All ones in lanes where the first operand is smaller (signed)
+} vector_op_t;
+
+// Function to apply a lane-wise operation (narrow selects 32-bit lanes)
+void vector_execute(vector_op_t op, bool narrow, vector_reg_t *destination, const vector_reg_t *a, const vector_reg_t *b);
+
+// Function to add up the lanes of a register (32-bit lanes are zero-extended before the sum)
+uint64_t vector_reduce_sum(const vector_reg_t *source, bool narrow);
+
+// Function to copy a value into every lane of a register
+void vector_splat(vector_reg_t *destination, uint64_t value, bool narrow);
+
+// Function to get the name of the host instructions used by the vector unit
+const char *vector_unit_name(void);
+
+#endif // VECTOR_UNIT_H
\ No newline at end of file
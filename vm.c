@@ -1,113 +1,601 @@
 #include "vm.h"
 #include "memory.h"
 #include "instruction_decoder.h" // Include the instruction decoder
+#include "instruction_execution.h"
+#include "threaded_interpreter.h"
+#include "program_verifier.h"
+#include "profiler.h"
+#include "trace.h"
+#include "block_device.h"
+#include "timer_device.h"
+#include "trap.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
-// ... (vm_init, vm_load_program, vm_fetch_instruction remain similar)
+// Helper function to reset one hart to the program entry
+static void cpu_reset(cpu_state_t *cpu) {
+    memset(cpu->registers, 0, sizeof(cpu->registers));
+    memset(cpu->vector_registers, 0, sizeof(cpu->vector_registers));
+    memset(cpu->fp_registers, 0, sizeof(cpu->fp_registers)); // All zero bits is +0.0
+    cpu->registers[1] = cpu->hart_id; // Lets the guest tell the harts apart
+    cpu->program_counter = cpu->vm->entry_point;
+    cpu->zero_flag = 0;
+    cpu->negative_flag = 0;
+    cpu->carry_flag = 0;
+    cpu->overflow_flag = 0;
+    cpu->reservation_valid = false;
+    cpu_reset_traps(cpu);
+    cpu->fuel = UINT64_MAX;
+    cpu->instructions_executed = 0;
+    cpu->exit_reason = VM_EXIT_NONE;
+    memset(&cpu->fault, 0, sizeof(cpu->fault));
+    cpu->halted = false;
+    cpu->running = true; // Runnable until it halts or faults
+}
 
-void vm_execute_instruction(vm_state_t *vm, uint64_t instruction_word) {
+// Helper function to initialize the hart with the given id
+static void cpu_init(vm_state_t *vm, cpu_state_t *cpu, uint32_t hart_id) {
+    memset(cpu, 0, sizeof(*cpu));
+    cpu->hart_id = hart_id;
+    cpu->vm = vm;
+    cpu->memory = &vm->memory;
+    memory_tlb_flush(&cpu->tlb);
+    predecode_init(&cpu->predecode);
+    cpu->predecode.fusion_enabled = vm->fusion_enabled;
+    if (vm->jit_enabled) {
+        cpu->jit = jit_create();
+    }
+    if (vm->profile_enabled) {
+        cpu->profile = profile_create();
+    }
+    if (vm->trace) {
+        cpu->trace_ring = trace_get_ring(vm->trace, hart_id);
+    }
+    cpu_reset(cpu);
+}
+
+// Helper function to release the caches of a hart
+static void cpu_destroy(cpu_state_t *cpu) {
+    jit_destroy(cpu->jit);
+    cpu->jit = NULL;
+    profile_destroy(cpu->profile);
+    cpu->profile = NULL;
+    predecode_free(&cpu->predecode);
+    cpu->running = false;
+}
+
+void vm_init(vm_state_t *vm) {
+    memory_init(&vm->memory);
+    console_init(&vm->console, false);
+    memory_add_device(&vm->memory, &vm->console.device);
+    vm->block = NULL;
+    vm->timer = timer_device_create(vm);
+    memory_add_device(&vm->memory, &vm->timer->device);
+    vm->cpus = NULL;
+    vm->num_cpus = 0;
+    vm->dispatch_mode = VM_DISPATCH_SWITCH;
+    vm->jit_enabled = false;
+    vm->fusion_enabled = true;
+    vm->profile_enabled = false;
+    vm->trace = NULL;
+    vm->code_start = 0;
+    vm->code_size = 0;
+    vm->entry_point = 0;
+    vm->verified = false;
+    vm->quiet = false;
+    vm_set_cpu_count(vm, 1);
+}
+
+void vm_destroy(vm_state_t *vm) {
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        cpu_destroy(&vm->cpus[i]);
+    }
+    free(vm->cpus);
+    vm->cpus = NULL;
+    vm->num_cpus = 0;
+    if (vm->trace) {
+        vm_finish_trace(vm, NULL);
+    }
+    if (vm->block) {
+        block_device_close(vm->block); // Its workers write guest memory until they stop
+        vm->block = NULL;
+    }
+    timer_device_destroy(vm->timer);
+    vm->timer = NULL;
+    console_destroy(&vm->console);
+    memory_free(&vm->memory);
+}
+
+bool vm_set_cpu_count(vm_state_t *vm, uint32_t count) {
+    if (count == 0 || count > VM_MAX_CPUS) {
+        fprintf(stderr, "Error: The number of harts must be between 1 and %d\n", VM_MAX_CPUS);
+        return false;
+    }
+    cpu_state_t *cpus = (cpu_state_t *)malloc(count * sizeof(cpu_state_t));
+    if (!cpus) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        cpu_destroy(&vm->cpus[i]);
+    }
+    free(vm->cpus);
+    vm->cpus = cpus;
+    vm->num_cpus = count;
+    for (uint32_t i = 0; i < count; i++) {
+        cpu_init(vm, &vm->cpus[i], i);
+    }
+    return true;
+}
+
+bool vm_load_program(vm_state_t *vm, const char *filename) {
+    memory_program_t program;
+    if (!memory_load_program(&vm->memory, filename, &program)) {
+        return false;
+    }
+    if (!vm->quiet) {
+        printf("Loaded %llu bytes into VM memory.\n", (unsigned long long)program.code_size);
+    }
+    vm->code_start = program.code_start;
+    vm->code_size = program.code_size;
+    vm->entry_point = program.entry_point;
+    vm->verified = false;
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        cpu_state_t *cpu = &vm->cpus[i];
+        memory_tlb_flush(&cpu->tlb);
+        predecode_set_verified_range(&cpu->predecode, 0, 0);
+        if (cpu->jit) {
+            jit_flush(cpu->jit);
+        }
+        cpu_reset(cpu);
+    }
+    return true;
+}
+
+bool vm_clone(vm_state_t *parent, vm_state_t *child) {
+    cpu_state_t *cpus = (cpu_state_t *)malloc(parent->num_cpus * sizeof(cpu_state_t));
+    if (!cpus) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if (memory_share(&parent->memory, &child->memory)) {
+        // The parent's pages now belong to the shared base and must not be written through its TLBs
+        for (uint32_t i = 0; i < parent->num_cpus; i++) {
+            memory_tlb_flush(&parent->cpus[i].tlb);
+        }
+    }
+    console_init(&child->console, parent->console.raw);
+    memory_add_device(&child->memory, &child->console.device);
+    child->block = NULL; // Clones writing one backing file would overwrite each other's data
+    child->timer = timer_device_create(child);
+    memory_add_device(&child->memory, &child->timer->device);
+    timer_device_set_time(child->timer, timer_device_time(parent->timer)); // The guest's clock carries on
+    child->cpus = cpus;
+    child->num_cpus = parent->num_cpus;
+    child->dispatch_mode = parent->dispatch_mode;
+    child->jit_enabled = parent->jit_enabled;
+    child->fusion_enabled = parent->fusion_enabled;
+    child->profile_enabled = false; // Clones run unprofiled and untraced
+    child->trace = NULL;
+    child->code_start = parent->code_start;
+    child->code_size = parent->code_size;
+    child->entry_point = parent->entry_point;
+    child->verified = parent->verified;
+    child->quiet = parent->quiet;
+
+    for (uint32_t i = 0; i < child->num_cpus; i++) {
+        const cpu_state_t *source = &parent->cpus[i];
+        cpu_state_t *cpu = &child->cpus[i];
+        cpu_init(child, cpu, i);
+        if (child->jit_enabled && !cpu->jit) {
+            child->num_cpus = i + 1; // Only these harts have been initialized
+            vm_destroy(child);
+            return false;
+        }
+        memcpy(cpu->registers, source->registers, sizeof(cpu->registers));
+        memcpy(cpu->vector_registers, source->vector_registers, sizeof(cpu->vector_registers));
+        memcpy(cpu->fp_registers, source->fp_registers, sizeof(cpu->fp_registers));
+        cpu->program_counter = source->program_counter;
+        cpu->zero_flag = source->zero_flag;
+        cpu->negative_flag = source->negative_flag;
+        cpu->carry_flag = source->carry_flag;
+        cpu->overflow_flag = source->overflow_flag;
+        cpu->trap_status = source->trap_status;
+        cpu->trap_vector = source->trap_vector;
+        cpu->trap_epc = source->trap_epc;
+        cpu->trap_cause = source->trap_cause;
+        cpu->trap_value = source->trap_value;
+        cpu->trap_scratch = source->trap_scratch;
+        cpu->interrupt_enable = source->interrupt_enable;
+        // Pending interrupts are raised again by the child's own devices
+        timer_device_set_compare(child->timer, i, parent->timer->compare[i]);
+        cpu->fuel = source->fuel;
+        cpu->instructions_executed = source->instructions_executed;
+        cpu->exit_reason = source->exit_reason;
+        cpu->fault = source->fault;
+        cpu->halted = source->halted;
+        cpu->running = source->running;
+        if (child->verified) {
+            predecode_set_verified_range(&cpu->predecode, child->code_start, child->code_start + child->code_size);
+        }
+    }
+    return true;
+}
+
+uint64_t cpu_fetch_instruction(cpu_state_t *cpu) {
+    uint64_t instruction_word = memory_tlb_read_word(&cpu->tlb, cpu->memory, cpu->program_counter);
+    cpu->program_counter += sizeof(uint64_t);
+    return instruction_word;
+}
+
+bool vm_parse_dispatch_mode(const char *name, vm_dispatch_mode_t *mode) {
+    if (strcmp(name, "switch") == 0) {
+        *mode = VM_DISPATCH_SWITCH;
+    } else if (strcmp(name, "threaded") == 0) {
+        *mode = VM_DISPATCH_THREADED;
+    } else if (strcmp(name, "call") == 0) {
+        *mode = VM_DISPATCH_CALL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool vm_verify_program(vm_state_t *vm) {
+    vm->verified = verify_program(&vm->memory, vm->code_start, vm->code_size);
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        if (vm->verified) {
+            predecode_set_verified_range(&vm->cpus[i].predecode, vm->code_start, vm->code_start + vm->code_size);
+        } else {
+            predecode_set_verified_range(&vm->cpus[i].predecode, 0, 0);
+        }
+    }
+    return vm->verified;
+}
+
+bool vm_enable_jit(vm_state_t *vm) {
+    if (!jit_available()) {
+        return false;
+    }
+    vm->jit_enabled = true;
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        if (!vm->cpus[i].jit) {
+            vm->cpus[i].jit = jit_create();
+        }
+        if (!vm->cpus[i].jit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool vm_attach_block_device(vm_state_t *vm, const char *path) {
+    block_device_t *block = block_device_open(path, &vm->memory);
+    if (!block) {
+        return false;
+    }
+    vm->block = block;
+    memory_add_device(&vm->memory, &block->device);
+    return true;
+}
+
+bool vm_enable_trace(vm_state_t *vm, const char *path) {
+    vm->trace = trace_open(path);
+    if (!vm->trace) {
+        return false;
+    }
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        vm->cpus[i].trace_ring = trace_get_ring(vm->trace, i);
+    }
+    return true;
+}
+
+bool vm_finish_trace(vm_state_t *vm, uint64_t *records_written) {
+    bool ok = trace_close(vm->trace, records_written);
+    vm->trace = NULL;
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        vm->cpus[i].trace_ring = NULL;
+    }
+    return ok;
+}
+
+void vm_enable_profile(vm_state_t *vm) {
+    vm->profile_enabled = true;
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        if (!vm->cpus[i].profile) {
+            vm->cpus[i].profile = profile_create();
+        }
+    }
+}
+
+// Helper function to settle the devices once every hart has stopped
+static void vm_finish_run(vm_state_t *vm) {
+    if (vm->block) {
+        block_device_drain(vm->block); // Requests still in flight complete before the state is inspected
+    }
+    timer_device_stop(vm->timer);
+    console_flush(&vm->console);
+}
+
+// Helper function run by the host thread of each hart
+static void *cpu_thread_main(void *arg) {
+    cpu_run((cpu_state_t *)arg);
+    return NULL;
+}
+
+// Helper function to combine the exit reasons of the harts into the result of vm_run
+static vm_exit_reason_t vm_exit_reason(const vm_state_t *vm) {
+    vm_exit_reason_t reason = VM_EXIT_NONE;
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        if (vm->cpus[i].exit_reason > reason) {
+            reason = vm->cpus[i].exit_reason;
+        }
+    }
+    return reason;
+}
+
+vm_exit_reason_t vm_run(vm_state_t *vm) {
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        predecode_cache_t *predecode = &vm->cpus[i].predecode;
+        if (predecode->fusion_enabled != vm->fusion_enabled) {
+            predecode->fusion_enabled = vm->fusion_enabled;
+            predecode_flush(predecode);
+        }
+    }
+    timer_device_start(vm->timer);
+    if (vm->num_cpus == 1) {
+        if (vm->cpus[0].running) {
+            cpu_run(&vm->cpus[0]);
+        }
+        vm_finish_run(vm);
+        return vm_exit_reason(vm);
+    }
+
+    // Harts that already stopped (e.g. in a restored snapshot) are not started again
+    pthread_t threads[VM_MAX_CPUS];
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < vm->num_cpus; i++) {
+        if (!vm->cpus[i].running) {
+            continue;
+        }
+        if (pthread_create(&threads[started], NULL, cpu_thread_main, &vm->cpus[i]) != 0) {
+            fprintf(stderr, "Error: Could not start the host thread of hart %u\n", i);
+            break;
+        }
+        started++;
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    vm_finish_run(vm);
+    return vm_exit_reason(vm);
+}
+
+const char *vm_exit_reason_name(vm_exit_reason_t reason) {
+    switch (reason) {
+        case VM_EXIT_HALT:
+            return "halt";
+        case VM_EXIT_OUT_OF_FUEL:
+            return "out of fuel";
+        case VM_EXIT_BREAKPOINT:
+            return "breakpoint";
+        case VM_EXIT_FAULT:
+            return "fault";
+        default:
+            return "none";
+    }
+}
+
+// Helper function to run the switch loop (every instruction goes through cpu_execute_decoded)
+static void cpu_run_switch(cpu_state_t *cpu) {
+    uint64_t fuel = cpu->fuel;
+    cpu->running = true;
+    while (cpu->running && fuel > 0) {
+        cpu_poll_interrupts(cpu);
+        // Hot code is decoded once per page; only the first fetch from a page pays for decoding
+        const predecoded_instruction_t *entry = predecode_lookup(&cpu->predecode, cpu->memory, cpu->program_counter);
+
+        // Charge one basic block at a time, as cpu_run_call_threaded does
+        uint64_t charged = entry->block_length < fuel ? entry->block_length : fuel;
+        const predecoded_instruction_t *block_end = entry + charged;
+        fuel -= charged;
+        for (; entry < block_end; entry++) {
+            uint64_t next_pc = cpu->program_counter + sizeof(uint64_t);
+            cpu->program_counter = next_pc;
+            cpu_execute_decoded(cpu, &entry->decoded);
+            // Only the last instruction of a block jumps, but any of them may fault or stop the hart
+            if (!cpu->running || cpu->program_counter != next_pc) {
+                break;
+            }
+        }
+        if (entry < block_end) {
+            fuel += (uint64_t)(block_end - entry) - 1; // Refund the slots that did not run
+        }
+    }
+    cpu->fuel = fuel;
+}
+
+vm_exit_reason_t cpu_run(cpu_state_t *cpu) {
+    vm_state_t *vm = cpu->vm;
+    uint64_t start_fuel = cpu->fuel;
+    cpu->exit_reason = VM_EXIT_NONE;
+    if (cpu->trace_ring) {
+        cpu_run_traced(cpu);
+    } else if (cpu->profile) {
+        cpu_run_profiled(cpu);
+    } else if (cpu->jit) {
+        jit_run(cpu);
+    } else if (vm->dispatch_mode == VM_DISPATCH_THREADED) {
+        cpu_run_threaded(cpu);
+    } else if (vm->dispatch_mode == VM_DISPATCH_CALL) {
+        cpu_run_call_threaded(cpu);
+    } else {
+        cpu_run_switch(cpu);
+    }
+    // Every tier charges the fuel, so it also counts the instructions
+    cpu->instructions_executed += start_fuel - cpu->fuel;
+
+    if (cpu->exit_reason == VM_EXIT_BREAKPOINT) {
+        cpu->running = true; // EBREAK only pauses the hart
+    } else if (cpu->halted) {
+        cpu->exit_reason = VM_EXIT_HALT;
+    } else if (!cpu->running) {
+        cpu->exit_reason = VM_EXIT_FAULT;
+    } else {
+        cpu->exit_reason = VM_EXIT_OUT_OF_FUEL;
+    }
+    return cpu->exit_reason;
+}
+
+void cpu_fence(cpu_state_t *cpu) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // Drop the decoded and compiled copies so code stored by other harts is fetched again
+    if (!__atomic_load_n(&cpu->vm->verified, __ATOMIC_RELAXED)) {
+        predecode_set_verified_range(&cpu->predecode, 0, 0);
+    } else {
+        predecode_flush(&cpu->predecode);
+    }
+    if (cpu->jit) {
+        jit_flush(cpu->jit);
+    }
+}
+
+void cpu_halt(cpu_state_t *cpu) {
+    if (!cpu->vm->quiet) {
+        console_flush(&cpu->vm->console); // The guest's output comes before the halt message
+        if (cpu->vm->num_cpus > 1) {
+            printf("Hart %u halted.\n", cpu->hart_id);
+        } else {
+            printf("VM halted.\n");
+        }
+    }
+    cpu->halted = true;
+    cpu->running = false;
+}
+
+void cpu_execute_instruction(cpu_state_t *cpu, uint64_t instruction_word) {
     decoded_instruction_t decoded = decode_instruction(instruction_word);
+    cpu_execute_decoded(cpu, &decoded);
+}
 
-    switch (decoded.opcode) {
+void cpu_execute_decoded(cpu_state_t *cpu, const decoded_instruction_t *decoded) {
+    switch (decoded->opcode) {
         case OP_ADD: { // ADD Rd, Rs1, Rs2
-            if (decoded.rd < NUM_REGISTERS && decoded.rs1 < NUM_REGISTERS && decoded.rs2 < NUM_REGISTERS) {
-                vm->registers[decoded.rd] = vm->registers[decoded.rs1] + vm->registers[decoded.rs2];
+            if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
+                cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] + cpu->registers[decoded->rs2];
             } else {
-                fprintf(stderr, "Error: Invalid register index in ADD instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
         case OP_SUB: { // SUB Rd, Rs1, Rs2
-            if (decoded.rd < NUM_REGISTERS && decoded.rs1 < NUM_REGISTERS && decoded.rs2 < NUM_REGISTERS) {
-                vm->registers[decoded.rd] = vm->registers[decoded.rs1] - vm->registers[decoded.rs2];
+            if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
+                cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] - cpu->registers[decoded->rs2];
             } else {
-                fprintf(stderr, "Error: Invalid register index in SUB instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
         case OP_HALT: { // HALT
-            printf("VM halted.\n");
-            vm->running = false;
+            cpu_halt(cpu);
             break;
         }
         case OP_LOAD: { // LOAD Rd, Address
-            if (decoded.rd < NUM_REGISTERS && decoded.address < MEMORY_SIZE - sizeof(reg_t) + 1) {
-                vm->registers[decoded.rd] = memory_read_word(decoded.address);
+            if (decoded->rd < NUM_REGISTERS) {
+                cpu->registers[decoded->rd] = memory_tlb_read_word(&cpu->tlb, cpu->memory, decoded->address);
             } else {
-                fprintf(stderr, "Error: Invalid register index or memory address in LOAD instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
         case OP_STORE: { // STORE Rs, Address
-            if (decoded.rd < NUM_REGISTERS && decoded.address < MEMORY_SIZE - sizeof(reg_t) + 1) {
-                memory_write_word(decoded.address, vm->registers[decoded.rd]);
+            if (decoded->rd < NUM_REGISTERS) {
+                if (memory_tlb_write_word(&cpu->tlb, cpu->memory, decoded->address, cpu->registers[decoded->rd])) {
+                    cpu_note_code_write(cpu, decoded->address, sizeof(reg_t));
+                } else {
+                    fault_out_of_memory(cpu, decoded->address);
+                }
             } else {
-                fprintf(stderr, "Error: Invalid register index or memory address in STORE instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
         case OP_ADDI: { // ADDI Rd, Rs1, Immediate
-            if (decoded.rd < NUM_REGISTERS && decoded.rs1 < NUM_REGISTERS) {
-                vm->registers[decoded.rd] = vm->registers[decoded.rs1] + decoded.immediate;
+            if (decoded->rd < NUM_REGISTERS && decoded->rs1 < NUM_REGISTERS) {
+                cpu->registers[decoded->rd] = cpu->registers[decoded->rs1] + decoded->immediate;
             } else {
-                fprintf(stderr, "Error: Invalid register index in ADDI instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
         case OP_LI: { // LI Rd, Immediate
-            if (decoded.rd < NUM_REGISTERS) {
-                vm->registers[decoded.rd] = decoded.immediate;
+            if (decoded->rd < NUM_REGISTERS) {
+                cpu->registers[decoded->rd] = decoded->immediate;
             } else {
-                fprintf(stderr, "Error: Invalid register index in LI instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
         case OP_JMP: { // JMP Address
-            vm->program_counter = decoded.address;
+            cpu->program_counter = decoded->address;
             break;
         }
         case OP_JR: { // JR Rs
-            if (decoded.rs1 < NUM_REGISTERS) {
-                vm->program_counter = vm->registers[decoded.rs1];
+            if (decoded->rs1 < NUM_REGISTERS) {
+                cpu->program_counter = cpu->registers[decoded->rs1];
+            } else {
+                fault_invalid_register(cpu, decoded);
+            }
+            break;
+        }
+        case OP_JAL: { // JAL Address
+            cpu->registers[LINK_REGISTER] = cpu->program_counter;
+            cpu->program_counter = decoded->address;
+            break;
+        }
+        case OP_JALR: { // JALR Rs
+            if (decoded->rs1 < NUM_REGISTERS) {
+                uint64_t target = cpu->registers[decoded->rs1];
+                cpu->registers[LINK_REGISTER] = cpu->program_counter;
+                cpu->program_counter = target;
             } else {
-                fprintf(stderr, "Error: Invalid register index in JR instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
+        case OP_RET: { // RET
+            cpu->program_counter = cpu->registers[LINK_REGISTER];
+            break;
+        }
         case OP_BEQ: { // BEQ Rs1, Rs2, Offset
-            if (decoded.rs1 < NUM_REGISTERS && decoded.rs2 < NUM_REGISTERS) {
-                if (vm->registers[decoded.rs1] == vm->registers[decoded.rs2]) {
-                    vm->program_counter += decoded.immediate; // Assuming offset is relative to current PC
+            if (decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
+                if (cpu->registers[decoded->rs1] == cpu->registers[decoded->rs2]) {
+                    cpu->program_counter += decoded->immediate; // Assuming offset is relative to current PC
                 }
             } else {
-                fprintf(stderr, "Error: Invalid register index in BEQ instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
         case OP_BNE: { // BNE Rs1, Rs2, Offset
-            if (decoded.rs1 < NUM_REGISTERS && decoded.rs2 < NUM_REGISTERS) {
-                if (vm->registers[decoded.rs1] != vm->registers[decoded.rs2]) {
-                    vm->program_counter += decoded.immediate; // Assuming offset is relative to current PC
+            if (decoded->rs1 < NUM_REGISTERS && decoded->rs2 < NUM_REGISTERS) {
+                if (cpu->registers[decoded->rs1] != cpu->registers[decoded->rs2]) {
+                    cpu->program_counter += decoded->immediate; // Assuming offset is relative to current PC
                 }
             } else {
-                fprintf(stderr, "Error: Invalid register index in BNE instruction.\n");
-                vm->running = false;
+                fault_invalid_register(cpu, decoded);
             }
             break;
         }
-        // Implement other instructions here
+        // The remaining instructions use their execute_* handler
         default: {
-            fprintf(stderr, "Error: Unknown opcode 0x%02X encountered.\n", decoded.opcode);
-            vm->running = false;
+            instruction_handler_t handler = get_instruction_handler(decoded->opcode);
+            if (handler) {
+                handler(cpu, decoded);
+                break;
+            }
+            cpu_fault(cpu, TRAP_CAUSE_ILLEGAL_INSTRUCTION, decoded->opcode);
             break;
         }
     }
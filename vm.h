@@ -6,37 +6,126 @@
 #include <stdbool.h>
 #include "instruction_set.h"
 #include "opcodes.h"
+#include "memory.h"
+#include "instruction_decoder.h"
+#include "predecode_cache.h"
+#include "jit.h"
+#include "cpu_state.h"
+#include "input_output.h"
 
-// Define the size of the virtual memory (example: 16 exebayt)
-#define MEMORY_SIZE (4294967296 * 4294967296)
+// Maximum number of harts (virtual CPUs) of one VM
+#define VM_MAX_CPUS 64
 
-// Define the number of general-purpose registers (from instruction_set.h)
-#define NUM_REGISTERS 32
+// Interpreter loop used by vm_run (selected at startup)
+typedef enum {
+    VM_DISPATCH_SWITCH,   // Central switch over the opcode (cpu_execute_decoded)
+    VM_DISPATCH_THREADED, // Computed goto between handlers of predecoded blocks
+    VM_DISPATCH_CALL      // Function pointer call to each slot's execute_* handler
+} vm_dispatch_mode_t;
 
-// Define the register type (from instruction_set.h)
-typedef uint64_t reg_t;
-
-// Structure representing the state of the SDSCKS virtual CPU
-typedef struct {
-    reg_t registers[NUM_REGISTERS];
-    uint64_t program_counter;
-    uint8_t memory[MEMORY_SIZE];
-    bool running;
+// Structure representing an SDSCKS machine: one or more harts sharing a guest
+// address space. Every hart starts at the program entry point with R1 holding its hart
+// id and runs on its own host thread; the VM stops once all harts have stopped.
+typedef struct vm_state_s {
+    vm_memory_t memory; // Sparse guest address space, pages are allocated on first write
+    console_t console;  // Console device mapped at CONSOLE_STATUS_ADDRESS
+    struct block_device_s *block; // Block device mapped at BLOCK_DEVICE_ADDRESS (NULL without a backing file)
+    struct timer_device_s *timer; // Timer device mapped at TIMER_DEVICE_ADDRESS
+    cpu_state_t *cpus;  // The harts of the machine
+    uint32_t num_cpus;
+    vm_dispatch_mode_t dispatch_mode;
+    bool jit_enabled;   // Every hart compiles hot blocks with its own JIT
+    bool fusion_enabled; // Fuse instruction pairs into superinstructions
+    bool profile_enabled; // Every hart runs the profiling loop and counts into its own profile
+    struct trace_s *trace; // Open trace file, every hart records into its own ring (NULL when not tracing)
+    uint64_t code_start; // Code range of the loaded program
+    uint64_t code_size;
+    uint64_t entry_point; // Address the harts start at
+    bool verified;       // The code range passed verify_program and runs unchecked
+    bool quiet;          // Do not print load and halt messages (batch mode)
 } vm_state_t;
 
-// Function to initialize the virtual machine state
+// Function to initialize the virtual machine state (with a single hart)
 void vm_init(vm_state_t *vm);
 
+// Function to release the memory owned by the virtual machine
+void vm_destroy(vm_state_t *vm);
+
+// Function to set the number of harts (call before loading the program)
+bool vm_set_cpu_count(vm_state_t *vm, uint32_t count);
+
+// Function to initialize child as a copy of a VM whose harts are stopped. The two share
+// the guest memory copy-on-write, so the cost does not depend on the size of the image.
+// Cloning again a parent that has not run since its last clone is thread-safe.
+bool vm_clone(vm_state_t *parent, vm_state_t *child);
+
 // Function to load the program (machine code) into the VM's memory
 bool vm_load_program(vm_state_t *vm, const char *filename);
 
-// Function to execute the program loaded in the VM
-void vm_run(vm_state_t *vm);
+// Function to execute the program loaded in the VM, one host thread per hart. It returns once
+// every hart has stopped or used up its fuel; calling it again resumes the harts that ran out
+// of fuel or stopped at a breakpoint (after the caller has given them more fuel).
+vm_exit_reason_t vm_run(vm_state_t *vm);
+
+// Function to get a printable name of an exit reason
+const char *vm_exit_reason_name(vm_exit_reason_t reason);
+
+// Function to parse a dispatch mode name ("switch", "threaded" or "call")
+bool vm_parse_dispatch_mode(const char *name, vm_dispatch_mode_t *mode);
+
+// Function to verify the loaded code and switch it to the unchecked handlers
+bool vm_verify_program(vm_state_t *vm);
+
+// Function to turn on the JIT compiler (returns false if the host does not support it)
+bool vm_enable_jit(vm_state_t *vm);
+
+// Function to give the guest a block device backed by a host file (see block_device.h).
+// Clones do not inherit it.
+bool vm_attach_block_device(vm_state_t *vm, const char *path);
+
+// Function to record every instruction into a trace file (see trace.h); it takes precedence
+// over the JIT and the dispatch mode
+bool vm_enable_trace(vm_state_t *vm, const char *path);
+
+// Function to write the rest of the trace and close it (returns false if it is incomplete)
+bool vm_finish_trace(vm_state_t *vm, uint64_t *records_written);
+
+// Function to turn on the instruction-level profiler (see profiler.h); it takes precedence
+// over the JIT and the dispatch mode
+void vm_enable_profile(vm_state_t *vm);
+
+// Helper function to drop the hart's decoded and compiled copies of code overwritten by a store.
+// Other harts keep running their copies until they execute FENCE.
+static inline void cpu_note_code_write(cpu_state_t *cpu, uint64_t address, uint64_t size) {
+    vm_state_t *vm = cpu->vm;
+    predecode_note_store(&cpu->predecode, address, size);
+    if (address < vm->code_start + vm->code_size && address + size > vm->code_start &&
+        __atomic_load_n(&vm->verified, __ATOMIC_RELAXED)) {
+        // Modified code is no longer known to be valid
+        __atomic_store_n(&vm->verified, false, __ATOMIC_RELAXED);
+        predecode_set_verified_range(&cpu->predecode, 0, 0);
+    }
+    if (cpu->jit) {
+        jit_note_store(cpu->jit, address, size);
+    }
+}
+
+// Function to run one hart on the calling thread until it stops or has used up its fuel
+vm_exit_reason_t cpu_run(cpu_state_t *cpu);
+
+// Function to order the hart's memory accesses and pick up code written by other harts (FENCE)
+void cpu_fence(cpu_state_t *cpu);
+
+// Function to stop a hart at a HALT instruction
+void cpu_halt(cpu_state_t *cpu);
 
 // Helper function to fetch the next instruction from memory
-uint64_t vm_fetch_instruction(vm_state_t *vm);
+uint64_t cpu_fetch_instruction(cpu_state_t *cpu);
 
 // Helper function to execute a single instruction
-void vm_execute_instruction(vm_state_t *vm, uint64_t instruction_word);
+void cpu_execute_instruction(cpu_state_t *cpu, uint64_t instruction_word);
+
+// Helper function to execute a single instruction that has already been decoded
+void cpu_execute_decoded(cpu_state_t *cpu, const decoded_instruction_t *decoded);
 
 #endif // VM_H
\ No newline at end of file